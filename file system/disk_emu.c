@@ -3,54 +3,112 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/stat.h>
 #include "disk_emu.h"
 
 
-FILE* fp = NULL;
+/*One open disk file. Each thread works on the disk it bound with   */
+/*disk_bind, the default disk if it bound none                       */
+/*A disk may keep blocks [slow_first, slow_first + slow_blocks) in a */
+/*second, slower file (see attach_slow_disk), the first file holds   */
+/*the blocks before and after them                                   */
+/*Every read_blocks and write_blocks call that reaches the file is   */
+/*counted as one device I/O (see disk_counters)                      */
+struct disk {
+    FILE* fp;
+    int block_size;
+    int max_block;
+    FILE* slow_fp;
+    int slow_first;
+    int slow_blocks;
+    int slow_latency; /*microseconds per block read or written*/
+    long long reads;
+    long long writes;
+    long long blocks_read;
+    long long blocks_written;
+};
+
+static struct disk disk_default;
+static __thread struct disk* disk = &disk_default;
 double L, p;
 double r;
-int BLOCK_SIZE, MAX_BLOCK, MAX_RETRY;
+int MAX_RETRY;
 
 /*----------------------------------------------------------*/
 /*Close the disk file filled when you don't need it anymore. */
 /*----------------------------------------------------------*/
 int close_disk()
 {
-    if(NULL != fp)
+    if(NULL != disk->fp)
+    {
+        fclose(disk->fp);
+        disk->fp = NULL;
+    }
+    if(NULL != disk->slow_fp)
     {
-        fclose(fp);
+        fclose(disk->slow_fp);
+        disk->slow_fp = NULL;
     }
+    disk->slow_blocks = 0;
     return 0;
 }
 
+/*---------------------------------------------------------------*/
+/*Finds the file and the byte offset holding block address       */
+/*---------------------------------------------------------------*/
+static FILE* locate(int address, off_t* offset)
+{
+    if (disk->slow_blocks == 0 || address < disk->slow_first)
+    {
+        *offset = (off_t)address * disk->block_size;
+        return disk->fp;
+    }
+    if (address < disk->slow_first + disk->slow_blocks)
+    {
+        *offset = (off_t)(address - disk->slow_first) * disk->block_size;
+        return disk->slow_fp;
+    }
+    *offset = (off_t)(address - disk->slow_blocks) * disk->block_size;
+    return disk->fp;
+}
+
+/*---------------------------------------------------------------*/
+/*Pauses for the latency of the slow file if address lies in it  */
+/*---------------------------------------------------------------*/
+static void slow_wait(int address)
+{
+    if (disk->slow_blocks > 0 && address >= disk->slow_first && address < disk->slow_first + disk->slow_blocks)
+    {
+        usleep(disk->slow_latency);
+    }
+}
+
 /*---------------------------------------*/
 /*Initializes a disk file filled with 0's*/
 /*---------------------------------------*/
 int init_fresh_disk(char *filename, int block_size, int num_blocks)
 {
-    int i, j;
-
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
+    disk->block_size = block_size;
+    disk->max_block = num_blocks;
     
     /*Initializes the random number generator*/
     srand((unsigned int)(time( 0 )) );
     /*Creates a new file*/
-    fp = fopen (filename, "w+b");
+    disk->fp = fopen (filename, "w+b");
 
-    if (fp == NULL)
+    if (disk->fp == NULL)
     {
         printf("Could not create new disk file %s\n\n", filename);
         return -1;
     }
     
-    /*Fills the file with 0's to its given size*/
-    for (i = 0; i < MAX_BLOCK; i++)
+    /*Extends the file with 0's to its given size, 64-bit so large disks fit*/
+    if (ftruncate(fileno(disk->fp), (off_t)disk->max_block * disk->block_size) != 0)
     {
-        for (j = 0; j < BLOCK_SIZE; j++)
-        {
-            fputc(0, fp);
-        }
+        printf("Could not size disk file %s\n\n", filename);
+        fclose(disk->fp);
+        disk->fp = NULL;
+        return -1;
     }
     return 0;
 }
@@ -59,13 +117,13 @@ int init_fresh_disk(char *filename, int block_size, int num_blocks)
 /*----------------------------*/
 int init_disk(char *filename, int block_size, int num_blocks)
 {
-    BLOCK_SIZE = block_size;
-    MAX_BLOCK = num_blocks;
+    disk->block_size = block_size;
+    disk->max_block = num_blocks;
     
     /*Opens a file*/
-    fp = fopen (filename, "r+b");
+    disk->fp = fopen (filename, "r+b");
 
-    if (fp == NULL)
+    if (disk->fp == NULL)
     {
         printf("Could not open %s\n\n", filename);
         return -1;
@@ -75,34 +133,35 @@ int init_disk(char *filename, int block_size, int num_blocks)
 
 /*-------------------------------------------------------------------*/
 /*Reads a series of blocks from the disk into the buffer             */
+/*Uses positioned I/O so several threads can read at the same time   */
 /*-------------------------------------------------------------------*/
 int read_blocks(int start_address, int nblocks, void *buffer)
 {
     int i, s;
     s = 0;
 
-    /*Sets up a temporary buffer*/
-    void* blockRead = (void*) malloc(BLOCK_SIZE);
-
     /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (start_address + nblocks > __atomic_load_n(&disk->max_block, __ATOMIC_ACQUIRE))
     {
         printf("out of bound error %d\n", start_address);
         return -1;
     }
 
-    /*Goto the data requested from the disk*/
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
-
     /*For every block requested*/
     for (i = 0; i < nblocks; ++i)
     {
+        off_t offset;
+        FILE* fp = locate(start_address + i, &offset);
+        slow_wait(start_address + i);
+        if (pread(fileno(fp), (char *)buffer+((size_t)i*disk->block_size), disk->block_size, offset) != disk->block_size)
+        {
+            break;
+        }
         s++;
-        fread(blockRead, BLOCK_SIZE, 1, fp);
-        memcpy((char *)buffer+(i*BLOCK_SIZE), blockRead, BLOCK_SIZE);  
     }
 
-    free(blockRead);
+    __atomic_add_fetch(&disk->reads, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk->blocks_read, s, __ATOMIC_RELAXED);
     return s;
 }
 
@@ -114,30 +173,136 @@ int write_blocks(int start_address, int nblocks, void *buffer)
     int i, s;
     s = 0;
 
-    void* blockWrite = (void*) malloc(BLOCK_SIZE);
-
     /*Checks that the data requested is within the range of addresses of the disk*/
-    if (start_address + nblocks > MAX_BLOCK)
+    if (start_address + nblocks > __atomic_load_n(&disk->max_block, __ATOMIC_ACQUIRE))
     {
         printf("out of bound error\n");
         return -1;
     }
 
-    /*Goto where the data is to be written on the disk*/        
-    fseek(fp, start_address * BLOCK_SIZE, SEEK_SET);
-
     /*For every block requested*/        
     for (i = 0; i < nblocks; ++i)
     {
+        off_t offset;
+        FILE* fp = locate(start_address + i, &offset);
+
         /*Pause until the latency duration is elapsed*/
         usleep(L);
+        slow_wait(start_address + i);
 
-        memcpy(blockWrite, (char *)buffer+(i*BLOCK_SIZE), BLOCK_SIZE);
-
-        fwrite(blockWrite, BLOCK_SIZE, 1, fp);
-        fflush(fp);
+        if (pwrite(fileno(fp), (char *)buffer+((size_t)i*disk->block_size), disk->block_size, offset) != disk->block_size)
+        {
+            break;
+        }
         s++;
     }
-    free(blockWrite);
+    __atomic_add_fetch(&disk->writes, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&disk->blocks_written, s, __ATOMIC_RELAXED);
     return s;
 }
+
+/*------------------------------------------------------------------*/
+/*Grows the open disk file to num_blocks blocks (the new ones read  */
+/*as 0's) while other threads keep reading and writing it. A file   */
+/*that is already that large is left as it is                       */
+/*------------------------------------------------------------------*/
+int extend_disk(int num_blocks)
+{
+    struct stat st;
+    off_t size = (off_t)(num_blocks - disk->slow_blocks) * disk->block_size;
+
+    if (disk->fp == NULL || fstat(fileno(disk->fp), &st) != 0)
+    {
+        return -1;
+    }
+    if (st.st_size < size && ftruncate(fileno(disk->fp), size) != 0)
+    {
+        printf("Could not extend disk file\n");
+        return -1;
+    }
+    __atomic_store_n(&disk->max_block, num_blocks, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/*------------------------------------------------------------------*/
+/*Moves blocks [first, first + nblocks) of the open disk to the     */
+/*file filename, each of them read or written in latency            */
+/*microseconds. With fresh the file is created filled with 0's and  */
+/*the first file gives up the room those blocks took in it          */
+/*------------------------------------------------------------------*/
+int attach_slow_disk(char *filename, int first, int nblocks, int fresh, int latency)
+{
+    if (disk->fp == NULL || first < 0 || nblocks <= 0 || first + nblocks > disk->max_block)
+    {
+        return -1;
+    }
+    disk->slow_fp = fopen (filename, fresh ? "w+b" : "r+b");
+    if (disk->slow_fp == NULL)
+    {
+        printf("Could not open %s\n\n", filename);
+        return -1;
+    }
+    if (fresh && (ftruncate(fileno(disk->slow_fp), (off_t)nblocks * disk->block_size) != 0
+                  || ftruncate(fileno(disk->fp), (off_t)(disk->max_block - nblocks) * disk->block_size) != 0))
+    {
+        printf("Could not size disk file %s\n\n", filename);
+        fclose(disk->slow_fp);
+        disk->slow_fp = NULL;
+        return -1;
+    }
+    disk->slow_first = first;
+    disk->slow_blocks = nblocks;
+    disk->slow_latency = latency;
+    return 0;
+}
+
+/*------------------------------------------------------------------*/
+/*Gives the read_blocks and write_blocks calls made on the disk of  */
+/*the calling thread and the blocks they moved since it was created */
+/*------------------------------------------------------------------*/
+void disk_counters(long long *reads, long long *writes, long long *blocks_read, long long *blocks_written)
+{
+    *reads = __atomic_load_n(&disk->reads, __ATOMIC_RELAXED);
+    *writes = __atomic_load_n(&disk->writes, __ATOMIC_RELAXED);
+    *blocks_read = __atomic_load_n(&disk->blocks_read, __ATOMIC_RELAXED);
+    *blocks_written = __atomic_load_n(&disk->blocks_written, __ATOMIC_RELAXED);
+}
+
+/*------------------------------------------------------------------*/
+/*Creates a disk that is not open yet, for disk_bind                */
+/*------------------------------------------------------------------*/
+struct disk* disk_create(void)
+{
+    return calloc(1, sizeof(struct disk));
+}
+
+/*------------------------------------------------------------------*/
+/*Closes and frees a disk made by disk_create                       */
+/*------------------------------------------------------------------*/
+void disk_destroy(struct disk* d)
+{
+    if (d == NULL)
+    {
+        return;
+    }
+    if (d->fp != NULL)
+    {
+        fclose(d->fp);
+    }
+    if (d->slow_fp != NULL)
+    {
+        fclose(d->slow_fp);
+    }
+    free(d);
+}
+
+/*------------------------------------------------------------------*/
+/*Makes d (the default disk if NULL) the disk of the calling thread */
+/*and returns the one it replaces                                   */
+/*------------------------------------------------------------------*/
+struct disk* disk_bind(struct disk* d)
+{
+    struct disk* prev = disk;
+    disk = d != NULL ? d : &disk_default;
+    return prev;
+}
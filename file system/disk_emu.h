@@ -3,3 +3,9 @@ int init_disk(char *filename, int block_size, int num_blocks);
 int read_blocks(int start_address, int nblocks, void *buffer);
 int write_blocks(int start_address, int nblocks, void *buffer);
 int close_disk();
+int extend_disk(int num_blocks);
+int attach_slow_disk(char *filename, int first, int nblocks, int fresh, int latency);
+void disk_counters(long long *reads, long long *writes, long long *blocks_read, long long *blocks_written);
+struct disk* disk_create(void);
+void disk_destroy(struct disk* d);
+struct disk* disk_bind(struct disk* d);
@@ -36,7 +36,10 @@ static int fuse_getattr(const char *path, struct stat *stbuf)
 static int fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
         off_t offset, struct fuse_file_info *fi)
 {
-    char file_name[MAXFILENAME];
+    struct sfs_dirent ents[64];
+    struct stat st;
+    SFS_DIR *dir;
+    int n, i;
     
     if (strcmp(path, "/") != 0)
         return -ENOENT;
@@ -44,10 +47,23 @@ static int fuse_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
     
-    while(sfs_getnextfilename(file_name)) {
-        filler(buf, &file_name[1], NULL, 0);
+    dir = sfs_opendir();
+    if (dir == NULL)
+        return -ENOMEM;
+    
+    /* names, i-nodes and sizes come back together, no lookup per file */
+    memset(&st, 0, sizeof(struct stat));
+    while ((n = sfs_readdir_plus(dir, ents, 64)) > 0) {
+        for (i = 0; i < n; i++) {
+            st.st_ino = ents[i].inode;
+            st.st_mode = S_IFREG | 0666;
+            st.st_nlink = 1;
+            st.st_size = ents[i].size;
+            filler(buf, &ents[i].name[1], &st, 0);
+        }
     }
     
+    sfs_closedir(dir);
     return 0;
 }
 
@@ -136,11 +152,39 @@ static int fuse_truncate(const char *path, off_t size)
     
     strcpy(filename, path);
     
-    fd = sfs_remove(filename);
+    fd = sfs_fopen(filename);
     if (fd == -1)
         return -errno;
     
+    if (sfs_ftruncate(fd, size) == -1) {
+        sfs_fclose(fd);
+        return -EFBIG;
+    }
+    
+    sfs_fclose(fd);
+    return 0;
+}
+
+static int fuse_fallocate(const char *path, int mode, off_t offset,
+        off_t length, struct fuse_file_info *fi)
+{
+    char filename[MAXFILENAME];
+    int fd;
+    
+    if (mode != 0)
+        return -EOPNOTSUPP;
+    
+    strcpy(filename, path);
+    
     fd = sfs_fopen(filename);
+    if (fd == -1)
+        return -errno;
+    
+    if (sfs_fallocate(fd, offset, length) == -1) {
+        sfs_fclose(fd);
+        return -ENOSPC;
+    }
+    
     sfs_fclose(fd);
     return 0;
 }
@@ -178,10 +222,15 @@ static struct fuse_operations xmp_oper = {
     .write = fuse_write, 
     .access = fuse_access,
     .create = fuse_create,
+    .fallocate = fuse_fallocate,
 };
 
 int main(int argc, char *argv[])
 {
+    int res;
+
     mksfs(1);
-    return fuse_main(argc, argv, &xmp_oper, NULL);
+    res = fuse_main(argc, argv, &xmp_oper, NULL);
+    sfs_unmount();
+    return res;
 }
@@ -1,424 +1,6658 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <stddef.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <time.h>
 #include "sfs_api.h"
 #include "disk_emu.h"
+#include "sfs_journal.h"
 
 /* --IMPORTANT INFORMATION REGARDING THE SFS--
 
-BLOCK SIZE: 512 BYTES
-DISK SIZE: 527 BLOCKS <- 1 (SUPERBLOCK) + 13 (I-NODE TABLE) + 512 (DATA BLOCKS) + 1 (BYTEMAP)
-MAX FILE SIZE: 140 BLOCKS
+BLOCK SIZE: 512 BYTES (sfs_mkfs: ANY POWER OF TWO FROM 512 TO 64K)
+DISK SIZE: 629 BLOCKS <- 1 (SUPERBLOCK) + 51 (I-NODE TABLE) + 64 (JOURNAL) + 512 (DATA BLOCKS) + 1 (BYTEMAP)
+I-NODE SIZE: 256 BYTES
+MAX FILE SIZE: 140 BLOCKS (12 + BLOCK SIZE / 4)
 MAX # OF FILES: 100
 
+THE NUMBERS ABOVE ARE THE GEOMETRY OF mksfs(1). sfs_mkfs TAKES THE BLOCK SIZE, THE DISK
+SIZE AND THE NUMBER OF I-NODES; THE SUPERBLOCK RECORDS THE RESULTING LAYOUT AND A MOUNT
+READS IT BACK INTO geo, SO EVERY SIZE BELOW THAT DEPENDS ON IT IS A RUNTIME VALUE. THE
+BYTEMAP TAKES AS MANY BLOCKS AT THE END OF THE DISK AS IT NEEDS (ONE BYTE PER DATA BLOCK).
+
+FILES OF UP TO INODE_INLINE_CAPACITY (248) BYTES KEEP THEIR DATA INSIDE THE I-NODE RECORD
+(FLAG INODE_INLINE), IN THE SPACE THAT OTHERWISE HOLDS THE BLOCK POINTERS. THEY OWN NO
+DATA BLOCK, AND ARE MOVED TO DATA BLOCKS THE FIRST TIME A WRITE GOES PAST THAT SIZE.
+
+A BLOCK POINTER OF 0 IS A HOLE: IT OWNS NO BLOCK AND READS AS ZEROS WITHOUT ANY DEVICE I/O.
+A SEEK PAST THE END OF A FILE FOLLOWED BY A WRITE LEAVES A HOLE, A WRITE THAT WOULD PUT A
+BLOCK OF ZEROS IN A HOLE LEAVES IT ONE, AND sfs_punch_hole TURNS A RANGE BACK INTO ONE.
+
+ALL METADATA BLOCKS (SUPERBLOCK, I-NODE TABLE, DIRECTORY, BYTEMAP) ARE READ AND WRITTEN
+THROUGH THE JOURNAL (SEE sfs_journal.c). DATA BLOCKS ARE WRITTEN IN PLACE (EXCEPT IN LOG MODE).
+
+--SHARED BLOCKS--
+
+THE BYTEMAP HOLDS A REFERENCE COUNT PER DATA BLOCK (0 = FREE): THE NUMBER OF I-NODE
+POINTERS AND INDIRECT BLOCK ENTRIES THAT POINT TO IT. CLONES AND SNAPSHOTS SHARE BLOCKS
+BY TAKING REFERENCES AND MARK THE FILES INODE_SHARED, AND A WRITE TO A SHARED FILE COPIES
+EVERY BLOCK (AND THE INDIRECT BLOCK) THAT IS STILL REFERENCED MORE THAN ONCE BEFORE IT
+CHANGES IT. BLOCKS BELOW A SHARED INDIRECT BLOCK ARE COUNTED ONCE, BY THE INDIRECT BLOCK.
+
+IN DEDUP MODE (sfs_dedup) EVERY DATA BLOCK WRITTEN IS FINGERPRINTED, AND A BLOCK WHOSE
+CONTENT IS ALREADY ON DISK TAKES A REFERENCE ON THAT BLOCK INSTEAD OF BEING ALLOCATED.
+BLOCKS IN THE FINGERPRINT INDEX ARE NEVER WRITTEN IN PLACE.
+
+--COMPRESSION--
+
+A FILE WITH INODE_COMPRESS (sfs_fcompress) IS WRITTEN IN GROUPS OF GROUP_BLOCKS LOGICAL
+BLOCKS. A GROUP THAT COMPRESSES INTO FEWER BLOCKS IS STORED AS A HEADER (COMPRESSED
+LENGTH) AND THE COMPRESSED BYTES IN ITS FIRST POINTERS, THE REST ARE 0 AND THE LAST ONE
+IS COMPRESSED_GROUP. OTHER GROUPS ARE STORED AS PLAIN BLOCKS. A COMPRESSED GROUP IS
+ALWAYS REWRITTEN TO NEW BLOCKS, SO IT IS NEVER CHANGED IN PLACE.
+
+--ALLOCATION GROUPS--
+
+THE DATA BLOCKS AND THE I-NODES ARE SPLIT INTO NUM_AGS ALLOCATION GROUPS, GROUP g OWNS
+DATA BLOCKS [g * AG_BLOCKS, (g + 1) * AG_BLOCKS) AND I-NODES [g * AG_INODES, (g + 1) * AG_INODES).
+A NEW FILE TAKES AN I-NODE IN THE GROUP WITH THE MOST FREE BLOCKS (ROUND ROBIN ON A TIE),
+AND THE BLOCKS OF A FILE ARE TAKEN FROM ITS I-NODE'S GROUP (NEXT FIT FROM THE GROUP'S
+ROTOR) UNTIL IT IS FULL, THEN FROM THE FOLLOWING GROUPS. THE DIRECTORY AND SNAPSHOT
+CATALOGS BELONG TO I-NODE 0, SO TO GROUP 0. THE FREE COUNT OF EACH GROUP IS KEPT IN MEMORY
+AND RECORDED IN THE SUPERBLOCK BY sfs_unmount, A CLEAN MOUNT READS IT BACK AND ANY OTHER
+MOUNT REBUILDS IT FROM THE BYTEMAP.
+
+--LOG MODE--
+
+IN LOG MODE (sfs_logmode) NO DATA BLOCK IS WRITTEN IN PLACE: EVERY BLOCK WRITTEN GOES TO
+A NEW BLOCK AT THE LOG HEAD AND THE OLD ONE IS RELEASED, LIKE A COPY ON WRITE OF A SHARED
+BLOCK. THE HEAD FILLS ONE SEGMENT (LOG_SEGMENT_BLOCKS CONSECUTIVE DATA BLOCKS) AFTER THE
+OTHER, SO THE BLOCKS OF A WRITE ARE ADJACENT ON DISK AND GO OUT AS ONE DEVICE WRITE.
+THE NUMBER OF USED BLOCKS OF EVERY SEGMENT IS KEPT IN MEMORY, SO MOVING THE HEAD DOES NOT
+READ THE BYTEMAP. METADATA IS ALREADY APPENDED TO THE JOURNAL, AND I-NODES KEEP THEIR PLACE IN THE TABLE SO
+NO I-NODE MAP IS NEEDED. A CLEANER THREAD KEEPS LOG_CLEAN_FREE EMPTY SEGMENTS AHEAD OF
+THE HEAD BY MOVING THE LIVE BLOCKS OF MOSTLY EMPTY SEGMENTS TO THE HEAD.
+
+--BLOCK CACHE--
+
+DATA BLOCKS READ BY sfs_fread ARE KEPT IN A BLOCK CACHE OF BCACHE_SIZE BYTES, LOOKED UP BY
+DISK ADDRESS AND EVICTED LEAST RECENTLY USED FIRST. IT IS WRITE-THROUGH: EVERY DATA BLOCK
+WRITE GOES TO THE DISK AND UPDATES A CACHED COPY, AND A BLOCK LEAVES THE CACHE WHEN IT IS
+FREED, SO READING THE DISK DIRECTLY IS ALWAYS SAFE. METADATA IS CACHED BY THE JOURNAL.
+A READ THAT GOES ON WHERE THE LAST ONE STOPPED LOADS READAHEAD_BLOCKS AHEAD OF ITSELF.
+sfs_fadvise CHANGES THAT PER FILE: SFS_FADV_SEQUENTIAL READS FURTHER AHEAD AND SENDS THE
+BLOCKS THE READER IS DONE WITH TO THE COLD END OF THE CACHE, SO A SCAN DOES NOT PUSH OUT
+WHAT OTHER FILES USE; SFS_FADV_RANDOM NEVER READS AHEAD; SFS_FADV_WILLNEED QUEUES THE
+RANGE FOR A PREFETCH THREAD AND SFS_FADV_DONTNEED DROPS IT FROM THE CACHE.
+
+--GROWING--
+
+sfs_grow MAKES A MOUNTED DISK LARGER WITHOUT UNMOUNTING IT. THE LAYOUT STAYS THE ONE
+sfs_mkfs WOULD GIVE A DISK OF THE NEW SIZE: THE DATA AREA GROWS OVER THE OLD BYTEMAP AND
+THE NEW BYTEMAP TAKES THE END OF THE DISK. THE PART OF THE NEW BYTEMAP PAST THE OLD END IS
+WRITTEN IN PLACE (NOTHING POINTS THERE YET), THE REST GOES THROUGH THE JOURNAL WITH THE NEW
+SUPERBLOCK, SO THE DISK SWITCHES TO THE NEW SIZE WITH ONE COMMIT. THE OLD BYTEMAP BLOCKS
+BECOME FREE DATA BLOCKS ONCE THE JOURNAL LETS GO OF THEM (SEE allocatable). THE CALLS IN
+FLIGHT ARE WAITED FOR WITH io_lock, THE SAME WAY sfs_logmode SWITCHES MODES. WITH
+sfs_autogrow SET, A WRITE THAT RUNS OUT OF BLOCKS GROWS THE DISK ITSELF AND GOES ON.
+
+--TIERS--
+
+sfs_mount CAN SPREAD A DISK OVER TWO IMAGES: THE LAST slow_size BYTES OF THE DATA AREA
+LIVE IN THE SLOW IMAGE, EVERYTHING ELSE (SUPERBLOCK, I-NODES, JOURNAL, THE FIRST DATA
+BLOCKS AND THE BYTEMAP) IN THE FAST ONE. A FILE WITH INODE_SLOW TAKES ITS BLOCKS FROM THE
+SLOW TIER, ANY OTHER FILE FROM THE FAST TIER, AND EITHER SPILLS INTO THE OTHER TIER WHEN
+ITS OWN IS FULL. NEW FILES START FAST. EVERY sfs_fread AND sfs_fwrite ADDS TO THE HEAT OF
+ITS FILE, AND A TIER THREAD FOLDS THE HEAT INTO A SCORE THAT HALVES EVERY
+TIER_INTERVAL_NS: A FAST FILE LEFT ALONE FOR TIER_COLD_PASSES PASSES MOVES TO THE SLOW
+TIER, A SLOW FILE WHOSE SCORE REACHES TIER_HOT_SCORE MOVES BACK WHILE THE FAST TIER KEEPS
+TIER_RESERVE_PERCENT OF ITSELF FREE. A MOVE IS ONE TRANSACTION UNDER THE FILE'S I-NODE
+LOCK, LIKE A DEFRAG MOVE, SO NAMES AND DESCRIPTORS DO NOT CHANGE. sfs_ftier MOVES A FILE
+AT ONCE. NOTHING MOVES IN LOG MODE, AND A TWO-IMAGE DISK CANNOT GROW.
+
+--TRACING--
+
+sfs_trace MAKES A MOUNTED INSTANCE WRITE A LINE FOR EVERY sfs_fopen, sfs_fclose,
+sfs_fwrite, sfs_fread, sfs_fseek AND sfs_remove THAT SUCCEEDS, FOR sfs_replay TO PLAY BACK:
+
+    MICROSECONDS SINCE sfs_trace  open NAME FD | close FD | write FD BYTES | read FD BYTES
+                                  | seek FD OFFSET | remove NAME
+
+THE TIME IS WHEN THE CALL STARTED, AND A write OR read RECORDS THE BYTES IT MOVED. LINES
+OF CALLS THAT OVERLAP COME OUT IN THE ORDER THE CALLS RETURN.
+
+--INSTANCES--
+
+EVERYTHING BELOW LIVES IN A struct sfs: THE DEFAULT ONE (sfs_disk, USED BY mksfs AND BY
+THREADS THAT NEVER CALLED sfs_use) OR ONE MADE BY sfs_mount. EACH THREAD WORKS ON THE
+INSTANCE IN fs, AND BINDING AN INSTANCE ALSO BINDS ITS JOURNAL AND ITS DISK.
+
+THE BLOCKS, GROUPS AND OPEN FILES A CALL WORKS ON COME FROM THE INSTANCE'S SCRATCH ARENA:
+A FREE LIST PER POWER OF TWO SIZE THAT A BUFFER GOES BACK TO WHEN THE CALL IS DONE WITH
+IT. ONLY A LIST THAT RUNS EMPTY TAKES A NEW BUFFER FROM THE HEAP (COUNTED IN heap_allocs),
+SO ONCE THE LISTS HAVE GROWN TO THE NUMBER OF CALLS IN FLIGHT, OPENING, READING, WRITING
+AND CLOSING FILES DOES NOT ALLOCATE. SINGLE I-NODES AND OTHER SMALL RECORDS LIVE ON THE STACK.
+
+--LOCKING--
+
+io_lock         (READERS/WRITER) HELD FOR READING BY A CALL ON A DESCRIPTOR, FOR WRITING TO SWITCH MODES WITH NO SUCH CALL IN FLIGHT
+fdt_lock        (READERS/WRITER) GUARDS THE FILE DESCRIPTOR TABLE AND THE OPEN FILE TABLE, ONLY HELD TO PIN AN open_file (SEE fdtpin)
+dir_lock        (READERS/WRITER) GUARDS THE DIRECTORY BLOCKS
+inode_locks[i]  (READERS/WRITER) GUARDS THE SIZE, POINTERS AND DATA OF FILE i
+alloc_lock      GUARDS BLOCK AND I-NODE ALLOCATION, THE SUMMARY COUNTERS, THE GROUP STATE AND THE LOG HEAD
+dedup_lock      GUARDS THE FINGERPRINT INDEX AND THE DEDUP COUNTERS
+dcache_lock     SERIALIZES UPDATES OF THE LOOKUP CACHE, READERS OF THE CACHE TAKE NO LOCK
+bcache_lock     GUARDS THE BLOCK CACHE, ITS COUNTERS AND THE PREFETCH QUEUE, NO I/O IS DONE WHILE IT IS HELD
+scratch_lock    GUARDS THE FREE LISTS OF THE SCRATCH ARENA, NOTHING IS TAKEN WHILE IT IS HELD
+prefetch_lock   SERIALIZES STARTING AND JOINING THE PREFETCH THREAD, TAKEN WITH NO OTHER LOCK HELD
+grow_lock       SERIALIZES GROWING THE DISK, TAKEN BEFORE ANY OTHER LOCK
+trace_lock      SERIALIZES LINES OF THE TRACE FILE, NOTHING IS TAKEN WHILE IT IS HELD
+
+LOCK ORDER: jnl_begin -> dir_lock -> io_lock -> fdt_lock -> inode_locks -> alloc_lock -> dedup_lock -> dcache_lock -> bcache_lock -> scratch_lock
+RECORDS THAT SHARE A BLOCK (I-NODES, BYTEMAP ENTRIES) ARE UPDATED WITH jnl_patch.
+
 */
 
 
-#define BLOCK_SIZE 512
-#define NUM_BLOCKS 527
-#define MAX_NUM_OF_FILES 100
-#define INODE_SIZE 64
-#define DATA_BLOCKS_OFFSET 14
-#define NUM_DIRECTORY_ENTRIES_PER_BLOCK 16
-#define NUM_INODES_PER_BLOCK 8
+#define DEFAULT_BLOCK_SIZE 512 //geometry of mksfs(1)
+#define DEFAULT_NUM_BLOCKS 629
+#define DEFAULT_NUM_INODES 102
+#define MIN_BLOCK_SIZE 512 //the superblock is read with this block size before the real one is known
+#define MAX_BLOCK_SIZE 65536
+#define INODE_SIZE 256
+#define NUM_JOURNAL_BLOCKS 64
 #define NUM_DIRECT_POINTERS_PER_INODE 12
-#define NUM_INODE_BLOCKS 13
+#define MAX_FILE_NAME_LENGTH MAXFILENAME
+#define DCACHE_SIZE 256
+#define FDT_INITIAL_SIZE 64
+#define GROUP_BLOCKS 4 //compression group, MAX_FILE_BLOCKS is a multiple of it
+#define GROUP_SIZE (GROUP_BLOCKS * BLOCK_SIZE)
+#define GROUP_HEADER_SIZE ((int)sizeof(int))
+#define COMPRESSED_GROUP -1 //last pointer of a compressed group
+#define FSCK_THREADS 4
+#define LZ_HASH_BITS 12
+#define NUM_AGS 4 //allocation groups, NUM_DATA_BLOCKS is a multiple of it
+#define DEFRAG_SLICE_NS 100000000L //longest sleep between checks for sfs_defrag_stop
+#define LOG_SEGMENT_BLOCKS 32 //unit the log head moves by, divides every block size
+#define LOG_CLEAN_FREE 4 //the cleaner runs while fewer segments than this are empty
+#define LOG_CLEAN_PERCENT 50 //and empties segments that are at most this full
+#define LOG_CLEAN_INTERVAL_NS 100000000L //pause between two cleaner passes
+#define COPY_CHUNK_BLOCKS 32 //blocks sfs_copy_range moves per transfer when it cannot share
+#define ZERO_CHUNK_BLOCKS 32 //blocks of zeros sfs_fallocate writes per transfer
+#define SCRATCH_CLASSES 14 //scratch buffer sizes MIN_BLOCK_SIZE << 0..13 (512 bytes to 4M)
+#define BCACHE_SIZE (1 << 20) //bytes of data blocks the block cache holds
+#define READAHEAD_BLOCKS 8 //window read ahead of a reader that goes on where it stopped
+#define READAHEAD_SEQ_BLOCKS 32 //window read ahead of an SFS_FADV_SEQUENTIAL reader
+#define PREFETCH_QUEUE 64 //runs of blocks waiting for the prefetch thread
+#define PREFETCH_RUN_BLOCKS 32 //longest run it loads with one device read
+#define GROW_JOURNAL_BLOCKS 16 //most new bytemap blocks a grow may place inside the old disk
+#define TIER_INTERVAL_NS 100000000L //pause between two passes of the tier thread
+#define TIER_COLD_PASSES 10 //passes without an access that send a file to the slow tier
+#define TIER_HOT_SCORE 8 //score that brings a file back to the fast tier
+#define TIER_RESERVE_PERCENT 10 //of the fast tier left free for new files
+
+struct geometry {
+    int block_size;
+    int num_blocks;
+    int inode_blocks;
+    int data_start;
+    int data_blocks;
+    int bytemap_start;
+    int bytemap_blocks;
+    int dedup_size; //power of two, at least twice the number of data blocks
+    int slow_start; //first data block of the slow tier, see --TIERS--
+    int slow_blocks; //0 IF THE DISK IS ONE IMAGE
+};
+
+#define BLOCK_SIZE (fs->geo.block_size)
+#define NUM_BLOCKS (fs->geo.num_blocks)
+#define NUM_INODE_BLOCKS (fs->geo.inode_blocks)
+#define NUM_INODES_PER_BLOCK (BLOCK_SIZE / INODE_SIZE)
+#define NUM_INODES (NUM_INODE_BLOCKS * NUM_INODES_PER_BLOCK)
+#define JOURNAL_OFFSET (1 + NUM_INODE_BLOCKS)
+#define DATA_BLOCKS_OFFSET (fs->geo.data_start)
+#define NUM_DATA_BLOCKS (fs->geo.data_blocks)
+#define BYTEMAP_OFFSET (fs->geo.bytemap_start)
+#define NUM_BYTEMAP_BLOCKS (fs->geo.bytemap_blocks)
+#define NUM_DIRECTORY_ENTRIES_PER_BLOCK (BLOCK_SIZE / (int)sizeof(struct dir_entry))
+#define MAX_FILE_BLOCKS (NUM_DIRECT_POINTERS_PER_INODE + BLOCK_SIZE / (int)sizeof(int))
+#define DIR_INDEX_SIZE BLOCK_SIZE //power of two, at least twice the directory capacity
+#define DEDUP_INDEX_SIZE (fs->geo.dedup_size)
+#define AG_BLOCKS (NUM_DATA_BLOCKS / NUM_AGS)
+#define AG_INODES ((NUM_INODES + NUM_AGS - 1) / NUM_AGS)
+#define NUM_SEGMENTS ((NUM_DATA_BLOCKS + LOG_SEGMENT_BLOCKS - 1) / LOG_SEGMENT_BLOCKS)
 
 struct dir_entry {
-    char file_name[28];
+    char file_name[MAX_FILE_NAME_LENGTH];
     int file_ptr;
 };
 
-struct dir_block {
-    struct dir_entry entries[NUM_DIRECTORY_ENTRIES_PER_BLOCK];
-};
+#define INODE_INLINE 0x01 //data is stored in the i-node record, see inlinedata()
+#define INODE_SHARED 0x02 //blocks may be shared with a clone or a snapshot
+#define INODE_COMPRESS 0x04 //new writes are compressed, see groupwrite()
+#define INODE_SLOW 0x08 //blocks come from the slow tier, see --TIERS--
 
 struct inode {
     unsigned char active;
+    unsigned char flags;
     int file_size;
     int ptrs[NUM_DIRECT_POINTERS_PER_INODE];
     int indirect_ptr;
+    char extended[INODE_SIZE - 60]; //rest of the extended record, inline data continues here
 };
 
-struct inode_block {
-    struct inode nodes[NUM_INODES_PER_BLOCK];
-};
+#define INODE_INLINE_CAPACITY ((int)(sizeof(struct inode) - offsetof(struct inode, ptrs)))
+#define inlinedata(node) ((char*)(node)->ptrs)
 
 struct superblock {
     int blk_sz;
     int fs_sz;
     int inode_table_sz;
     int root_dir;
+    int jnl_start;
+    int jnl_sz;
+    int snapshots[SFS_MAX_SNAPSHOTS]; //header block of each snapshot, 0 IF THE SLOT IS FREE
+    int clean; //set by sfs_unmount, cleared while mounted
+    int free_blocks; //summary counters, valid when clean
+    int free_inodes;
+    int data_start; //first data block
+    int data_sz;
+    int bytemap_start;
+    int bytemap_sz;
+    int slow_sz; //data blocks in the slow image, 0 FOR ONE IMAGE
+    int ag_saved; //ag_free holds the group counts, set by sfs_unmount
+    int ag_free[NUM_AGS]; //free data blocks of each allocation group, valid when clean
+};
+
+/* --SNAPSHOTS--
+
+A SNAPSHOT IS A HEADER BLOCK AND A CATALOG: ONE snapshot_entry (NAME AND A COPY OF THE
+I-NODE) PER FILE, PACKED ACROSS THE CATALOG BLOCKS. THE COPIED I-NODES HOLD A REFERENCE
+ON EVERY BLOCK THEY POINT TO, SO TAKING A SNAPSHOT ONLY WRITES METADATA. HEADER AND
+CATALOG ARE WRITTEN IN PLACE LIKE DATA AND ONLY BECOME REACHABLE WHEN THE SUPERBLOCK
+SLOT IS COMMITTED.
+
+*/
+
+struct snapshot_entry {
+    char file_name[MAX_FILE_NAME_LENGTH];
+    int inode_num;
+    struct inode node;
+};
+
+#define SNAPSHOT_MAX_BLOCKS (BLOCK_SIZE / (int)sizeof(int) - 2)
+
+struct snapshot_header {
+    int count; //files in the catalog
+    int nblocks; //catalog blocks
+    int blocks[]; //SNAPSHOT_MAX_BLOCKS of them fill the header block
+};
+
+/* --OPEN FILE TABLE--
+
+ONE open_file PER OPEN I-NODE, SHARED BY EVERY DESCRIPTOR OF THAT FILE. IT CACHES THE
+I-NODE AND THE LOGICAL -> DISK BLOCK MAP SO READS AND WRITES DO NOT GO BACK TO THE
+I-NODE TABLE OR THE INDIRECT BLOCK. BOTH ARE GUARDED BY THE FILE'S inode_locks ENTRY.
+
+THE DESCRIPTOR TABLE GROWS BY DOUBLING AND KEEPS ITS FREE SLOTS ON A LIST, SO OPEN AND
+CLOSE ARE CONSTANT TIME. A FREE SLOT HAS of == NULL. A FILE OPENED FROM A SNAPSHOT GETS
+AN open_file OF ITS OWN THAT IS NOT IN open_files, ITS I-NODE NUMBER IS THE LIVE FILE'S.
+
+A CALL ON A DESCRIPTOR PINS ITS open_file WITH A REFERENCE AND THE OFFSET IT WORKS AT IN
+A SHORT fdt_lock SECTION, THEN DROPS THE LOCK FOR THE I/O (SEE filebegin), SO OPENING AND
+CLOSING FILES NEVER WAITS FOR A READ OR A WRITE. A READ OR A WRITE MOVES THE OFFSET BY
+THE WHOLE LENGTH WHEN IT STARTS AND BACK TO WHERE IT STOPPED WHEN IT ENDS, SO CALLS
+SHARING A DESCRIPTOR GET RANGES OF THEIR OWN. sfs_fclose LEAVES A PINNED open_file TO
+THE LAST CALL THAT DROPS IT.
+
+*/
+
+struct open_file {
+    int inode_num;
+    int snapshot; //snapshot the file was opened from (read-only), -1 FOR A LIVE FILE
+    int refcount; //descriptors sharing this object plus calls pinning it (see fdtpin), changed atomically
+    int unlinked; //file was removed while open
+    struct inode node;
+    int* blockmap; //MAX_FILE_BLOCKS entries, allocated with the object (see ofalloc)
+    pthread_mutex_t cache_lock; //guards the group cache, readers share the i-node lock
+    int cache_group; //compressed group held in cache, -1 IF NONE
+    char* cache; //GROUP_SIZE bytes
+    int advice; //SFS_FADV_NORMAL, SFS_FADV_RANDOM OR SFS_FADV_SEQUENTIAL, see sfs_fadvise
+    int ra_next; //offset the last read ended at, a read starting there is sequential
+    int ra_start; //logical blocks [ra_start, ra_end) were read ahead last
+    int ra_end;
 };
 
 struct fdt_entry {
+    struct open_file* of;
     int rw_ptr;
+    int next_free;
+};
+
+struct sfs_dir {
+    int pos; //next directory slot, or catalog index of a snapshot
+    struct snapshot_entry* catalog; //snapshot being listed, NULL FOR THE LIVE DIRECTORY
+    int count; //files in catalog
+};
+
+struct dedup_entry {
+    unsigned long long hash[2]; //128-bit fingerprint of the block
+    int block; //disk address, 0 IF THE SLOT IS EMPTY
+};
+
+struct log_run {
+    char* data; //LOG_SEGMENT_BLOCKS blocks
+    int first; //disk address of the first block held
+    int len;
+};
+
+struct bcache_entry {
+    int block; //disk address, 0 IF THE ENTRY IS EMPTY
+    int prev; //neighbour toward the most recently used end, -1 AT THE HEAD
+    int next; //neighbour toward the least recently used end, -1 AT THE TAIL
+    int hnext; //next entry on the same hash chain, -1 AT THE END
+};
+
+struct prefetch_req {
+    int block; //disk address of the first block
+    int count;
+};
+
+struct dcache_entry {
+    unsigned int seq; //odd while the entry is being updated
     int file_ptr;
+    char file_name[MAX_FILE_NAME_LENGTH];
+};
+
+//--ALL STATE OF ONE MOUNTED FILE SYSTEM, SEE --INSTANCES--
+struct sfs {
+    char* path; //disk file
+    struct disk* disk;
+    struct jnl_state* jnl;
+    int users; //threads bound with sfs_use or inside a handle call, -1 ONCE sfs_umount STARTS
+    struct geometry geo; //layout of the mounted disk
+    struct fdt_entry* fdt;
+    int fdt_size;
+    int fdt_free;
+    struct open_file** open_files; //NUM_INODES entries, allocated at mount
+    struct dcache_entry dcache[DCACHE_SIZE];
+    SFS_DIR default_dir; //cursor behind sfs_getnextfilename
+    int mounted;
+    int snap_open[SFS_MAX_SNAPSHOTS]; //descriptors open on each snapshot, guarded by fdt_lock
+    int free_blocks; //summary counters, guarded by alloc_lock
+    int free_inodes;
+    int ag_free[NUM_AGS]; //free data blocks of each allocation group, guarded by alloc_lock
+    int ag_rotor[NUM_AGS]; //where the next search of each group starts
+    int ag_next; //first group tried for the next new file
+    int* free_seq; //transaction (jnl_seq) that freed each data block, see allocatable
+    int last_free_seq; //transaction of the last block freed, guarded by alloc_lock
+    int dedup_on;
+    struct dedup_entry* dedup_index; //DEDUP_INDEX_SIZE entries, NULL WHILE DEDUP IS OFF
+    int* dedup_slot; //index slot + 1 of each data block, 0 IF NOT INDEXED, NULL WHILE DEDUP IS OFF
+    struct sfs_dedup_stats dedup_stats;
+    pthread_t defrag_thread;
+    int defrag_running; //a defrag thread was started and not joined yet
+    int defrag_cancel; //set by sfs_defrag_stop, read by the thread
+    int defrag_rate; //blocks per second, 0 IF UNLIMITED
+    struct sfs_defrag_stats defrag_stats;
+    int log_on;
+    int log_head; //data block the log appends at next, guarded by alloc_lock
+    struct sfs_log_stats log_stats;
+    pthread_t log_thread;
+    int log_running; //the cleaner was started and not joined yet
+    int log_cancel; //set when log mode is turned off, read by the cleaner
+    unsigned char* log_victim; //segments being emptied by the cleaner, guarded by alloc_lock
+    int* seg_live; //used blocks of each segment, guarded by alloc_lock, NULL WHILE LOG MODE IS OFF
+    pthread_rwlock_t io_lock;
+    pthread_rwlock_t fdt_lock;
+    pthread_rwlock_t dir_lock;
+    pthread_rwlock_t* inode_locks; //NUM_INODES entries
+    pthread_mutex_t alloc_lock;
+    pthread_mutex_t dedup_lock;
+    pthread_mutex_t dcache_lock;
+    struct scratch* scratch[SCRATCH_CLASSES]; //free scratch buffers of each size class
+    long long heap_allocs; //buffers the scratch arena had to take from the heap
+    pthread_mutex_t scratch_lock;
+    struct bcache_entry* bcache; //bcache_blocks entries, allocated at mount
+    int* bcache_hash; //first entry of each hash chain, -1 IF EMPTY
+    char* bcache_data; //bcache_blocks blocks
+    int bcache_blocks;
+    int bcache_head; //most recently used entry
+    int bcache_tail; //least recently used entry, evicted next
+    unsigned int bcache_gen; //bumped by every write or drop, see cacheinsert
+    struct sfs_cache_stats cache_stats; //guarded by bcache_lock
+    struct prefetch_req prefetch_queue[PREFETCH_QUEUE]; //guarded by bcache_lock
+    int prefetch_next; //oldest request in the queue
+    int prefetch_count;
+    int prefetch_running; //the prefetch thread is working on the queue
+    int prefetch_started; //a prefetch thread was started and not joined yet
+    pthread_t prefetch_thread;
+    pthread_mutex_t bcache_lock;
+    pthread_mutex_t prefetch_lock;
+    long long grow_step; //bytes a full disk grows by, 0 IF IT DOES NOT, see sfs_autogrow
+    pthread_mutex_t grow_lock;
+    char* slow_path; //image of the slow tier, NULL FOR ONE IMAGE
+    long long slow_size; //bytes of the slow tier of a new file system
+    int slow_latency;
+    unsigned int* heat; //accesses of each file since the last tier pass, NUM_INODES entries
+    struct sfs_tier_stats tier_stats; //guarded by bcache_lock
+    pthread_t tier_thread;
+    int tier_running; //the tier thread was started and not joined yet
+    int tier_cancel; //set to stop the tier thread
+    FILE* trace; //trace file of sfs_trace, NULL IF CALLS ARE NOT TRACED
+    long long trace_epoch; //time sfs_trace started, in microseconds
+    pthread_mutex_t trace_lock;
+};
+
+static struct sfs sfs_default = {
+    .path = "sfs_disk",
+    .fdt_free = -1,
+    .io_lock = PTHREAD_RWLOCK_INITIALIZER,
+    .fdt_lock = PTHREAD_RWLOCK_INITIALIZER,
+    .dir_lock = PTHREAD_RWLOCK_INITIALIZER,
+    .alloc_lock = PTHREAD_MUTEX_INITIALIZER,
+    .dedup_lock = PTHREAD_MUTEX_INITIALIZER,
+    .dcache_lock = PTHREAD_MUTEX_INITIALIZER,
+    .scratch_lock = PTHREAD_MUTEX_INITIALIZER,
+    .bcache_lock = PTHREAD_MUTEX_INITIALIZER,
+    .prefetch_lock = PTHREAD_MUTEX_INITIALIZER,
+    .grow_lock = PTHREAD_MUTEX_INITIALIZER,
+    .trace_lock = PTHREAD_MUTEX_INITIALIZER,
 };
+static __thread struct sfs* fs = &sfs_default; //instance of the calling thread, see sfs_use
 
-static struct fdt_entry fdt[MAX_NUM_OF_FILES];
+static void fdtreset(void);
+static void geofree(void);
+static void dedup_forget(int block);
+static struct snapshot_entry* snapload(int id, struct snapshot_header* hdr);
+static void defragjoin(int cancel);
+static int logalloc(void);
+static void logappend(struct log_run* run, int block, const char* data);
+static void logflush(struct log_run* run);
+static void logjoin(void);
+static void prefetchjoin(void);
+static int growfs(long long disk_size, int full);
+static int tierof(int inode_num);
+static void tierjoin(void);
+static int freepending(void);
+static long long tracestart(void);
+static void traceop(long long start, const char* format, ...);
 
 /* --HELPER FUNCTION--
 
-SEARCHES FREE BITMAP FOR NEXT AVAILABLE BLOCK
-RETURNS INDEX OF FREE BLOCK OR,
-RETURNS -1 IF ALL BLOCKS FULL
-RETURNS -2 FOR ALL OTHER FAILURE
+MAKES f THE INSTANCE OF THE CALLING THREAD, WITH ITS JOURNAL AND ITS DISK
+RETURNS THE INSTANCE IT REPLACES
 
 */
 
-int getnextfreeblock(){
-    void* buffer = (void*) malloc(BLOCK_SIZE); 
-    if(read_blocks(NUM_BLOCKS - 1, 1, buffer) != 1) 
-    return -2;
-    unsigned char* bytemap = (unsigned char*) buffer;
-    for(int i = 0; i < BLOCK_SIZE; i++){
-        if(*(bytemap+i) == 0)
-        return i;
-    }
-    return -1;
+static struct sfs* fsbind(struct sfs* f){
+    struct sfs* prev = fs;
+    fs = f;
+    jnl_bind(f->jnl);
+    disk_bind(f->disk);
+    return prev;
 }
 
+//--HEADER IN FRONT OF EVERY SCRATCH BUFFER, 16 BYTES SO THE BUFFER KEEPS malloc'S ALIGNMENT--
+struct scratch {
+    struct scratch* next; //next free buffer of the same class
+    int cls; //SCRATCH_CLASSES IF THE BUFFER IS TOO LARGE FOR ANY CLASS
+} __attribute__((aligned(16)));
+
 /* --HELPER FUNCTION--
 
-MARKS BLOCK AS OCCUPIED ON THE BITMAP
-RETURNS 0 ON SUCCESS,
-RETURNS 1 ON FAILURE
+TAKES A BUFFER OF AT LEAST size BYTES FROM THE SCRATCH ARENA, FROM THE HEAP ONLY IF THE
+FREE LIST OF ITS CLASS IS EMPTY. GIVEN BACK WITH scratchput
+RETURNS THE BUFFER OR,
+RETURNS NULL IF THE HEAP IS EXHAUSTED
 
 */
 
-int markblocktaken(int block_number){
-    void* buffer = (void*) malloc(BLOCK_SIZE);
-    if(read_blocks(NUM_BLOCKS - 1, 1, buffer) != 1) 
-    return 1;
-    unsigned char* bytemap = (unsigned char*) buffer;
-    *(bytemap+block_number) = 1;
-    if(write_blocks(NUM_BLOCKS - 1, 1, bytemap) != 1)
-    return 1;
-    else
-    return 0;
+static void* scratchget(size_t size){
+    int cls = 0;
+    while(cls < SCRATCH_CLASSES && ((size_t)MIN_BLOCK_SIZE << cls) < size)
+    cls++;
+    struct scratch* s = NULL;
+    if(cls < SCRATCH_CLASSES){
+        pthread_mutex_lock(&fs->scratch_lock);
+        s = fs->scratch[cls];
+        if(s != NULL)
+        fs->scratch[cls] = s->next;
+        pthread_mutex_unlock(&fs->scratch_lock);
+        size = (size_t)MIN_BLOCK_SIZE << cls;
+    }
+    if(s == NULL){
+        s = malloc(sizeof(struct scratch) + size);
+        if(s == NULL)
+        return NULL;
+        s->cls = cls;
+        __atomic_add_fetch(&fs->heap_allocs, 1, __ATOMIC_RELAXED);
+    }
+    return s + 1;
 }
 
 /* --HELPER FUNCTION--
 
-MARKS BLOCK AS FREE ON THE BITMAP
-RETURNS 0 ON SUCCESS,
-RETURNS 1 ON FAILURE
+TAKES A ZEROED BUFFER OF size BYTES FROM THE SCRATCH ARENA
+RETURNS THE BUFFER OR,
+RETURNS NULL IF THE HEAP IS EXHAUSTED
 
 */
 
-int markblockfree(int block_number){
-    void* buffer = (void*) malloc(BLOCK_SIZE);
-    if(read_blocks(NUM_BLOCKS - 1, 1, buffer) != 1) 
-    return 1;
-    unsigned char* bytemap = (unsigned char*) buffer;
-    *(bytemap+block_number) = 0;
-    if(write_blocks(NUM_BLOCKS - 1, 1, bytemap) != 1)
-    return 1;
-    else
-    return 0;
+static void* scratchzero(size_t size){
+    void* p = scratchget(size);
+    if(p != NULL)
+    memset(p, 0, size);
+    return p;
 }
 
 /* --HELPER FUNCTION--
 
-GETS THE INODE_NUM'TH I-NODE IN THE I-NODE TABLE
-RETURNS I-NODE ON SUCCESS,
-RETURNS NULL ON FAILURE
+GIVES A BUFFER FROM scratchget BACK TO THE FREE LIST OF ITS CLASS (NULL IS IGNORED)
 
 */
 
-struct inode* getinode(int inode_num){
-    int block_num = inode_num / NUM_INODES_PER_BLOCK;
-    int index = inode_num % NUM_INODES_PER_BLOCK;
-    if(block_num > 13 || block_num < 0){
-        printf("Failed to retrieve i-node\n");
-        return NULL;
-    }
-    else if(index >= 8 || index < 0){
-        printf("Failed to retrieve i-node\n");
-        return NULL;
+static void scratchput(void* p){
+    if(p == NULL)
+    return;
+    struct scratch* s = (struct scratch*)p - 1;
+    if(s->cls == SCRATCH_CLASSES){
+        free(s);
+        return;
     }
-    else{
-        void* buffer = (void*)malloc (BLOCK_SIZE);
-        read_blocks(1 + block_num, 1, buffer);
-        struct inode_block* b = (struct inode_block*)buffer;
-        return &(b->nodes[index]);
+    pthread_mutex_lock(&fs->scratch_lock);
+    s->next = fs->scratch[s->cls];
+    fs->scratch[s->cls] = s;
+    pthread_mutex_unlock(&fs->scratch_lock);
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS EVERY FREE SCRATCH BUFFER TO THE HEAP
+
+*/
+
+static void scratchdrain(void){
+    pthread_mutex_lock(&fs->scratch_lock);
+    for(int c = 0; c < SCRATCH_CLASSES; c++){
+        while(fs->scratch[c] != NULL){
+            struct scratch* s = fs->scratch[c];
+            fs->scratch[c] = s->next;
+            free(s);
+        }
     }
+    pthread_mutex_unlock(&fs->scratch_lock);
 }
 
-void mksfs(int fresh){
+/* --HEAP ALLOCATIONS--
 
-    //--FRESH FLAG RAISED, CREATE NEW DISK--
-    if(fresh){
-        int disk_creation_flag = init_fresh_disk("sfs_disk", BLOCK_SIZE, NUM_BLOCKS);
-        if(disk_creation_flag == -1)
-        return;
-        else if(disk_creation_flag == 0)
-        printf("Created new disk file sfs_disk\n");
-        else
-        return;
+NUMBER OF BUFFERS THE SCRATCH ARENA OF THE INSTANCE HAS TAKEN FROM THE HEAP SINCE IT WAS
+MADE, TOGETHER WITH THOSE OF ITS JOURNAL. A CALL THAT FINDS ITS BUFFERS IN THE ARENA
+LEAVES IT UNCHANGED
+RETURNS THE COUNT
 
-        //--CREATE SUPERBLOCK--
-        struct superblock* sb = malloc (BLOCK_SIZE);
-        sb->blk_sz = BLOCK_SIZE;
-        sb->fs_sz = NUM_BLOCKS;
-        sb->inode_table_sz = 13;
-        sb->root_dir = 0;
-        write_blocks(0, 1, sb);
-        free(sb);
+*/
+
+long long sfs_heap_allocs(void){
+    return __atomic_load_n(&fs->heap_allocs, __ATOMIC_RELAXED) + jnl_allocs();
+}
 
-        //--CREATE FREE BYTEMAP--
-        unsigned char* bytemap = malloc (BLOCK_SIZE);
-        for(int i = 0; i < BLOCK_SIZE; i++){
-            *(bytemap+i) = 0;
-        }
-        write_blocks(NUM_BLOCKS - 1, 1, bytemap);
-        free(bytemap);
-
-        //--CREATE I-NODE TABLE--
-        for(int i = 1; i <= NUM_INODE_BLOCKS; i++){
-            struct inode_block* temp_block = malloc (BLOCK_SIZE);
-            for(int k = 0; k < NUM_INODES_PER_BLOCK; k++){
-                struct inode* temp_node = malloc (INODE_SIZE);
-                temp_node->active = 0;
-                temp_block->nodes[k] = *temp_node;
-            }
-            write_blocks(i, 1, temp_block);
-            free(temp_block);
-        }
-
-        //--CREATE ROOT DIRECTORY--
-        struct inode* dir_node = malloc (INODE_SIZE); //create an i-node for the directory
-        int freeblock = DATA_BLOCKS_OFFSET + getnextfreeblock(); //create a directory block
-        struct dir_block* dir = malloc(BLOCK_SIZE);
-        write_blocks(freeblock, 1, dir); //store directory block onto disk
-        markblocktaken(freeblock - DATA_BLOCKS_OFFSET);
-        dir_node->active = 1;
-        dir_node->file_size = BLOCK_SIZE;
-        dir_node->ptrs[0] = freeblock;
-
-        void* buffer = (void*) malloc (BLOCK_SIZE); 
-        read_blocks(1, 1, buffer); //pull 1st block of i-node table from disk
-        ((struct inode_block*)buffer)->nodes[0] = *dir_node; //store i-node into i-node table 
-        write_blocks(1, 1, buffer); //push updated i-node table onto disk
+/* --HELPER FUNCTION--
 
-        free(dir);
-        free(dir_node);
-        free(buffer);
-    }
+FINDS DATA BLOCK block (DISK ADDRESS) IN THE BLOCK CACHE. CALLER HOLDS bcache_lock
+RETURNS THE ENTRY OR,
+RETURNS -1 IF THE BLOCK IS NOT CACHED
 
+*/
+
+static int bcache_find(int block){
+    for(int e = fs->bcache_hash[block % fs->bcache_blocks]; e != -1; e = fs->bcache[e].hnext){
+        if(fs->bcache[e].block == block)
+        return e;
+    }
+    return -1;
 }
 
-int sfs_getnextfilename(char* fname);
+/* --HELPER FUNCTION--
 
-int sfs_getfilesize(const char* path);
+MOVES ENTRY e TO THE HEAD OF THE LRU LIST (hot) OR TO ITS TAIL, WHERE IT IS EVICTED
+FIRST. CALLER HOLDS bcache_lock
 
-int sfs_fopen(char* name){
-    //--CHECK IF FILE WITH name ALREADY EXISTS IN DIRECTORY--
-    //--GET DIRECTORY INODE--
-    struct inode* directory = getinode(0); 
-    int inode_index = -1;
-    //--ITERATE THROUGH THE DATA BLOCKS THAT THE DIRECTORY IS STORED IN--
-    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
-        void* buffer = (void*)malloc(BLOCK_SIZE);
-        read_blocks(directory->ptrs[i], 1, buffer);
-        struct dir_block* db = (struct dir_block*) buffer;
-        //--ITERATE THROUGH THE DIRECTORY ENTRIES THAT ARE STORED IN EACH DATA BLOCK
-        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){ 
-            //--GET POINTER TO FILE INODE--
-            if(strcmp((db->entries[k]).file_name, name) == 0){
-                inode_index = (db->entries[k]).file_ptr;
-                printf("File found in directory\n");
-                for(int p = 0; p < MAX_NUM_OF_FILES; p++){
-                    if(fdt[p].file_ptr == db->entries[k].file_ptr){
-                        printf("File with file ptr %d found in FDT\n", fdt[p].file_ptr);
-                        return p;
-                    }
-                }
-            }
-        }
-        free(buffer);
+*/
+
+static void bcache_move(int e, int hot){
+    struct bcache_entry* b = fs->bcache;
+    if(hot ? e == fs->bcache_head : e == fs->bcache_tail)
+    return;
+    //--UNLINK--
+    if(b[e].prev != -1)
+    b[b[e].prev].next = b[e].next;
+    else
+    fs->bcache_head = b[e].next;
+    if(b[e].next != -1)
+    b[b[e].next].prev = b[e].prev;
+    else
+    fs->bcache_tail = b[e].prev;
+    //--LINK AT THE CHOSEN END--
+    if(hot){
+        b[e].prev = -1;
+        b[e].next = fs->bcache_head;
+        b[fs->bcache_head].prev = e;
+        fs->bcache_head = e;
     }
-    //--FILE WAS NOT FOUND IN DIRECTORY--
-    if(inode_index == -1){
-        //--LOOK FOR EMPTY I-NODE SLOT--
-        unsigned char found = 0;
-        for(int i = 1; i <= NUM_INODE_BLOCKS && !found; i++){
-            void* buffer = (void*)malloc(BLOCK_SIZE);
-            read_blocks(i, 1, buffer);
-            struct inode_block* blk = (struct inode_block*)buffer;
-            for(int k = 0; k < NUM_INODES_PER_BLOCK; k++){
-                if(blk->nodes[k].active == 0){
-                    //--CREATE NEW I-NODE IN EMPTY SLOT--
-                    blk->nodes[k].active = 1;
-                    blk->nodes[k].file_size = 0;
-                    for(int j = 0; j < NUM_DIRECT_POINTERS_PER_INODE; j++){
-                        blk->nodes[k].ptrs[j] = 0;
-                    }
-                    blk->nodes[k].indirect_ptr = 0;
-                    write_blocks(i, 1, blk);
-                    inode_index = (i-1) * NUM_INODES_PER_BLOCK + k;
-                    printf("Created a new file @ i-node index %d\n", inode_index);
-                    //--LF BUG--
-                    struct inode* bug = getinode(inode_index);
-                    printf("New i-node: active = %d, file_size = %d\n", bug->active, bug->file_size);
-                    //----------
-                    found = 1;
-                    break;
-                }
-            }
-            free(buffer);
-        }
-        //--FIND EMPTY SLOT IN DIRECTORY--
-        int finished = 0;
-        for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE && !finished; i++){ //iterate through the direct pointers of the directory i-node
-            void* buffer = (void*)malloc(BLOCK_SIZE);
-            if(buffer == NULL){
-                //create new directory page
-            }
-            read_blocks(directory->ptrs[i], 1, buffer);
-            struct dir_block* db = (struct dir_block*) buffer;
-            for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){ //iterate through the entries in the directory block
-                if(db->entries[k].file_ptr == 0){
-                    strcpy(db->entries[k].file_name, name);
-                    db->entries[k].file_ptr = inode_index;
-                    write_blocks(directory->ptrs[i], 1, (void*) db);
-                    printf("Directory entry created: file name = %s, file ptr = %d\n", db->entries[k].file_name, db->entries[k].file_ptr);
-                    finished = 1;
-                    break;
-                }
-            }
-            //free(buffer);
-        }
+    else{
+        b[e].next = -1;
+        b[e].prev = fs->bcache_tail;
+        b[fs->bcache_tail].next = e;
+        fs->bcache_tail = e;
     }
-    //--CREATE NEW FILE DESCRIPTOR AND ADD TO FDT--
-    for(int i = 0; i < 100; i++){
-        if(fdt[i].file_ptr == 0){
-            fdt[i].file_ptr = inode_index;
-            fdt[i].rw_ptr = getinode(inode_index)->file_size;
-            printf("File with file ptr %d added to the %d th index of the FDT\n", fdt[i].file_ptr, i);
-            return i;
-        }        
+}
+
+/* --HELPER FUNCTION--
+
+EMPTIES ENTRY e AND TAKES IT OFF ITS HASH CHAIN. CALLER HOLDS bcache_lock
+
+*/
+
+static void bcache_clear(int e){
+    int* link = &fs->bcache_hash[fs->bcache[e].block % fs->bcache_blocks];
+    while(*link != e){
+        link = &fs->bcache[*link].hnext;
     }
-    return -1;
+    *link = fs->bcache[e].hnext;
+    fs->bcache[e].block = 0;
+    fs->bcache[e].hnext = -1;
 }
 
-int sfs_fclose(int fileID){
-    if(fileID >= MAX_NUM_OF_FILES || fileID < 0){
-        return -1;
+/* --HELPER FUNCTION--
+
+COUNTS n DATA BLOCKS AT block READ FROM THE DISK IN THE READS OF THEIR TIER. CALLER HOLDS
+bcache_lock
+
+*/
+
+static void tierreads(int block, int n){
+    if(fs->geo.slow_blocks == 0)
+    return;
+    int slow = DATA_BLOCKS_OFFSET + fs->geo.slow_start;
+    for(int k = 0; k < n; k++){
+        if(block + k >= slow)
+        fs->tier_stats.slow_reads++;
+        else
+        fs->tier_stats.fast_reads++;
     }
-    fdt[fileID].file_ptr = 0;
-    fdt[fileID].rw_ptr = 0;
-    return 0;
 }
 
-int sfs_fwrite(int fileID, const char* buf, int length){
-    if(fileID >= MAX_NUM_OF_FILES || fileID < 0){
-        return -1;
+/* --HELPER FUNCTION--
+
+ADDS n BLOCKS READ FROM THE DISK AT block TO THE BLOCK CACHE, AT THE HOT OR THE COLD END,
+UNLESS A WRITE OR A DROP HAPPENED SINCE bcache_gen WAS gen: THE DATA MAY BE OLDER THAN
+THAT WRITE. BLOCKS ADDED ARE COUNTED IN *counter IF IT IS NOT NULL
+RETURNS NUMBER OF BLOCKS ADDED
+
+*/
+
+static int cacheinsert(int block, int n, const char* data, unsigned int gen, int hot, long long* counter){
+    int added = 0;
+    pthread_mutex_lock(&fs->bcache_lock);
+    for(int k = 0; k < n && gen == fs->bcache_gen; k++){
+        if(bcache_find(block + k) != -1)
+        continue;
+        //--TAKE THE LEAST RECENTLY USED ENTRY--
+        int e = fs->bcache_tail;
+        if(fs->bcache[e].block != 0){
+            bcache_clear(e);
+            fs->cache_stats.evictions++;
+        }
+        fs->bcache[e].block = block + k;
+        int* chain = &fs->bcache_hash[(block + k) % fs->bcache_blocks];
+        fs->bcache[e].hnext = *chain;
+        *chain = e;
+        memcpy(fs->bcache_data + (size_t)e * BLOCK_SIZE, data + (size_t)k * BLOCK_SIZE, BLOCK_SIZE);
+        bcache_move(e, hot);
+        added++;
     }
-    else if(fdt[fileID].file_ptr == 0){
-        return -1;
+    if(counter != NULL)
+    *counter += added;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    return added;
+}
+
+/* --HELPER FUNCTION--
+
+READS n DATA BLOCKS STARTING AT DISK ADDRESS block INTO buf THROUGH THE BLOCK CACHE. THE
+MISSING BLOCKS ARE READ WITH ONE DEVICE READ PER RUN AND ADDED TO THE CACHE. WITH behind
+THE READER IS DONE WITH THE BLOCKS, SO THEY GO TO THE COLD END TO BE EVICTED FIRST
+
+*/
+
+static void cacheread(int block, int n, char* buf, int behind){
+    int k = 0;
+    while(k < n){
+        pthread_mutex_lock(&fs->bcache_lock);
+        int e;
+        while(k < n && (e = bcache_find(block + k)) != -1){
+            memcpy(buf + (size_t)k * BLOCK_SIZE, fs->bcache_data + (size_t)e * BLOCK_SIZE, BLOCK_SIZE);
+            bcache_move(e, !behind);
+            fs->cache_stats.hits++;
+            k++;
+        }
+        int m = 0;
+        while(k + m < n && bcache_find(block + k + m) == -1){
+            m++;
+        }
+        fs->cache_stats.misses += m;
+        tierreads(block + k, m);
+        unsigned int gen = fs->bcache_gen;
+        pthread_mutex_unlock(&fs->bcache_lock);
+        if(m == 0)
+        break;
+        read_blocks(block + k, m, buf + (size_t)k * BLOCK_SIZE);
+        cacheinsert(block + k, m, buf + (size_t)k * BLOCK_SIZE, gen, !behind, NULL);
+        k += m;
     }
-    else{
-        struct inode* file_inode = getinode(fdt[fileID].file_ptr);
-        //--ALLOCATE BLOCKS TO THE FILE NECESSARY FOR THE WRITE--
-        if(file_inode->file_size < fdt[fileID].rw_ptr + length){
-            for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
-                if(file_inode->ptrs[i] == 0){
-                    int freeblock = DATA_BLOCKS_OFFSET + getnextfreeblock();
-                    file_inode->ptrs[i] = freeblock;
-                    file_inode->file_size = fdt[fileID].rw_ptr + length;
-                    struct inode_block* temp = malloc(BLOCK_SIZE);
-                    read_blocks(fdt[fileID].file_ptr/NUM_INODES_PER_BLOCK + 1, 1, temp);
-                    temp->nodes[fdt[fileID].file_ptr%NUM_INODES_PER_BLOCK] = *file_inode;
-                    write_blocks(fdt[fileID].file_ptr/NUM_INODES_PER_BLOCK + 1, 1, temp);
-                    markblocktaken(freeblock - DATA_BLOCKS_OFFSET);
-                    printf("Block %d allocated to file %d\n", freeblock, fdt[fileID].file_ptr);
-                    break;
-                }
-            }
+}
+
+/* --HELPER FUNCTION--
+
+LOADS THE BLOCKS OF THE RUN OF n DATA BLOCKS AT block THAT ARE NOT CACHED YET, WITH ONE
+DEVICE READ PER RUN OF MISSING BLOCKS, AND COUNTS THEM IN *counter
+RETURNS NUMBER OF BLOCKS LOADED
+
+*/
+
+static int cachefill(int block, int n, long long* counter){
+    char* data = scratchget((size_t)n * BLOCK_SIZE);
+    int added = 0;
+    int k = 0;
+    while(data != NULL && k < n){
+        pthread_mutex_lock(&fs->bcache_lock);
+        while(k < n && bcache_find(block + k) != -1){
+            k++;
         }
-        int start_block = fdt[fileID].rw_ptr / BLOCK_SIZE;
-        int read_position = fdt[fileID].rw_ptr % BLOCK_SIZE;
-        void* buffer = malloc (BLOCK_SIZE);
-        read_blocks(file_inode->ptrs[start_block], 1, buffer);
-        char* data_block = (char*) buffer;
-        int i = 0;
-        for(; i < length; i++){
-            *(data_block + i + read_position) = *(buf + i);
+        int m = 0;
+        while(k + m < n && bcache_find(block + k + m) == -1){
+            m++;
         }
-        printf("Writing %s to block %d\n", data_block, file_inode->ptrs[start_block]);
-        write_blocks(file_inode->ptrs[start_block], 1, data_block);
-        return i;
+        tierreads(block + k, m);
+        unsigned int gen = fs->bcache_gen;
+        pthread_mutex_unlock(&fs->bcache_lock);
+        if(m == 0)
+        break;
+        if(read_blocks(block + k, m, data) != m)
+        break;
+        added += cacheinsert(block + k, m, data, gen, 1, counter);
+        k += m;
     }
+    scratchput(data);
+    return added;
 }
 
-int sfs_fread(int fileID, char* buf, int length){
-    if(fileID >= MAX_NUM_OF_FILES || fileID < 0){
-        return -1;
+/* --HELPER FUNCTION--
+
+WRITES n DATA BLOCKS FROM buf TO THE DISK AT block AND UPDATES THE ONES THAT ARE CACHED
+RETURNS NUMBER OF BLOCKS WRITTEN (AS write_blocks)
+
+*/
+
+static int cachewrite(int block, int n, const void* buf){
+    int res = write_blocks(block, n, (void*)buf);
+    pthread_mutex_lock(&fs->bcache_lock);
+    for(int k = 0; k < n; k++){
+        int e = bcache_find(block + k);
+        if(e != -1)
+        memcpy(fs->bcache_data + (size_t)e * BLOCK_SIZE, (const char*)buf + (size_t)k * BLOCK_SIZE, BLOCK_SIZE);
     }
-    else if(fdt[fileID].file_ptr == 0){
-        return -1;
+    fs->bcache_gen++;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS DATA BLOCK block FROM THE BLOCK CACHE, ITS ENTRY IS THE NEXT ONE REUSED
+
+*/
+
+static void cachedrop(int block){
+    pthread_mutex_lock(&fs->bcache_lock);
+    int e = bcache_find(block);
+    if(e != -1){
+        bcache_clear(e);
+        bcache_move(e, 0);
     }
-    else{
-        struct inode* file_inode = getinode(fdt[fileID].file_ptr);
-        int start_block = fdt[fileID].rw_ptr / BLOCK_SIZE;
-        int read_position = fdt[fileID].rw_ptr % BLOCK_SIZE;
-        void* buffer = malloc (BLOCK_SIZE);
-        read_blocks(file_inode->ptrs[start_block], 1, buffer);
-        char* data_block = (char*) buffer;
-        int i = 0;
-        for(; i < length; i++){
-            if(*(data_block + i + read_position) == '\0' || i+1 == length){
-                *(buf + i) = '\0';
-                break;
-            }
-            *(buf + i) = *(data_block + i + read_position);
-        }
-        printf("%s was read from block %d\n", data_block, file_inode->ptrs[start_block]);
-        return i;
+    fs->bcache_gen++;
+    pthread_mutex_unlock(&fs->bcache_lock);
+}
+
+/* --HELPER FUNCTION--
+
+CHECKS A GEOMETRY AND DERIVES THE DATA AREA, THE BYTEMAP, THE TABLE SIZES AND THE SLOW
+TIER FROM ITS BLOCK SIZE, DISK SIZE, I-NODE TABLE SIZE AND SLOW TIER SIZE
+RETURNS 0 ON SUCCESS,
+RETURNS 1 IF THE GEOMETRY CANNOT HOLD A FILE SYSTEM
+
+*/
+
+static int geolayout(struct geometry* g){
+    if(g->block_size < MIN_BLOCK_SIZE || g->block_size > MAX_BLOCK_SIZE || (g->block_size & (g->block_size - 1)) != 0)
+    return 1;
+    if(g->inode_blocks < 1 || g->num_blocks < 1)
+    return 1;
+    g->data_start = 1 + g->inode_blocks + NUM_JOURNAL_BLOCKS;
+    int avail = g->num_blocks - g->data_start;
+    //--THE LARGEST DATA AREA (A MULTIPLE OF NUM_AGS) WHOSE BYTEMAP FITS IN WHAT IS LEFT--
+    long long data = (long long)avail * g->block_size / (g->block_size + 1);
+    data -= data % NUM_AGS;
+    while(data > 0 && data + (data + g->block_size - 1) / g->block_size > avail){
+        data -= NUM_AGS;
+    }
+    if(data < NUM_AGS)
+    return 1;
+    g->data_blocks = (int)data;
+    g->bytemap_blocks = (g->data_blocks + g->block_size - 1) / g->block_size;
+    g->bytemap_start = g->num_blocks - g->bytemap_blocks;
+    g->dedup_size = 1;
+    while(g->dedup_size < 2 * g->data_blocks){
+        g->dedup_size *= 2;
     }
+    //--THE SLOW TIER IS THE END OF THE DATA AREA, THE FAST ONE KEEPS AT LEAST A BLOCK PER GROUP--
+    g->slow_start = g->data_blocks - g->slow_blocks;
+    if(g->slow_blocks < 0 || g->slow_start < NUM_AGS)
+    return 1;
+    return 0;
 }
 
-int sfs_fseek(int fileID, int loc){
-    if(fileID >= MAX_NUM_OF_FILES || fileID < 0){
-        return -1;
+/* --HELPER FUNCTION--
+
+ALLOCATES THE TABLES SIZED BY THE GEOMETRY (OPEN FILES, I-NODE LOCKS, FREED BLOCKS, BLOCK
+CACHE, HEAT). THE FINGERPRINT INDEX IS ONLY ALLOCATED BY sfs_dedup
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int geoalloc(void){
+    fs->open_files = calloc(NUM_INODES, sizeof(struct open_file*));
+    fs->inode_locks = malloc(NUM_INODES * sizeof(pthread_rwlock_t));
+    fs->free_seq = calloc(NUM_DATA_BLOCKS, sizeof(int));
+    fs->last_free_seq = 0;
+    fs->bcache_blocks = BCACHE_SIZE / BLOCK_SIZE;
+    fs->bcache = malloc(fs->bcache_blocks * sizeof(struct bcache_entry));
+    fs->bcache_hash = malloc(fs->bcache_blocks * sizeof(int));
+    fs->bcache_data = malloc(BCACHE_SIZE);
+    fs->heat = calloc(NUM_INODES, sizeof(unsigned int));
+    if(fs->open_files == NULL || fs->inode_locks == NULL || fs->free_seq == NULL
+       || fs->bcache == NULL || fs->bcache_hash == NULL || fs->bcache_data == NULL || fs->heat == NULL){
+        free(fs->inode_locks);
+        fs->inode_locks = NULL;
+        geofree();
+        return 1;
     }
-    else if(fdt[fileID].file_ptr == 0){
-        return -1;
+    for(int i = 0; i < NUM_INODES; i++){
+        pthread_rwlock_init(&fs->inode_locks[i], NULL);
     }
-    else{
-        fdt[fileID].rw_ptr = loc;
-        return 0;
+    //--EVERY ENTRY STARTS EMPTY, IN ONE LIST FROM HEAD TO TAIL--
+    for(int e = 0; e < fs->bcache_blocks; e++){
+        fs->bcache[e].block = 0;
+        fs->bcache[e].prev = e - 1;
+        fs->bcache[e].next = e + 1 < fs->bcache_blocks ? e + 1 : -1;
+        fs->bcache[e].hnext = -1;
+        fs->bcache_hash[e] = -1;
     }
+    fs->bcache_head = 0;
+    fs->bcache_tail = fs->bcache_blocks - 1;
+    memset(&fs->cache_stats, 0, sizeof(fs->cache_stats));
+    memset(&fs->tier_stats, 0, sizeof(fs->tier_stats));
+    return 0;
 }
 
-int sfs_remove(char* file){
-    struct inode* directory = getinode(0);
-    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
-        void* buffer = malloc(BLOCK_SIZE);
-        read_blocks(directory->ptrs[i], 1, buffer);
-        struct dir_block* db = (struct dir_block*)buffer;
-        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){
-            //--FILE FOUND--
-            if(strcmp(db->entries[k].file_name, file) == 0){
-                //--RELEASE FDT ENTRIES HELD BY FILE--
-                for(int j = 0; j < MAX_NUM_OF_FILES; j++){
-                    if(fdt[j].file_ptr == db->entries->file_ptr){
-                        fdt[j].file_ptr = 0;
-                        fdt[j].rw_ptr = 0;
-                    }
-                }
-                for(int p = 0; p < 28; p++){
-                    db->entries[k].file_name[p] = '\0';
-                }
-                db->entries[k].file_ptr = 0;
-                printf("File %s was removed\n", file);
-                write_blocks(directory->ptrs[i], 1, db);
-                return 0;
-            }
+/* --HELPER FUNCTION--
+
+FREES THE TABLES ALLOCATED BY geoalloc
+
+*/
+
+static void geofree(void){
+    if(fs->inode_locks != NULL){
+        for(int i = 0; i < NUM_INODES; i++){
+            pthread_rwlock_destroy(&fs->inode_locks[i]);
         }
     }
+    free(fs->open_files);
+    free(fs->inode_locks);
+    free(fs->dedup_index);
+    free(fs->dedup_slot);
+    free(fs->free_seq);
+    free(fs->bcache);
+    free(fs->bcache_hash);
+    free(fs->bcache_data);
+    free(fs->heat);
+    free(fs->seg_live);
+    fs->open_files = NULL;
+    fs->inode_locks = NULL;
+    fs->dedup_index = NULL;
+    fs->dedup_slot = NULL;
+    fs->free_seq = NULL;
+    fs->bcache = NULL;
+    fs->bcache_hash = NULL;
+    fs->bcache_data = NULL;
+    fs->heat = NULL;
+    fs->seg_live = NULL;
+}
+
+/* --HELPER FUNCTION--
+
+READS THE BYTEMAP (ONE REFERENCE COUNT PER DATA BLOCK)
+RETURNS THE BYTEMAP (GIVEN BACK WITH scratchput) OR,
+RETURNS NULL ON FAILURE
+
+*/
+
+static unsigned char* bytemapload(void){
+    unsigned char* bytemap = scratchget(NUM_BYTEMAP_BLOCKS * BLOCK_SIZE);
+    if(bytemap != NULL && jnl_read_range(BYTEMAP_OFFSET, NUM_BYTEMAP_BLOCKS, bytemap) != NUM_BYTEMAP_BLOCKS){
+        scratchput(bytemap);
+        return NULL;
+    }
+    return bytemap;
+}
+
+/* --HELPER FUNCTION--
+
+READS THE BYTEMAP ENTRY OF DATA BLOCK block_number
+RETURNS THE ENTRY OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int bytemapget(int block_number){
+    unsigned char* buffer = scratchget(BLOCK_SIZE);
+    int res = -1;
+    if(buffer != NULL && jnl_read(BYTEMAP_OFFSET + block_number / BLOCK_SIZE, buffer) == 1)
+    res = buffer[block_number % BLOCK_SIZE];
+    scratchput(buffer);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+STORES len BYTEMAP ENTRIES STARTING AT DATA BLOCK first, ACROSS BYTEMAP BLOCKS IF NEEDED
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int bytemapput(int first, const unsigned char* entries, int len){
+    while(len > 0){
+        int offset = first % BLOCK_SIZE;
+        int n = BLOCK_SIZE - offset < len ? BLOCK_SIZE - offset : len;
+        if(jnl_patch(BYTEMAP_OFFSET + first / BLOCK_SIZE, offset, entries, n) != 1)
+        return 1;
+        first += n;
+        entries += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+CHECKS WHETHER DATA BLOCK block_number, WHOSE BYTEMAP ENTRY IS refs, CAN BE ALLOCATED. A
+FREED BLOCK WAITS UNTIL THE TRANSACTION THAT FREED IT IS COMMITTED, OR A CRASH WOULD
+GIVE IT BACK TO ITS OWNER WITH THE NEW DATA IN IT. A FREED DIRECTORY OR INDIRECT BLOCK
+ALSO WAITS UNTIL THE JOURNAL NO LONGER HOLDS A COPY OF IT, OR A CHECKPOINT (OR A
+REPLAY) WOULD WRITE THAT COPY OVER THE NEW DATA. CALLER HOLDS alloc_lock
+RETURNS 1 IF IT CAN, 0 OTHERWISE
+
+*/
+
+static int allocatable(unsigned char refs, int block_number){
+    return refs == 0 && (fs->free_seq[block_number] == 0 || fs->free_seq[block_number] < jnl_seq())
+           && !jnl_holds(DATA_BLOCKS_OFFSET + block_number);
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF A BLOCK WAS FREED BY THE RUNNING TRANSACTION, SO A COMMIT WOULD MAKE IT
+ALLOCATABLE, 0 OTHERWISE
+
+*/
+
+static int freepending(void){
+    pthread_mutex_lock(&fs->alloc_lock);
+    int pending = fs->last_free_seq != 0 && fs->last_free_seq >= jnl_seq();
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return pending;
+}
+
+/* --HELPER FUNCTION--
+
+FINDS THE DATA BLOCKS [*lo, *hi) OF TIER tier, ALL OF THEM FOR -1 OR ON A ONE-IMAGE DISK
+
+*/
+
+static void tierrange(int tier, int* lo, int* hi){
+    *lo = 0;
+    *hi = NUM_DATA_BLOCKS;
+    if(fs->geo.slow_blocks == 0 || tier == -1)
+    return;
+    if(tier == SFS_TIER_SLOW)
+    *lo = fs->geo.slow_start;
+    else
+    *hi = fs->geo.slow_start;
+}
+
+/* --HELPER FUNCTION--
+
+SEARCHES FREE BITMAP FOR NEXT AVAILABLE BLOCK AMONG DATA BLOCKS [lo, hi), IN ALLOCATION
+GROUP ag FROM ITS ROTOR FIRST, THEN IN THE FOLLOWING GROUPS. CALLER HOLDS alloc_lock
+RETURNS INDEX OF FREE BLOCK OR,
+RETURNS -1 IF ALL BLOCKS FULL
+RETURNS -2 FOR ALL OTHER FAILURE
+
+*/
+
+int getnextfreeblock(int ag, int lo, int hi){
+    unsigned char* bytemap = scratchget(BLOCK_SIZE);
+    if(bytemap == NULL)
+    return -2;
+    int loaded = -1; //bytemap block held in bytemap
+    int freeblock = -1;
+    for(int n = 0; n < NUM_AGS && freeblock == -1; n++){
+        int g = (ag + n) % NUM_AGS;
+        //--THE PART OF THE GROUP INSIDE [lo, hi), FROM THE ROTOR IF IT LIES THERE--
+        int first = g * AG_BLOCKS > lo ? g * AG_BLOCKS : lo;
+        int end = (g + 1) * AG_BLOCKS < hi ? (g + 1) * AG_BLOCKS : hi;
+        if(fs->ag_free[g] == 0 || first >= end)
+        continue;
+        int start = g * AG_BLOCKS + fs->ag_rotor[g];
+        if(start < first || start >= end)
+        start = first;
+        for(int k = 0; k < end - first; k++){
+            int i = first + (start - first + k) % (end - first);
+            if(i / BLOCK_SIZE != loaded){
+                loaded = i / BLOCK_SIZE;
+                if(jnl_read(BYTEMAP_OFFSET + loaded, bytemap) != 1){
+                    scratchput(bytemap);
+                    return -2;
+                }
+            }
+            if(allocatable(bytemap[i % BLOCK_SIZE], i)){
+                freeblock = i;
+                break;
+            }
+        }
+    }
+    scratchput(bytemap);
+    return freeblock;
+}
+
+/* --HELPER FUNCTION--
+
+REBUILDS THE FREE COUNT OF EVERY ALLOCATION GROUP, AND IN LOG MODE THE LIVE COUNT OF EVERY
+SEGMENT, FROM THE BYTEMAP. CALLER HOLDS alloc_lock
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int agload(void){
+    unsigned char* bytemap = bytemapload();
+    if(bytemap == NULL)
+    return 1;
+    for(int g = 0; g < NUM_AGS; g++){
+        fs->ag_free[g] = 0;
+        fs->ag_rotor[g] = 0;
+        for(int i = g * AG_BLOCKS; i < (g + 1) * AG_BLOCKS; i++){
+            if(bytemap[i] == 0)
+            fs->ag_free[g]++;
+        }
+    }
+    if(fs->seg_live != NULL){
+        memset(fs->seg_live, 0, NUM_SEGMENTS * sizeof(int));
+        for(int i = 0; i < NUM_DATA_BLOCKS; i++){
+            if(bytemap[i] != 0)
+            fs->seg_live[i / LOG_SEGMENT_BLOCKS]++;
+        }
+    }
+    scratchput(bytemap);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+TAKES THE FREE COUNT OF EVERY ALLOCATION GROUP FROM THE SUPERBLOCK OF A CLEAN DISK, SO A
+MOUNT DOES NOT SCAN THE BYTEMAP. COUNTS THAT DO NOT ADD UP TO free_blocks ARE NOT USED
+(A DISK LAST UNMOUNTED BEFORE THEY WERE RECORDED HAS NONE). CALLER IS MOUNTING
+RETURNS 0 ON SUCCESS,
+RETURNS 1 IF THE BYTEMAP MUST BE SCANNED (SEE agload)
+
+*/
+
+static int agrestore(const struct superblock* sb){
+    int sum = 0;
+    if(!sb->ag_saved)
+    return 1;
+    for(int g = 0; g < NUM_AGS; g++){
+        if(sb->ag_free[g] < 0 || sb->ag_free[g] > AG_BLOCKS)
+        return 1;
+        sum += sb->ag_free[g];
+    }
+    if(sum != fs->free_blocks)
+    return 1;
+    for(int g = 0; g < NUM_AGS; g++){
+        fs->ag_free[g] = sb->ag_free[g];
+        fs->ag_rotor[g] = 0;
+    }
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS delta TO THE LIVE COUNT OF THE SEGMENTS HOLDING DATA BLOCKS [first, first + len), SO
+THE LOG HEAD IS PICKED WITHOUT READING THE BYTEMAP. NOTHING IS KEPT WHILE LOG MODE IS OFF.
+CALLER HOLDS alloc_lock
+
+*/
+
+static void seglive(int first, int len, int delta){
+    if(fs->seg_live == NULL)
+    return;
+    for(int i = first; i < first + len; i++){
+        fs->seg_live[i / LOG_SEGMENT_BLOCKS] += delta;
+    }
+}
+
+/* --HELPER FUNCTION--
+
+MARKS BLOCK AS OCCUPIED ON THE BITMAP
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+int markblocktaken(int block_number){
+    unsigned char taken = 1;
+    return bytemapput(block_number, &taken, 1);
+}
+
+/* --HELPER FUNCTION--
+
+MARKS BLOCK AS FREE ON THE BITMAP
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+int markblockfree(int block_number){
+    unsigned char taken = 0;
+    return bytemapput(block_number, &taken, 1);
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF block IS THE DISK ADDRESS OF A DATA BLOCK, 0 OTHERWISE
+
+*/
+
+static int validblock(int block){
+    return block >= DATA_BLOCKS_OFFSET && block < DATA_BLOCKS_OFFSET + NUM_DATA_BLOCKS;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS delta TO THE REFERENCE COUNT OF DATA BLOCK block (DISK ADDRESS), delta 0 ONLY READS IT.
+A BLOCK THAT BECOMES FREE LEAVES THE FINGERPRINT INDEX AND THE BLOCK CACHE. CALLER HOLDS alloc_lock
+RETURNS NEW REFERENCE COUNT OR,
+RETURNS -1 ON FAILURE OR IF THE COUNT WOULD LEAVE 0..255
+
+*/
+
+static int blockref_locked(int block, int delta){
+    int block_number = block - DATA_BLOCKS_OFFSET;
+    unsigned char refs;
+    if(!validblock(block))
+    return -1;
+    //--ONLY THE ENTRY IS NEEDED, THE JOURNAL COPIES IT OUT OF THE STAGED BYTEMAP--
+    int count = bytemapget(block_number);
+    if(count == -1)
+    return -1;
+    count += delta;
+    if(count < 0 || count > 255)
+    return -1;
+    if(delta != 0){
+        refs = count;
+        if(bytemapput(block_number, &refs, 1) != 0)
+        return -1;
+        if(count == 0){
+            fs->free_blocks++;
+            fs->ag_free[block_number / AG_BLOCKS]++;
+            seglive(block_number, 1, -1);
+            fs->free_seq[block_number] = jnl_seq();
+            fs->last_free_seq = fs->free_seq[block_number];
+            dedup_forget(block);
+            cachedrop(block);
+        }
+    }
+    return count;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS delta TO THE REFERENCE COUNT OF DATA BLOCK block (DISK ADDRESS), delta 0 ONLY READS IT
+RETURNS NEW REFERENCE COUNT OR,
+RETURNS -1 ON FAILURE OR IF THE COUNT WOULD LEAVE 0..255
+
+*/
+
+int blockref(int block, int delta){
+    pthread_mutex_lock(&fs->alloc_lock);
+    int count = blockref_locked(block, delta);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return count;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS A REFERENCE ON AN INDIRECT BLOCK, THE LAST OWNER ALSO DROPS THE BLOCKS IT POINTS TO
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int indirectunref(int indirect_ptr){
+    int count = blockref(indirect_ptr, -1);
+    if(count != 0)
+    return count == -1 ? 1 : 0;
+    int* indirect = scratchget(BLOCK_SIZE);
+    if(indirect == NULL || jnl_read(indirect_ptr, indirect) != 1){
+        scratchput(indirect);
+        return 1;
+    }
+    for(int i = 0; i < BLOCK_SIZE / (int)sizeof(int); i++){
+        if(indirect[i] > 0)
+        blockref(indirect[i], -1);
+    }
+    scratchput(indirect);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+ALLOCATES A DATA BLOCK FOR FILE inode_num IN TIER tier (-1 FOR ANY), IN ITS ALLOCATION
+GROUP IF THERE IS ROOM, OR AT THE LOG HEAD IN LOG MODE (SEARCH AND MARK ARE ONE ATOMIC
+STEP). WITH spill A FULL TIER LETS THE BLOCK COME FROM THE OTHER ONE
+RETURNS DISK ADDRESS OF THE BLOCK OR,
+RETURNS -1 IF NO BLOCK COULD BE ALLOCATED
+
+*/
+
+static int allocin(int inode_num, int tier, int spill){
+    int lo, hi;
+    tierrange(tier, &lo, &hi);
+    pthread_mutex_lock(&fs->alloc_lock);
+    int freeblock = fs->log_on ? logalloc() : getnextfreeblock(inode_num / AG_INODES, lo, hi);
+    if(freeblock == -1 && spill && hi - lo < NUM_DATA_BLOCKS && !fs->log_on)
+    freeblock = getnextfreeblock(inode_num / AG_INODES, 0, NUM_DATA_BLOCKS);
+    if(freeblock < 0 || markblocktaken(freeblock) != 0){
+        pthread_mutex_unlock(&fs->alloc_lock);
+        return -1;
+    }
+    fs->free_blocks--;
+    fs->ag_free[freeblock / AG_BLOCKS]--;
+    seglive(freeblock, 1, 1);
+    fs->ag_rotor[freeblock / AG_BLOCKS] = (freeblock + 1) % AG_BLOCKS;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return DATA_BLOCKS_OFFSET + freeblock;
+}
+
+/* --HELPER FUNCTION--
+
+ALLOCATES A DATA BLOCK FOR FILE inode_num, IN ITS TIER IF THERE IS ROOM (SEE allocin)
+RETURNS DISK ADDRESS OF THE BLOCK OR,
+RETURNS -1 IF NO BLOCK COULD BE ALLOCATED
+
+*/
+
+int allocblock(int inode_num){
+    return allocin(inode_num, tierof(inode_num), 1);
+}
+
+/* --HELPER FUNCTION--
+
+ALLOCATES UP TO want CONSECUTIVE DATA BLOCKS FOR FILE inode_num IN ITS TIER, THE FIRST
+RUN OF FREE BLOCKS THAT IS LONG ENOUGH OR ELSE THE LONGEST ONE. RUNS DO NOT CROSS
+ALLOCATION GROUPS, THE FILE'S OWN GROUP IS SEARCHED FIRST
+RETURNS DISK ADDRESS OF THE FIRST BLOCK (THE LENGTH OF THE RUN IN len) OR,
+RETURNS -1 IF THE DISK IS FULL
+
+*/
+
+int allocrun(int inode_num, int want, int* len){
+    int lo, hi;
+    tierrange(tierof(inode_num), &lo, &hi);
+    pthread_mutex_lock(&fs->alloc_lock);
+    unsigned char* bytemap = bytemapload();
+    int best = -1;
+    int best_len = 0;
+    if(bytemap != NULL){
+        for(int n = 0; n < NUM_AGS && best_len < want; n++){
+            int g = (inode_num / AG_INODES + n) % NUM_AGS;
+            int end = (g + 1) * AG_BLOCKS < hi ? (g + 1) * AG_BLOCKS : hi;
+            for(int i = g * AG_BLOCKS > lo ? g * AG_BLOCKS : lo; i < end && best_len < want; i++){
+                if(!allocatable(bytemap[i], i))
+                continue;
+                int k = i;
+                while(k < end && allocatable(bytemap[k], k) && k - i < want){
+                    k++;
+                }
+                if(k - i > best_len){
+                    best = i;
+                    best_len = k - i;
+                }
+                i = k;
+            }
+        }
+    }
+    if(best != -1){
+        memset(bytemap + best, 1, best_len);
+        if(bytemapput(best, bytemap + best, best_len) != 0)
+        best = -1;
+        else{
+            fs->free_blocks -= best_len;
+            fs->ag_free[best / AG_BLOCKS] -= best_len;
+            seglive(best, best_len, 1);
+        }
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+    scratchput(bytemap);
+    *len = best_len;
+    return best == -1 ? -1 : DATA_BLOCKS_OFFSET + best;
+}
+
+/* --HELPER FUNCTION--
+
+COPIES THE INODE_NUM'TH I-NODE OF THE I-NODE TABLE INTO node
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+int readinode(int inode_num, struct inode* node){
+    if(inode_num < 0 || inode_num >= NUM_INODES)
+    return 1;
+    struct inode* blk = scratchget(BLOCK_SIZE);
+    if(blk == NULL)
+    return 1;
+    int res = jnl_read(1 + inode_num / NUM_INODES_PER_BLOCK, blk) == 1 ? 0 : 1;
+    if(res == 0)
+    *node = blk[inode_num % NUM_INODES_PER_BLOCK];
+    scratchput(blk);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+STORES THE INODE_NUM'TH I-NODE INTO THE I-NODE TABLE WITHOUT TOUCHING ITS NEIGHBOURS
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+int putinode(int inode_num, struct inode* node){
+    int block_num = 1 + inode_num / NUM_INODES_PER_BLOCK;
+    int offset = (inode_num % NUM_INODES_PER_BLOCK) * sizeof(struct inode);
+    if(jnl_patch(block_num, offset, node, sizeof(struct inode)) != 1)
+    return 1;
+    else
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+PICKS THE I-NODE OF A NEW FILE IN THE I-NODE TABLE table: THE FIRST FREE ONE OF THE GROUP
+WITH THE MOST FREE BLOCKS, ROUND ROBIN FROM ag_next ON A TIE. THE SEARCH OF GROUP g STARTS
+AT next[g] (g * AG_INODES AT FIRST), WHICH IS MOVED UP TO THE FREE I-NODE FOUND, SO A BATCH
+SCANS EACH GROUP ONCE. CALLER HOLDS alloc_lock
+RETURNS I-NODE INDEX OR,
+RETURNS -1 IF THE I-NODE TABLE IS FULL
+
+*/
+
+static int agpick(const struct inode* table, int* next){
+    int best = -1;
+    for(int k = 0; k < NUM_AGS; k++){
+        int g = (fs->ag_next + k) % NUM_AGS;
+        int end = (g + 1) * AG_INODES < NUM_INODES ? (g + 1) * AG_INODES : NUM_INODES;
+        while(next[g] < end && (next[g] == 0 || table[next[g]].active)){
+            next[g]++;
+        }
+        if(next[g] < end && (best == -1 || fs->ag_free[g] > fs->ag_free[best]))
+        best = g;
+    }
+    if(best == -1)
+    return -1;
+    fs->ag_next = (best + 1) % NUM_AGS;
+    return next[best];
+}
+
+/* --HELPER FUNCTION--
+
+FINDS AN INACTIVE I-NODE AND CLAIMS IT FOR AN EMPTY FILE, IN THE ALLOCATION GROUP WITH
+THE MOST FREE BLOCKS THAT STILL HAS A FREE I-NODE
+RETURNS I-NODE INDEX OR,
+RETURNS -1 IF THE I-NODE TABLE IS FULL
+
+*/
+
+int allocinode(){
+    int inode_index = -1;
+    struct inode* table = scratchget(NUM_INODE_BLOCKS * BLOCK_SIZE);
+    if(table == NULL)
+    return -1;
+    pthread_mutex_lock(&fs->alloc_lock);
+    if(jnl_read_range(1, NUM_INODE_BLOCKS, table) != NUM_INODE_BLOCKS){
+        pthread_mutex_unlock(&fs->alloc_lock);
+        scratchput(table);
+        return -1;
+    }
+    int next[NUM_AGS];
+    for(int g = 0; g < NUM_AGS; g++){
+        next[g] = g * AG_INODES;
+    }
+    inode_index = agpick(table, next);
+    if(inode_index != -1){
+        //--CREATE NEW I-NODE IN EMPTY SLOT--
+        struct inode node;
+        memset(&node, 0, sizeof(node));
+        node.active = 1;
+        node.flags = INODE_INLINE;
+        putinode(inode_index, &node);
+        fs->free_inodes--;
+        printf("Created a new file @ i-node index %d\n", inode_index);
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+    scratchput(table);
+    return inode_index;
+}
+
+/* --HELPER FUNCTION--
+
+TAKES (delta 1) OR DROPS (delta -1) ONE REFERENCE ON EVERY BLOCK AN I-NODE POINTS TO.
+A FAILED TAKE IS UNDONE
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int inoderef(struct inode* node, int delta){
+    if(node->flags & INODE_INLINE)
+    return 0;
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(node->ptrs[i] > 0 && blockref(node->ptrs[i], delta) == -1 && delta > 0){
+            while(--i >= 0){
+                if(node->ptrs[i] > 0)
+                blockref(node->ptrs[i], -delta);
+            }
+            return 1;
+        }
+    }
+    if(node->indirect_ptr == 0)
+    return 0;
+    if(delta < 0)
+    return indirectunref(node->indirect_ptr);
+    if(blockref(node->indirect_ptr, delta) != -1)
+    return 0;
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(node->ptrs[i] > 0)
+        blockref(node->ptrs[i], -delta);
+    }
+    return 1;
+}
+
+/* --HELPER FUNCTION--
+
+RELEASES AN I-NODE AND DROPS ITS REFERENCE ON EVERY BLOCK IT POINTS TO
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+int releaseinode(int inode_num){
+    struct inode node;
+    if(readinode(inode_num, &node) != 0)
+    return 1;
+    //--INLINE DATA OCCUPIES THE POINTERS, THERE IS NO BLOCK TO FREE--
+    inoderef(&node, -1);
+    memset(inlinedata(&node), 0, INODE_INLINE_CAPACITY);
+    node.active = 0;
+    node.flags = 0;
+    node.file_size = 0;
+    int res = putinode(inode_num, &node);
+    pthread_mutex_lock(&fs->alloc_lock);
+    fs->free_inodes++;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+HASHES A FILE NAME (FNV-1A)
+
+*/
+
+static unsigned int namehash(const char* name){
+    unsigned int h = 2166136261u;
+    for(int i = 0; i < MAX_FILE_NAME_LENGTH && name[i] != '\0'; i++){
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned int dcache_hash(const char* name){
+    return namehash(name) % DCACHE_SIZE;
+}
+
+/* --HELPER FUNCTION--
+
+LOCK-FREE LOOKUP OF A FILE NAME IN THE LOOKUP CACHE. EACH ENTRY IS A SEQUENCE LOCK:
+THE READER RETRIES IF THE ENTRY CHANGED WHILE IT WAS BEING COPIED.
+RETURNS I-NODE INDEX OR,
+RETURNS -1 ON A CACHE MISS
+
+*/
+
+static int dcache_lookup(const char* name){
+    struct dcache_entry* e = &fs->dcache[dcache_hash(name)];
+    char file_name[MAX_FILE_NAME_LENGTH];
+    unsigned int seq;
+    int file_ptr;
+    do{
+        seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        file_ptr = __atomic_load_n(&e->file_ptr, __ATOMIC_RELAXED);
+        memcpy(file_name, e->file_name, MAX_FILE_NAME_LENGTH);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while((seq & 1) || seq != __atomic_load_n(&e->seq, __ATOMIC_RELAXED));
+    if(file_ptr > 0 && strncmp(file_name, name, MAX_FILE_NAME_LENGTH) == 0)
+    return file_ptr;
+    return -1;
+}
+
+/* --HELPER FUNCTION--
+
+SETS THE LOOKUP CACHE ENTRY OF name (file_ptr -1 INVALIDATES IT)
+
+*/
+
+static void dcache_set(const char* name, int file_ptr){
+    struct dcache_entry* e = &fs->dcache[dcache_hash(name)];
+    pthread_mutex_lock(&fs->dcache_lock);
+    if(file_ptr == -1 && strncmp(e->file_name, name, MAX_FILE_NAME_LENGTH) != 0){
+        pthread_mutex_unlock(&fs->dcache_lock);
+        return;
+    }
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->file_ptr, file_ptr, __ATOMIC_RELAXED);
+    strncpy(e->file_name, name, MAX_FILE_NAME_LENGTH);
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&fs->dcache_lock);
+}
+
+/* --HELPER FUNCTION--
+
+SEARCHES THE DIRECTORY FOR name, CALLER HOLDS dir_lock
+RETURNS I-NODE INDEX (AND THE DIRECTORY BLOCK AND ENTRY HOLDING IT) OR,
+RETURNS -1 IF THE FILE DOES NOT EXIST
+
+*/
+
+int dirlookup(const char* name, int* block, int* entry){
+    struct inode directory;
+    void* buffer = (void*)scratchget(BLOCK_SIZE);
+    if(buffer == NULL || readinode(0, &directory) != 0){
+        scratchput(buffer);
+        return -1;
+    }
+    //--ITERATE THROUGH THE DATA BLOCKS THAT THE DIRECTORY IS STORED IN--
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(directory.ptrs[i] == 0)
+        continue;
+        jnl_read(directory.ptrs[i], buffer);
+        struct dir_entry* db = (struct dir_entry*) buffer;
+        //--ITERATE THROUGH THE DIRECTORY ENTRIES THAT ARE STORED IN EACH DATA BLOCK
+        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){ 
+            //--GET POINTER TO FILE INODE--
+            if(db[k].file_ptr != 0 && strcmp(db[k].file_name, name) == 0){
+                if(block != NULL)
+                *block = directory.ptrs[i];
+                if(entry != NULL)
+                *entry = k;
+                int inode_index = db[k].file_ptr;
+                scratchput(buffer);
+                return inode_index;
+            }
+        }
+    }
+    scratchput(buffer);
+    return -1;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS A DIRECTORY ENTRY, GROWING THE DIRECTORY BY ONE BLOCK IF IT IS FULL.
+CALLER HOLDS dir_lock FOR WRITING
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF THE DIRECTORY IS FULL
+
+*/
+
+int diradd(const char* name, int inode_index){
+    struct inode directory;
+    void* buffer = (void*)scratchget(BLOCK_SIZE);
+    if(buffer == NULL || readinode(0, &directory) != 0){
+        scratchput(buffer);
+        return -1;
+    }
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){ //iterate through the direct pointers of the directory i-node
+        if(directory.ptrs[i] == 0){
+            //--CREATE NEW DIRECTORY PAGE--
+            int freeblock = allocblock(0);
+            if(freeblock == -1)
+            break;
+            memset(buffer, 0, BLOCK_SIZE);
+            jnl_write(freeblock, buffer);
+            directory.ptrs[i] = freeblock;
+            directory.file_size += BLOCK_SIZE;
+            putinode(0, &directory);
+        }
+        jnl_read(directory.ptrs[i], buffer);
+        struct dir_entry* db = (struct dir_entry*) buffer;
+        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){ //iterate through the entries in the directory block
+            if(db[k].file_ptr == 0){
+                strcpy(db[k].file_name, name);
+                db[k].file_ptr = inode_index;
+                jnl_write(directory.ptrs[i], (void*) db);
+                printf("Directory entry created: file name = %s, file ptr = %d\n", db[k].file_name, db[k].file_ptr);
+                scratchput(buffer);
+                return 0;
+            }
+        }
+    }
+    scratchput(buffer);
+    return -1;
+}
+
+/* --CONSISTENCY CHECK--
+
+sfs_fsck REBUILDS WHAT CAN BE DERIVED FROM THE I-NODE TABLE AND THE DIRECTORY. IT RUNS IN
+TWO PARALLEL PASSES OF FSCK_THREADS WORKERS:
+1. EACH WORKER READS ITS SHARE OF THE I-NODE TABLE AND OF THE DIRECTORY BLOCKS AND COUNTS
+   THE LINKS (DIRECTORY ENTRIES) OF EVERY I-NODE.
+   ENTRIES THAT POINT TO NO FILE ARE CLEARED, FILES THAT NO ENTRY POINTS TO ARE RELEASED
+   AND POINTERS OUTSIDE THE DATA AREA ARE CLEARED.
+2. EACH WORKER COUNTS THE REFERENCES HELD BY ITS SHARE OF THE I-NODES AND OF THE DISTINCT
+   INDIRECT BLOCKS. THE SUMS (WITH THE SNAPSHOT CATALOGS) REPLACE THE BYTEMAP.
+IT IS RUN WHEN A DISK THAT WAS NOT UNMOUNTED CLEANLY IS MOUNTED.
+
+*/
+
+struct fsck_work {
+    int id;
+    int phase;
+    struct inode* table; //whole i-node table, each worker reads its share
+    struct dir_entry* dir; //whole directory, each worker reads its share
+    struct inode* directory;
+    int* indirects; //distinct indirect blocks (pass 2)
+    int* indirect_data; //their contents (BLOCK_SIZE each), cleaned
+    unsigned char* indirect_bad; //set if an entry had to be cleared
+    int nindirects;
+    int* links; //NUM_INODES counts
+    int* refs; //NUM_DATA_BLOCKS counts
+    struct sfs* owner; //instance being checked
+};
+
+static void* fsckworker(void* arg){
+    struct fsck_work* w = (struct fsck_work*) arg;
+    fsbind(w->owner);
+    if(w->phase == 1){
+        int first = w->id * NUM_INODE_BLOCKS / FSCK_THREADS;
+        int last = (w->id + 1) * NUM_INODE_BLOCKS / FSCK_THREADS;
+        if(last > first)
+        jnl_read_range(1 + first, last - first, w->table + first * NUM_INODES_PER_BLOCK);
+        for(int i = w->id; i < NUM_DIRECT_POINTERS_PER_INODE; i += FSCK_THREADS){
+            if(!validblock(w->directory->ptrs[i]) || jnl_read(w->directory->ptrs[i], w->dir + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK) != 1){
+                memset(w->dir + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK, 0, BLOCK_SIZE);
+                continue;
+            }
+            for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){
+                int p = w->dir[i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k].file_ptr;
+                if(p > 0 && p < NUM_INODES)
+                w->links[p]++;
+            }
+        }
+        return NULL;
+    }
+    for(int n = w->id; n < NUM_INODES; n += FSCK_THREADS){
+        struct inode* node = &w->table[n];
+        if(!node->active || (node->flags & INODE_INLINE))
+        continue;
+        for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+            if(node->ptrs[i] > 0)
+            w->refs[node->ptrs[i] - DATA_BLOCKS_OFFSET]++;
+        }
+        if(node->indirect_ptr != 0)
+        w->refs[node->indirect_ptr - DATA_BLOCKS_OFFSET]++;
+    }
+    for(int j = w->id; j < w->nindirects; j += FSCK_THREADS){
+        int* entries = w->indirect_data + j * (BLOCK_SIZE / (int)sizeof(int));
+        if(jnl_read(w->indirects[j], entries) != 1)
+        continue;
+        for(int i = 0; i < BLOCK_SIZE / (int)sizeof(int); i++){
+            if(entries[i] == 0 || entries[i] == COMPRESSED_GROUP)
+            continue;
+            if(!validblock(entries[i])){
+                entries[i] = 0;
+                w->indirect_bad[j] = 1;
+                continue;
+            }
+            w->refs[entries[i] - DATA_BLOCKS_OFFSET]++;
+        }
+    }
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+RUNS ONE PASS OF THE CONSISTENCY CHECK ON EVERY WORKER (IN THE CALLING THREAD IF A
+WORKER CANNOT BE STARTED)
+
+*/
+
+static void fsckpass(struct fsck_work* works, int phase){
+    pthread_t threads[FSCK_THREADS];
+    int started[FSCK_THREADS];
+    for(int t = 0; t < FSCK_THREADS; t++){
+        works[t].phase = phase;
+        works[t].owner = fs;
+        started[t] = pthread_create(&threads[t], NULL, fsckworker, &works[t]) == 0;
+        if(!started[t])
+        fsckworker(&works[t]);
+    }
+    for(int t = 0; t < FSCK_THREADS; t++){
+        if(started[t])
+        pthread_join(threads[t], NULL);
+    }
+}
+
+/* --HELPER FUNCTION--
+
+CLEARS THE POINTERS OF AN I-NODE THAT ARE OUTSIDE THE DATA AREA
+RETURNS NUMBER OF POINTERS CLEARED
+
+*/
+
+static int fsckpointers(struct inode* node){
+    int fixes = 0;
+    if(node->flags & INODE_INLINE)
+    return 0;
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(node->ptrs[i] != 0 && node->ptrs[i] != COMPRESSED_GROUP && !validblock(node->ptrs[i])){
+            node->ptrs[i] = 0;
+            fixes++;
+        }
+    }
+    if(node->indirect_ptr != 0 && !validblock(node->indirect_ptr)){
+        node->indirect_ptr = 0;
+        fixes++;
+    }
+    return fixes;
+}
+
+/* --CONSISTENCY CHECK--
+
+CHECKS AND REPAIRS THE MOUNTED FILE SYSTEM, NO OTHER CALL MAY RUN AT THE SAME TIME
+RETURNS NUMBER OF PROBLEMS FIXED OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_fsck(void){
+    if(!fs->mounted)
+    return -1;
+    //--EVERY I-NODE, LIVE OR IN A SNAPSHOT, HAS AT MOST ONE INDIRECT BLOCK--
+    int max_indirects = NUM_INODES * (1 + SFS_MAX_SNAPSHOTS);
+    if(max_indirects > NUM_DATA_BLOCKS)
+    max_indirects = NUM_DATA_BLOCKS;
+    struct fsck_work* works = calloc(FSCK_THREADS, sizeof(struct fsck_work));
+    struct inode* table = malloc(NUM_INODE_BLOCKS * BLOCK_SIZE);
+    struct dir_entry* dir = malloc(NUM_DIRECT_POINTERS_PER_INODE * BLOCK_SIZE);
+    int* refs = calloc(NUM_DATA_BLOCKS, sizeof(int));
+    int* indirects = malloc(max_indirects * sizeof(int));
+    int* indirect_data = malloc((size_t)max_indirects * BLOCK_SIZE);
+    unsigned char* indirect_bad = calloc(max_indirects, 1);
+    unsigned char* seen = calloc(NUM_DATA_BLOCKS, 1);
+    unsigned char* bytemap = NULL;
+    struct superblock* sb = malloc(BLOCK_SIZE);
+    struct snapshot_header* hdr = malloc(BLOCK_SIZE);
+    int* links = calloc(NUM_INODES, sizeof(int));
+    struct inode directory;
+    int fixes = -1;
+    if(works == NULL || table == NULL || dir == NULL || refs == NULL || indirects == NULL || indirect_data == NULL || indirect_bad == NULL || seen == NULL || sb == NULL || hdr == NULL || links == NULL)
+    goto done;
+    for(int t = 0; t < FSCK_THREADS; t++){
+        works[t].links = calloc(NUM_INODES, sizeof(int));
+        works[t].refs = calloc(NUM_DATA_BLOCKS, sizeof(int));
+        if(works[t].links == NULL || works[t].refs == NULL)
+        goto done;
+    }
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    if(readinode(0, &directory) != 0){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        pthread_rwlock_unlock(&fs->io_lock);
+        pthread_rwlock_unlock(&fs->dir_lock);
+        jnl_end();
+        goto done;
+    }
+    fixes = fsckpointers(&directory);
+    if(fixes > 0)
+    putinode(0, &directory);
+
+    //--PASS 1: READ THE TABLE AND THE DIRECTORY, COUNT LINKS--
+    for(int t = 0; t < FSCK_THREADS; t++){
+        works[t].id = t;
+        works[t].table = table;
+        works[t].dir = dir;
+        works[t].directory = &directory;
+        works[t].indirects = indirects;
+        works[t].indirect_data = indirect_data;
+        works[t].indirect_bad = indirect_bad;
+    }
+    fsckpass(works, 1);
+    for(int t = 0; t < FSCK_THREADS; t++){
+        for(int n = 0; n < NUM_INODES; n++){
+            links[n] += works[t].links[n];
+        }
+    }
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        int dirty = 0;
+        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK && validblock(directory.ptrs[i]); k++){
+            struct dir_entry* e = &dir[i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k];
+            int p = e->file_ptr;
+            if(p == 0 || (p > 0 && p < NUM_INODES && table[p].active))
+            continue;
+            printf("fsck: removed entry %.*s pointing to free i-node %d\n", MAX_FILE_NAME_LENGTH, e->file_name, p);
+            memset(e, 0, sizeof(struct dir_entry));
+            dirty = 1;
+            fixes++;
+        }
+        if(dirty)
+        jnl_write(directory.ptrs[i], dir + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK);
+    }
+    for(int n = 1; n < NUM_INODES; n++){
+        struct inode* node = &table[n];
+        if(!node->active)
+        continue;
+        int changed = fsckpointers(node);
+        //--NO ENTRY POINTS TO IT, ITS BLOCKS ARE FREED BY THE NEW BYTEMAP--
+        if(links[n] == 0){
+            printf("fsck: released orphan i-node %d\n", n);
+            memset(node, 0, sizeof(struct inode));
+            changed++;
+        }
+        if(changed > 0)
+        putinode(n, node);
+        fixes += changed;
+    }
+    table[0] = directory;
+
+    //--PASS 2: COUNT REFERENCES, THE SNAPSHOT CATALOGS ARE COUNTED HERE--
+    int nindirects = 0;
+    for(int n = 0; n < NUM_INODES; n++){
+        struct inode* node = &table[n];
+        if(node->active && !(node->flags & INODE_INLINE) && node->indirect_ptr != 0 && !seen[node->indirect_ptr - DATA_BLOCKS_OFFSET]){
+            seen[node->indirect_ptr - DATA_BLOCKS_OFFSET] = 1;
+            indirects[nindirects++] = node->indirect_ptr;
+        }
+    }
+    for(int id = 0; id < SFS_MAX_SNAPSHOTS; id++){
+        jnl_read(0, sb);
+        int header = sb->snapshots[id];
+        if(header == 0)
+        continue;
+        struct snapshot_entry* catalog = validblock(header) ? snapload(id, hdr) : NULL;
+        if(catalog == NULL){
+            printf("fsck: dropped unreadable snapshot %d\n", id);
+            int none = 0;
+            jnl_patch(0, offsetof(struct superblock, snapshots) + id * sizeof(int), &none, sizeof(int));
+            fixes++;
+            continue;
+        }
+        refs[header - DATA_BLOCKS_OFFSET]++;
+        for(int i = 0; i < hdr->nblocks; i++){
+            refs[hdr->blocks[i] - DATA_BLOCKS_OFFSET]++;
+        }
+        for(int k = 0; k < hdr->count; k++){
+            struct inode* node = &catalog[k].node;
+            if(node->flags & INODE_INLINE)
+            continue;
+            fsckpointers(node);
+            for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+                if(node->ptrs[i] > 0)
+                refs[node->ptrs[i] - DATA_BLOCKS_OFFSET]++;
+            }
+            if(node->indirect_ptr == 0)
+            continue;
+            refs[node->indirect_ptr - DATA_BLOCKS_OFFSET]++;
+            if(!seen[node->indirect_ptr - DATA_BLOCKS_OFFSET] && nindirects < max_indirects){
+                seen[node->indirect_ptr - DATA_BLOCKS_OFFSET] = 1;
+                indirects[nindirects++] = node->indirect_ptr;
+            }
+        }
+        free(catalog);
+    }
+    for(int t = 0; t < FSCK_THREADS; t++){
+        works[t].nindirects = nindirects;
+    }
+    fsckpass(works, 2);
+    for(int j = 0; j < nindirects; j++){
+        if(indirect_bad[j]){
+            jnl_write(indirects[j], indirect_data + j * (BLOCK_SIZE / (int)sizeof(int)));
+            fixes++;
+        }
+    }
+
+    //--THE SUMS ARE THE NEW BYTEMAP--
+    bytemap = bytemapload();
+    if(bytemap == NULL){
+        fixes = -1;
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        pthread_rwlock_unlock(&fs->io_lock);
+        pthread_rwlock_unlock(&fs->dir_lock);
+        jnl_end();
+        goto done;
+    }
+    int changed = 0;
+    int blocks = 0;
+    for(int b = 0; b < NUM_DATA_BLOCKS; b++){
+        for(int t = 0; t < FSCK_THREADS; t++){
+            refs[b] += works[t].refs[b];
+        }
+        unsigned char count = refs[b] > 255 ? 255 : refs[b];
+        if(bytemap[b] != count){
+            bytemap[b] = count;
+            changed++;
+        }
+        if(count == 0)
+        blocks++;
+    }
+    if(changed > 0){
+        printf("fsck: corrected %d reference counts\n", changed);
+        bytemapput(0, bytemap, NUM_DATA_BLOCKS);
+        fixes += changed;
+    }
+    int inodes = 0;
+    for(int n = 1; n < NUM_INODES; n++){
+        if(!table[n].active)
+        inodes++;
+    }
+    pthread_mutex_lock(&fs->alloc_lock);
+    fs->free_blocks = blocks;
+    fs->free_inodes = inodes;
+    agload();
+    pthread_mutex_lock(&fs->dedup_lock);
+    if(fs->dedup_index != NULL){
+        memset(fs->dedup_index, 0, DEDUP_INDEX_SIZE * sizeof(struct dedup_entry));
+        memset(fs->dedup_slot, 0, NUM_DATA_BLOCKS * sizeof(int));
+    }
+    fs->dedup_stats.unique_blocks = 0;
+    pthread_mutex_unlock(&fs->dedup_lock);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    printf("fsck: %d problems fixed, %d free blocks, %d free i-nodes\n", fixes, blocks, inodes);
+
+    done:
+    for(int t = 0; works != NULL && t < FSCK_THREADS; t++){
+        free(works[t].links);
+        free(works[t].refs);
+    }
+    free(works);
+    free(table);
+    free(dir);
+    free(refs);
+    free(indirects);
+    free(indirect_data);
+    free(indirect_bad);
+    free(seen);
+    scratchput(bytemap);
+    free(sb);
+    free(hdr);
+    free(links);
+    return fixes;
+}
+
+/* --HELPER FUNCTION--
+
+RECORDS THE SUMMARY COUNTERS, THE FREE COUNT OF EACH ALLOCATION GROUP AND THE CLEAN FLAG,
+FLUSHES THE JOURNAL AND RELEASES THE DISK. CALLER MAKES SURE NO OTHER CALL IS RUNNING
+
+*/
+
+static void unmountsfs(void){
+    struct superblock counters;
+    jnl_begin();
+    pthread_mutex_lock(&fs->alloc_lock);
+    counters.clean = 1;
+    counters.free_blocks = fs->free_blocks;
+    counters.free_inodes = fs->free_inodes;
+    counters.ag_saved = 1;
+    memcpy(counters.ag_free, fs->ag_free, sizeof(counters.ag_free));
+    pthread_mutex_unlock(&fs->alloc_lock);
+    jnl_patch(0, offsetof(struct superblock, clean), &counters.clean, 3 * sizeof(int));
+    jnl_patch(0, offsetof(struct superblock, ag_saved), &counters.ag_saved, (1 + NUM_AGS) * sizeof(int));
+    jnl_end();
+    jnl_checkpoint();
+    jnl_shutdown();
+    close_disk();
+    fs->mounted = 0;
+}
+
+/* --UNMOUNT--
+
+CLOSES EVERY DESCRIPTOR AND UNMOUNTS THE FILE SYSTEM, MARKING IT CLEAN SO THE NEXT MOUNT
+SKIPS THE CONSISTENCY CHECK
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO FILE SYSTEM IS MOUNTED
+
+*/
+
+int sfs_unmount(void){
+    if(!fs->mounted)
+    return -1;
+    defragjoin(1);
+    tierjoin();
+    logjoin();
+    prefetchjoin();
+    sfs_trace(NULL);
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    fdtreset();
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    unmountsfs();
+    printf("Unmounted %s\n", fs->path);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+FLUSHES THE JOURNAL OF A PREVIOUSLY MOUNTED DISK, RELEASES IT AND FORGETS EVERY
+IN-MEMORY TABLE SIZED BY ITS GEOMETRY
+
+*/
+
+static void sfsreset(void){
+    defragjoin(1);
+    tierjoin();
+    logjoin();
+    prefetchjoin();
+    if(fs->mounted)
+    unmountsfs();
+    fdtreset();
+    memset(fs->dcache, 0, sizeof(fs->dcache));
+    fs->default_dir.pos = 0;
+    fs->dedup_on = 0;
+    memset(&fs->dedup_stats, 0, sizeof(fs->dedup_stats));
+    fs->log_on = 0;
+    fs->log_head = 0;
+    memset(&fs->log_stats, 0, sizeof(fs->log_stats));
+    fs->grow_step = 0;
+    geofree();
+    scratchdrain();
+}
+
+/* --DIRECTORY CAPACITY--
+
+THE DIRECTORY HAS NUM_DIRECT_POINTERS_PER_INODE BLOCKS OF ENTRIES, SO NO FILE SYSTEM WITH
+BLOCKS OF block_size BYTES HOLDS MORE FILES THAN THIS, HOWEVER MANY I-NODES IT HAS
+RETURNS THE NUMBER OF FILES OR,
+RETURNS -1 IF block_size IS NOT A VALID BLOCK SIZE
+
+*/
+
+int sfs_max_files(int block_size){
+    if(block_size < MIN_BLOCK_SIZE || block_size > MAX_BLOCK_SIZE || (block_size & (block_size - 1)) != 0)
+    return -1;
+    return NUM_DIRECT_POINTERS_PER_INODE * (block_size / (int)sizeof(struct dir_entry));
+}
+
+/* --MAKE FILE SYSTEM--
+
+CREATES AND MOUNTS A NEW FILE SYSTEM ON THE DISK FILE OF THE INSTANCE (sfs_disk BY DEFAULT)
+WITH BLOCKS OF block_size BYTES (A POWER OF TWO FROM 512 TO 64K), disk_size BYTES IN ALL
+AND AT LEAST num_inodes I-NODES, ONE OF THEM THE DIRECTORY'S. MORE FILES THAN THE
+DIRECTORY CAN NAME (SEE sfs_max_files) ARE REFUSED.
+THE GEOMETRY IS RECORDED IN THE SUPERBLOCK AND READ BACK BY EVERY LATER MOUNT
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_mkfs(int block_size, long long disk_size, int num_inodes){
+    sfsreset();
+
+    //--LAY OUT THE DISK--
+    struct geometry g;
+    memset(&g, 0, sizeof(g));
+    if(block_size < MIN_BLOCK_SIZE || num_inodes < 1 || disk_size / block_size > INT_MAX){
+        printf("Invalid geometry\n");
+        return -1;
+    }
+    g.block_size = block_size;
+    g.num_blocks = (int)(disk_size / block_size);
+    g.inode_blocks = (num_inodes + block_size / INODE_SIZE - 1) / (block_size / INODE_SIZE);
+    g.slow_blocks = fs->slow_path != NULL ? (int)(fs->slow_size / block_size) : 0;
+    if(geolayout(&g) != 0 || (fs->slow_path != NULL && g.slow_blocks == 0)){
+        printf("Invalid geometry\n");
+        return -1;
+    }
+    if(num_inodes - 1 > sfs_max_files(block_size)){
+        printf("The directory holds at most %d files\n", sfs_max_files(block_size));
+        return -1;
+    }
+    fs->geo = g;
+    if(geoalloc() != 0)
+    return -1;
+
+    int disk_creation_flag = init_fresh_disk(fs->path, BLOCK_SIZE, NUM_BLOCKS);
+    if(disk_creation_flag != 0)
+    return -1;
+    printf("Created new disk file %s\n", fs->path);
+    if(fs->geo.slow_blocks > 0){
+        if(attach_slow_disk(fs->slow_path, DATA_BLOCKS_OFFSET + fs->geo.slow_start, fs->geo.slow_blocks, 1, fs->slow_latency) != 0){
+            close_disk();
+            return -1;
+        }
+        printf("Created new disk file %s for the slow tier\n", fs->slow_path);
+    }
+
+    //--CREATE SUPERBLOCK, THE DISK STARTS ZEROED SO THE BYTEMAP IS EMPTY AND EVERY I-NODE INACTIVE--
+    struct superblock* sb = calloc (1, BLOCK_SIZE);
+    sb->blk_sz = BLOCK_SIZE;
+    sb->fs_sz = NUM_BLOCKS;
+    sb->inode_table_sz = NUM_INODE_BLOCKS;
+    sb->root_dir = 0;
+    sb->jnl_start = JOURNAL_OFFSET;
+    sb->jnl_sz = NUM_JOURNAL_BLOCKS;
+    sb->data_start = DATA_BLOCKS_OFFSET;
+    sb->data_sz = NUM_DATA_BLOCKS;
+    sb->bytemap_start = BYTEMAP_OFFSET;
+    sb->bytemap_sz = NUM_BYTEMAP_BLOCKS;
+    sb->slow_sz = fs->geo.slow_blocks;
+    write_blocks(0, 1, sb);
+    free(sb);
+
+    //--CREATE JOURNAL--
+    if(jnl_init(JOURNAL_OFFSET, NUM_JOURNAL_BLOCKS, BLOCK_SIZE) != 0 || jnl_format() != 0){
+        close_disk();
+        return -1;
+    }
+    fs->mounted = 1;
+    fs->free_blocks = NUM_DATA_BLOCKS;
+    fs->free_inodes = NUM_INODES - 1;
+    agload();
+
+    //--CREATE ROOT DIRECTORY--
+    jnl_begin();
+    struct inode* dir_node = calloc (1, INODE_SIZE); //create an i-node for the directory
+    int freeblock = allocblock(0); //create a directory block
+    struct dir_entry* dir = calloc(1, BLOCK_SIZE);
+    jnl_write(freeblock, dir); //store directory block onto disk
+    dir_node->active = 1;
+    dir_node->file_size = BLOCK_SIZE;
+    dir_node->ptrs[0] = freeblock;
+
+    putinode(0, dir_node); //store i-node into i-node table 
+    jnl_end();
+    jnl_checkpoint();
+
+    free(dir);
+    free(dir_node);
+    return 0;
+}
+
+void mksfs(int fresh){
+
+    //--FRESH FLAG RAISED, CREATE NEW DISK WITH THE DEFAULT GEOMETRY--
+    if(fresh){
+        sfs_mkfs(DEFAULT_BLOCK_SIZE, (long long)DEFAULT_BLOCK_SIZE * DEFAULT_NUM_BLOCKS, DEFAULT_NUM_INODES);
+        return;
+    }
+
+    //--FRESH FLAG NOT RAISED, OPEN EXISTING DISK, READ ITS GEOMETRY AND REPLAY ITS JOURNAL--
+    sfsreset();
+    if(init_disk(fs->path, MIN_BLOCK_SIZE, 1) != 0)
+    return;
+    struct superblock* sb = malloc (MIN_BLOCK_SIZE);
+    int n = read_blocks(0, 1, sb);
+    close_disk();
+    struct geometry g;
+    memset(&g, 0, sizeof(g));
+    g.block_size = sb->blk_sz;
+    g.num_blocks = sb->fs_sz;
+    g.inode_blocks = sb->inode_table_sz;
+    g.slow_blocks = sb->slow_sz;
+    int jnl_start = sb->jnl_start;
+    int jnl_sz = sb->jnl_sz;
+    //--DISKS MADE BEFORE THE LAYOUT WAS RECORDED LEAVE data_sz AT 0--
+    if(n != 1 || geolayout(&g) != 0 || (sb->data_sz != 0 && (sb->data_start != g.data_start || sb->data_sz != g.data_blocks || sb->bytemap_start != g.bytemap_start))){
+        printf("%s has an invalid superblock\n", fs->path);
+        free(sb);
+        return;
+    }
+    free(sb);
+    if((g.slow_blocks > 0) != (fs->slow_path != NULL)){
+        printf(g.slow_blocks > 0 ? "%s needs the image of its slow tier\n" : "%s has no slow tier\n", fs->path);
+        return;
+    }
+    fs->geo = g;
+    if(geoalloc() != 0 || init_disk(fs->path, BLOCK_SIZE, NUM_BLOCKS) != 0)
+    return;
+    if(g.slow_blocks > 0 && attach_slow_disk(fs->slow_path, DATA_BLOCKS_OFFSET + g.slow_start, g.slow_blocks, 0, fs->slow_latency) != 0){
+        close_disk();
+        return;
+    }
+    if(jnl_init(jnl_start, jnl_sz, BLOCK_SIZE) != 0 || jnl_recover() < 0){
+        printf("Failed to recover journal\n");
+        close_disk();
+        return;
+    }
+
+    //--A GROW THAT ONLY REACHED THE JOURNAL CHANGED THE SUPERBLOCK DURING THE REPLAY--
+    sb = malloc (BLOCK_SIZE);
+    jnl_read(0, sb);
+    if(sb->fs_sz != NUM_BLOCKS){
+        g.num_blocks = sb->fs_sz;
+        int bad = geolayout(&g) != 0 || sb->data_sz != g.data_blocks || sb->bytemap_start != g.bytemap_start;
+        geofree();
+        fs->geo = g;
+        if(bad || geoalloc() != 0 || extend_disk(NUM_BLOCKS) != 0){
+            printf("%s has an invalid superblock\n", fs->path);
+            free(sb);
+            close_disk();
+            return;
+        }
+    }
+    fs->mounted = 1;
+
+    //--CLEAN DISK: TRUST THE COUNTERS, EVERYTHING ELSE IS READ WHEN IT IS NEEDED--
+    if(sb->clean){
+        fs->free_blocks = sb->free_blocks;
+        fs->free_inodes = sb->free_inodes;
+        if(agrestore(sb) != 0)
+        agload();
+    }
+    else{
+        printf("%s was not unmounted cleanly, checking it\n", fs->path);
+        sfs_fsck();
+    }
+    free(sb);
+
+    //--MARK THE DISK IN USE, A CRASH FROM HERE ON LEAVES IT DIRTY--
+    int dirty = 0;
+    jnl_begin();
+    jnl_patch(0, offsetof(struct superblock, clean), &dirty, sizeof(int));
+    jnl_end();
+    jnl_commit();
+
+}
+
+/* --SYNC--
+
+COMMITS ALL PENDING METADATA UPDATES TO THE JOURNAL
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_sync(void){
+    if(!fs->mounted)
+    return -1;
+    return jnl_commit();
+}
+
+/* --DIRECTORY CURSOR--
+
+A CURSOR IS A POSITION IN THE DIRECTORY (BLOCK * NUM_DIRECTORY_ENTRIES_PER_BLOCK + ENTRY),
+SO IT STAYS VALID ACROSS CALLS AND CAN BE SAVED AND RESTORED WITH sfs_telldir/sfs_seekdir.
+EACH DIRECTORY BLOCK IS READ ONCE, AND THE SIZES OF A WHOLE BATCH OF ENTRIES COME FROM
+ONE READ OF THE I-NODE TABLE BLOCKS COVERING IT, SO A LISTING WITH SIZES COSTS ONE PASS.
+
+*/
+
+/* --HELPER FUNCTION--
+
+READS UP TO max ENTRIES FROM THE CURSOR, WITH FILE SIZES IF sizes IS SET
+RETURNS NUMBER OF ENTRIES READ (0 AT THE END OF THE DIRECTORY) OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int dirscan(SFS_DIR* dir, struct sfs_dirent* ents, int max, int sizes){
+    if(dir == NULL || ents == NULL || max <= 0)
+    return -1;
+    struct inode directory;
+    int count = 0;
+    int end = NUM_DIRECT_POINTERS_PER_INODE * NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+    //--A SNAPSHOT CURSOR LISTS ITS OWN COPY OF THE CATALOG, THE POSITION IS AN INDEX INTO IT--
+    if(dir->catalog != NULL){
+        while(dir->pos < dir->count && count < max){
+            struct snapshot_entry* e = &dir->catalog[dir->pos++];
+            memcpy(ents[count].name, e->file_name, MAXFILENAME);
+            ents[count].name[MAXFILENAME - 1] = '\0';
+            ents[count].inode = e->inode_num;
+            ents[count].size = sizes ? e->node.file_size : -1;
+            count++;
+        }
+        return count;
+    }
+    pthread_rwlock_rdlock(&fs->dir_lock);
+    void* buffer = scratchget(BLOCK_SIZE);
+    if(buffer == NULL || readinode(0, &directory) != 0){
+        scratchput(buffer);
+        pthread_rwlock_unlock(&fs->dir_lock);
+        return -1;
+    }
+    while(dir->pos < end && count < max){
+        int i = dir->pos / NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+        if(directory.ptrs[i] == 0){
+            dir->pos = (i + 1) * NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+            continue;
+        }
+        jnl_read(directory.ptrs[i], buffer);
+        struct dir_entry* db = (struct dir_entry*) buffer;
+        for(int k = dir->pos % NUM_DIRECTORY_ENTRIES_PER_BLOCK; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK && count < max; k++){
+            dir->pos++;
+            if(db[k].file_ptr == 0)
+            continue;
+            memcpy(ents[count].name, db[k].file_name, MAXFILENAME);
+            ents[count].name[MAXFILENAME - 1] = '\0';
+            ents[count].inode = db[k].file_ptr;
+            ents[count].size = -1;
+            count++;
+        }
+    }
+    scratchput(buffer);
+
+    //--FILL IN SIZES FROM THE I-NODE TABLE BLOCKS COVERING THE BATCH--
+    if(sizes && count > 0){
+        int first = NUM_INODE_BLOCKS;
+        int last = -1;
+        for(int j = 0; j < count; j++){
+            int b = ents[j].inode / NUM_INODES_PER_BLOCK;
+            if(b < first)
+            first = b;
+            if(b > last)
+            last = b;
+        }
+        struct inode* table = scratchget((last - first + 1) * BLOCK_SIZE);
+        if(table != NULL && jnl_read_range(1 + first, last - first + 1, table) == last - first + 1){
+            for(int j = 0; j < count; j++){
+                ents[j].size = table[ents[j].inode - first * NUM_INODES_PER_BLOCK].file_size;
+            }
+        }
+        scratchput(table);
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    return count;
+}
+
+SFS_DIR* sfs_opendir(void){
+    SFS_DIR* dir = calloc(1, sizeof(SFS_DIR));
+    return dir;
+}
+
+int sfs_readdir_plus(SFS_DIR* dir, struct sfs_dirent* ents, int max){
+    return dirscan(dir, ents, max, 1);
+}
+
+int sfs_telldir(SFS_DIR* dir){
+    if(dir == NULL)
+    return -1;
+    return dir->pos;
+}
+
+int sfs_seekdir(SFS_DIR* dir, int pos){
+    if(dir == NULL || pos < 0)
+    return -1;
+    dir->pos = pos;
+    return 0;
+}
+
+int sfs_closedir(SFS_DIR* dir){
+    if(dir == NULL)
+    return -1;
+    free(dir->catalog);
+    free(dir);
+    return 0;
+}
+
+/* --GET NEXT FILE NAME--
+
+COPIES THE NEXT FILE NAME OF THE DIRECTORY INTO fname
+RETURNS 1 WHILE THERE ARE FILES LEFT,
+RETURNS 0 AT THE END OF THE DIRECTORY (THE NEXT CALL STARTS OVER)
+
+*/
+
+int sfs_getnextfilename(char* fname){
+    struct sfs_dirent ent;
+    if(dirscan(&fs->default_dir, &ent, 1, 0) == 1){
+        strcpy(fname, ent.name);
+        return 1;
+    }
+    fs->default_dir.pos = 0;
+    return 0;
+}
+
+/* --GET FILE SIZE--
+
+RETURNS SIZE OF THE FILE NAMED path OR,
+RETURNS -1 IF IT DOES NOT EXIST
+
+*/
+
+int sfs_getfilesize(const char* path){
+    struct inode node;
+    if(strlen(path) >= MAX_FILE_NAME_LENGTH)
+    return -1;
+    //--FAST PATH, VALID IF THE CACHE STILL AGREES AFTER THE I-NODE WAS READ--
+    int inode_index = dcache_lookup(path);
+    if(inode_index != -1 && readinode(inode_index, &node) == 0 && node.active && dcache_lookup(path) == inode_index)
+    return node.file_size;
+
+    pthread_rwlock_rdlock(&fs->dir_lock);
+    inode_index = dirlookup(path, NULL, NULL);
+    int size = -1;
+    if(inode_index != -1 && readinode(inode_index, &node) == 0){
+        dcache_set(path, inode_index);
+        size = node.file_size;
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    return size;
+}
+
+/* --HELPER FUNCTION--
+
+TAKES AN open_file TOGETHER WITH ITS BLOCK MAP AND GROUP CACHE FROM THE SCRATCH ARENA AS ONE BUFFER
+RETURNS THE OBJECT OR,
+RETURNS NULL ON FAILURE
+
+*/
+
+static struct open_file* ofalloc(void){
+    struct open_file* of = scratchget(sizeof(struct open_file) + MAX_FILE_BLOCKS * sizeof(int) + GROUP_SIZE);
+    if(of == NULL)
+    return NULL;
+    of->blockmap = (int*)(of + 1);
+    of->cache = (char*)(of->blockmap + MAX_FILE_BLOCKS);
+    return of;
+}
+
+/* --HELPER FUNCTION--
+
+FREES AN open_file WHOSE LAST DESCRIPTOR WAS CLOSED
+
+*/
+
+static void offree(struct open_file* of){
+    pthread_mutex_destroy(&of->cache_lock);
+    scratchput(of);
+}
+
+/* --HELPER FUNCTION--
+
+CLOSES EVERY DESCRIPTOR AND EMPTIES THE OPEN FILE TABLE (USED WHEN MOUNTING)
+
+*/
+
+static void fdtreset(void){
+    for(int i = 0; i < fs->fdt_size; i++){
+        struct open_file* of = fs->fdt[i].of;
+        if(of != NULL && --of->refcount == 0)
+        offree(of);
+    }
+    free(fs->fdt);
+    fs->fdt = NULL;
+    fs->fdt_size = 0;
+    fs->fdt_free = -1;
+    memset(fs->snap_open, 0, sizeof(fs->snap_open));
+    if(fs->open_files != NULL)
+    memset(fs->open_files, 0, NUM_INODES * sizeof(struct open_file*));
+}
+
+/* --HELPER FUNCTION--
+
+LOADS THE LOGICAL -> DISK BLOCK MAP OF AN OPEN FILE FROM ITS I-NODE AND INDIRECT BLOCK
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int bmapload(struct open_file* of){
+    memset(of->blockmap, 0, MAX_FILE_BLOCKS * sizeof(int));
+    if(of->node.flags & INODE_INLINE)
+    return 0;
+    memcpy(of->blockmap, of->node.ptrs, sizeof(of->node.ptrs));
+    if(of->node.indirect_ptr == 0)
+    return 0;
+    int* indirect = scratchget(BLOCK_SIZE);
+    if(indirect == NULL)
+    return 1;
+    int res = jnl_read(of->node.indirect_ptr, indirect) == 1 ? 0 : 1;
+    if(res == 0)
+    memcpy(of->blockmap + NUM_DIRECT_POINTERS_PER_INODE, indirect, BLOCK_SIZE);
+    scratchput(indirect);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+CHECKS WHETHER THE FIRST len BYTES OF data ARE ALL ZERO
+RETURNS 1 IF THEY ARE,
+RETURNS 0 IF NOT
+
+*/
+
+static int iszero(const char* data, int len){
+    for(int k = 0; k < len; k++){
+        if(data[k] != 0)
+        return 0;
+    }
+    return 1;
+}
+
+/* --HELPER FUNCTION--
+
+GIVES LOGICAL BLOCK lblk OF AN OPEN FILE A DISK BLOCK, ALLOCATING THE INDIRECT BLOCK
+IF NEEDED. CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS DISK ADDRESS OF THE BLOCK OR,
+RETURNS -1 IF THE FILE OR THE DISK IS FULL
+
+*/
+
+static int bmapset(struct open_file* of, int lblk, int block);
+
+static int bmapalloc(struct open_file* of, int lblk){
+    if(lblk >= MAX_FILE_BLOCKS)
+    return -1;
+    if(of->blockmap[lblk] != 0)
+    return of->blockmap[lblk];
+    int freeblock = allocblock(of->inode_num);
+    if(freeblock == -1)
+    return -1;
+    if(bmapset(of, lblk, freeblock) != 0){
+        blockref(freeblock, -1);
+        return -1;
+    }
+    printf("Block %d allocated to file %d\n", freeblock, of->inode_num);
+    return freeblock;
+}
+
+/* --HELPER FUNCTION--
+
+GIVES A SHARED FILE ITS OWN COPY OF ITS INDIRECT BLOCK. THE COPY TAKES A REFERENCE ON
+EVERY BLOCK IT POINTS TO. CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING
+RETURNS 0 ON SUCCESS (OR IF THE INDIRECT BLOCK IS NOT SHARED),
+RETURNS -1 ON FAILURE
+
+*/
+
+static int indirectcow(struct open_file* of){
+    int old = of->node.indirect_ptr;
+    if(old == 0 || blockref(old, 0) <= 1)
+    return 0;
+    int fresh = allocblock(of->inode_num);
+    if(fresh == -1)
+    return -1;
+    int* indirect = scratchget(BLOCK_SIZE);
+    if(indirect == NULL || jnl_read(old, indirect) != 1){
+        scratchput(indirect);
+        blockref(fresh, -1);
+        return -1;
+    }
+    for(int i = 0; i < BLOCK_SIZE / (int)sizeof(int); i++){
+        if(indirect[i] > 0 && blockref(indirect[i], 1) == -1){
+            while(--i >= 0){
+                if(indirect[i] > 0)
+                blockref(indirect[i], -1);
+            }
+            scratchput(indirect);
+            blockref(fresh, -1);
+            return -1;
+        }
+    }
+    jnl_write(fresh, indirect);
+    scratchput(indirect);
+    of->node.indirect_ptr = fresh;
+    indirectunref(old);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+POINTS LOGICAL BLOCK lblk OF AN OPEN FILE AT DISK BLOCK block (0 FOR A HOLE), IN THE
+I-NODE OR IN ITS INDIRECT BLOCK (ALLOCATED HERE IF NEEDED). CALLER HOLDS THE FILE'S
+I-NODE LOCK FOR WRITING
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int bmapset(struct open_file* of, int lblk, int block){
+    if(lblk < NUM_DIRECT_POINTERS_PER_INODE)
+    of->node.ptrs[lblk] = block;
+    //--A HOLE BELOW A MISSING INDIRECT BLOCK NEEDS NO INDIRECT BLOCK--
+    else if(block != 0 || of->node.indirect_ptr != 0){
+        if(of->node.indirect_ptr == 0){
+            int indirect_ptr = allocblock(of->inode_num);
+            if(indirect_ptr == -1)
+            return -1;
+            void* zero = scratchzero(BLOCK_SIZE);
+            jnl_write(indirect_ptr, zero);
+            scratchput(zero);
+            of->node.indirect_ptr = indirect_ptr;
+        }
+        else if((of->node.flags & INODE_SHARED) && indirectcow(of) != 0)
+        return -1;
+        jnl_patch(of->node.indirect_ptr, (lblk - NUM_DIRECT_POINTERS_PER_INODE) * sizeof(int), &block, sizeof(int));
+    }
+    of->blockmap[lblk] = block;
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+MAKES LOGICAL BLOCK lblk OF A SHARED FILE PRIVATE BEFORE IT IS OVERWRITTEN, MOVING IT TO
+A NEW BLOCK IF ANOTHER FILE OR A SNAPSHOT STILL REFERENCES IT OR IT IS IN THE FINGERPRINT
+INDEX. THE CALLER WRITES THE WHOLE BLOCK, SO THE OLD CONTENTS ARE NOT COPIED.
+CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS DISK ADDRESS OF THE BLOCK OR,
+RETURNS -1 IF THE DISK IS FULL
+
+*/
+
+static int bmapcow(struct open_file* of, int lblk){
+    //--COPYING THE INDIRECT BLOCK TAKES A REFERENCE ON THE BLOCKS BELOW IT, SO DO IT FIRST--
+    if(lblk >= NUM_DIRECT_POINTERS_PER_INODE && indirectcow(of) != 0)
+    return -1;
+    int old = of->blockmap[lblk];
+    pthread_mutex_lock(&fs->alloc_lock);
+    pthread_mutex_lock(&fs->dedup_lock);
+    int private = (fs->dedup_slot == NULL || fs->dedup_slot[old - DATA_BLOCKS_OFFSET] == 0) && blockref_locked(old, 0) <= 1;
+    pthread_mutex_unlock(&fs->dedup_lock);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    if(private && !fs->log_on)
+    return old;
+    int freeblock = allocblock(of->inode_num);
+    if(freeblock == -1)
+    return -1;
+    bmapset(of, lblk, freeblock);
+    blockref(old, -1);
+    printf("Block %d of file %d moved to block %d\n", old, of->inode_num, freeblock);
+    return freeblock;
+}
+
+/* --HELPER FUNCTION--
+
+MOVES THE INLINE DATA OF AN OPEN FILE INTO ITS FIRST DATA BLOCK. CALLER HOLDS THE FILE'S
+I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO BLOCK COULD BE ALLOCATED
+
+*/
+
+static int inlinepromote(struct open_file* of){
+    char* data_block = scratchzero(BLOCK_SIZE);
+    if(data_block == NULL)
+    return -1;
+    memcpy(data_block, inlinedata(&of->node), of->node.file_size);
+    memset(inlinedata(&of->node), 0, INODE_INLINE_CAPACITY);
+    of->node.flags &= ~INODE_INLINE;
+    if(of->node.file_size > 0){
+        int block = bmapalloc(of, 0);
+        if(block == -1){
+            memcpy(inlinedata(&of->node), data_block, of->node.file_size);
+            of->node.flags |= INODE_INLINE;
+            scratchput(data_block);
+            return -1;
+        }
+        cachewrite(block, 1, data_block);
+    }
+    scratchput(data_block);
+    return 0;
+}
+
+/* --DEDUPLICATION--
+
+THE FINGERPRINT INDEX MAPS THE 128-BIT HASH OF A BLOCK'S CONTENT TO THE BLOCK HOLDING IT.
+IT IS AN OPEN ADDRESSING TABLE IN MEMORY, dedup_slot MAPS EACH BLOCK BACK TO ITS SLOT SO A
+FREED BLOCK CAN BE DROPPED. ONLY BLOCKS WRITTEN WHILE DEDUP IS ON ARE INDEXED, AND THE
+INDEX STARTS EMPTY AT EVERY MOUNT. BOTH TABLES ONLY EXIST WHILE DEDUP IS ON. A MATCHING
+FINGERPRINT ONLY NAMES A CANDIDATE, THE BLOCK IS SHARED IF ITS BYTES ARE THE SAME.
+
+*/
+
+static unsigned long long rotl64(unsigned long long x, int r){
+    return (x << r) | (x >> (64 - r));
+}
+
+static unsigned long long fmix64(unsigned long long k){
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+/* --HELPER FUNCTION--
+
+128-BIT FINGERPRINT OF A DATA BLOCK (MURMURHASH3 x64_128)
+
+*/
+
+static void fingerprint(const void* data, unsigned long long hash[2]){
+    const unsigned long long c1 = 0x87c37b91114253d5ULL;
+    const unsigned long long c2 = 0x4cf5ad432745937fULL;
+    unsigned long long h1 = 0;
+    unsigned long long h2 = 0;
+    const unsigned long long* words = (const unsigned long long*) data;
+    for(int i = 0; i < BLOCK_SIZE / 16; i++){
+        unsigned long long k1 = words[2 * i];
+        unsigned long long k2 = words[2 * i + 1];
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+    h1 ^= BLOCK_SIZE;
+    h2 ^= BLOCK_SIZE;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+    hash[0] = h1;
+    hash[1] = h2;
+}
+
+/* --HELPER FUNCTION--
+
+FINDS THE INDEX SLOT OF hash, CALLER HOLDS dedup_lock. ONLY LOOKUPS (count SET) ARE
+COUNTED IN THE LOOKUP COST
+RETURNS SLOT HOLDING hash OR THE EMPTY SLOT WHERE IT WOULD GO
+
+*/
+
+static int dedup_probe(const unsigned long long hash[2], int count){
+    int h = (int)(hash[0] & (DEDUP_INDEX_SIZE - 1));
+    if(count)
+    fs->dedup_stats.lookups++;
+    while(fs->dedup_index[h].block != 0){
+        if(count)
+        fs->dedup_stats.probes++;
+        if(fs->dedup_index[h].hash[0] == hash[0] && fs->dedup_index[h].hash[1] == hash[1])
+        break;
+        h = (h + 1) & (DEDUP_INDEX_SIZE - 1);
+    }
+    return h;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS A BLOCK FROM THE FINGERPRINT INDEX, SHIFTING BACK THE ENTRIES PROBED PAST IT.
+CALLER HOLDS alloc_lock
+
+*/
+
+static void dedup_forget(int block){
+    pthread_mutex_lock(&fs->dedup_lock);
+    int h = fs->dedup_slot != NULL ? fs->dedup_slot[block - DATA_BLOCKS_OFFSET] - 1 : -1;
+    if(h >= 0){
+        fs->dedup_slot[block - DATA_BLOCKS_OFFSET] = 0;
+        fs->dedup_index[h].block = 0;
+        fs->dedup_stats.unique_blocks--;
+        for(int j = (h + 1) & (DEDUP_INDEX_SIZE - 1); fs->dedup_index[j].block != 0; j = (j + 1) & (DEDUP_INDEX_SIZE - 1)){
+            int home = (int)(fs->dedup_index[j].hash[0] & (DEDUP_INDEX_SIZE - 1));
+            //--MOVE THE ENTRY UNLESS ITS HOME LIES CYCLICALLY IN (h, j]--
+            if(h < j ? (home <= h || home > j) : (home <= h && home > j)){
+                fs->dedup_index[h] = fs->dedup_index[j];
+                fs->dedup_slot[fs->dedup_index[h].block - DATA_BLOCKS_OFFSET] = h + 1;
+                fs->dedup_index[j].block = 0;
+                h = j;
+            }
+        }
+    }
+    pthread_mutex_unlock(&fs->dedup_lock);
+}
+
+/* --HELPER FUNCTION--
+
+ADDS A BLOCK THAT WAS JUST WRITTEN TO THE FINGERPRINT INDEX
+
+*/
+
+static void dedup_insert(const unsigned long long hash[2], int block){
+    pthread_mutex_lock(&fs->dedup_lock);
+    fs->dedup_stats.blocks_written++;
+    if(fs->dedup_index == NULL){
+        pthread_mutex_unlock(&fs->dedup_lock);
+        return;
+    }
+    int h = dedup_probe(hash, 0);
+    if(fs->dedup_index[h].block == 0 && fs->dedup_slot[block - DATA_BLOCKS_OFFSET] == 0){
+        fs->dedup_index[h].hash[0] = hash[0];
+        fs->dedup_index[h].hash[1] = hash[1];
+        fs->dedup_index[h].block = block;
+        fs->dedup_slot[block - DATA_BLOCKS_OFFSET] = h + 1;
+        fs->dedup_stats.unique_blocks++;
+    }
+    pthread_mutex_unlock(&fs->dedup_lock);
+}
+
+/* --HELPER FUNCTION--
+
+FINGERPRINTS THE NEW CONTENT OF LOGICAL BLOCK lblk (LEFT IN hash) AND, IF A BLOCK WITH THE
+SAME CONTENT IS ALREADY ON DISK, POINTS lblk AT IT. THE BLOCK THE INDEX NAMES IS READ AND
+COMPARED FIRST, TWO CONTENTS CAN SHARE A FINGERPRINT. CALLER HOLDS THE FILE'S I-NODE LOCK
+FOR WRITING AND IS INSIDE jnl_begin
+RETURNS 0 IF THE BLOCK WAS SHARED (NOTHING LEFT TO WRITE),
+RETURNS -1 IF THE CALLER MUST WRITE IT
+
+*/
+
+static int dedupmap(struct open_file* of, int lblk, const char* data, unsigned long long hash[2]){
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fingerprint(data, hash);
+    int dup = 0;
+    int old = of->blockmap[lblk];
+    //--TAKE THE REFERENCE BEFORE LETTING GO OF THE INDEX, SO THE BLOCK CANNOT BE FREED--
+    pthread_mutex_lock(&fs->alloc_lock);
+    pthread_mutex_lock(&fs->dedup_lock);
+    if(fs->dedup_index != NULL)
+    dup = fs->dedup_index[dedup_probe(hash, 1)].block;
+    if(dup != 0 && dup != old && blockref_locked(dup, 1) == -1)
+    dup = 0;
+    pthread_mutex_unlock(&fs->dedup_lock);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    //--AN INDEXED BLOCK IS NEVER WRITTEN IN PLACE, SO IT STILL HOLDS WHAT WAS FINGERPRINTED--
+    if(dup != 0){
+        char* stored = scratchget(BLOCK_SIZE);
+        if(stored != NULL)
+        cacheread(dup, 1, stored, 0);
+        if(stored == NULL || memcmp(stored, data, BLOCK_SIZE) != 0){
+            if(dup != old)
+            blockref(dup, -1);
+            dup = 0;
+        }
+        scratchput(stored);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_mutex_lock(&fs->dedup_lock);
+    fs->dedup_stats.lookup_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    if(dup != 0){
+        fs->dedup_stats.blocks_written++;
+        fs->dedup_stats.blocks_shared++;
+    }
+    pthread_mutex_unlock(&fs->dedup_lock);
+    if(dup == 0)
+    return -1;
+    //--THE BLOCK ALREADY HOLDS THIS CONTENT--
+    if(dup == old)
+    return 0;
+    if(bmapset(of, lblk, dup) != 0){
+        blockref(dup, -1);
+        return -1;
+    }
+    if(old != 0)
+    blockref(old, -1);
+    return 0;
+}
+
+/* --DEDUP MODE--
+
+TURNS DEDUPLICATION OF WRITTEN DATA BLOCKS ON (enable != 0) OR OFF. TURNING IT ON
+ALLOCATES THE FINGERPRINT INDEX, TURNING IT OFF FREES IT. THE COUNTERS ARE KEPT UNTIL
+THE NEXT MOUNT
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO FILE SYSTEM IS MOUNTED OR THE INDEX CANNOT BE ALLOCATED
+
+*/
+
+int sfs_dedup(int enable){
+    if(!fs->mounted)
+    return -1;
+    //--NO WRITE IS IN FLIGHT WHILE io_lock IS HELD FOR WRITING, NO BLOCK MOVES WHILE fdt_lock IS--
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    pthread_mutex_lock(&fs->dedup_lock);
+    struct dedup_entry* index = fs->dedup_index;
+    int* slot = fs->dedup_slot;
+    int res = 0;
+    if(enable && index == NULL){
+        fs->dedup_index = calloc(DEDUP_INDEX_SIZE, sizeof(struct dedup_entry));
+        fs->dedup_slot = calloc(NUM_DATA_BLOCKS, sizeof(int));
+        if(fs->dedup_index == NULL || fs->dedup_slot == NULL){
+            free(fs->dedup_index);
+            free(fs->dedup_slot);
+            fs->dedup_index = NULL;
+            fs->dedup_slot = NULL;
+            res = -1;
+        }
+    }
+    else if(!enable){
+        fs->dedup_index = NULL;
+        fs->dedup_slot = NULL;
+        fs->dedup_stats.unique_blocks = 0;
+        free(index);
+        free(slot);
+    }
+    fs->dedup_on = fs->dedup_index != NULL;
+    pthread_mutex_unlock(&fs->dedup_lock);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    return res;
+}
+
+/* --DEDUP COUNTERS--
+
+COPIES THE DEDUP COUNTERS INTO stats. THE DEDUP RATIO IS
+blocks_written / (blocks_written - blocks_shared), THE AVERAGE LOOKUP COST IS
+probes / lookups INDEX SLOTS AND lookup_ns / lookups NANOSECONDS (HASH INCLUDED)
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_dedup_stats(struct sfs_dedup_stats* stats){
+    if(stats == NULL)
+    return -1;
+    pthread_mutex_lock(&fs->dedup_lock);
+    *stats = fs->dedup_stats;
+    pthread_mutex_unlock(&fs->dedup_lock);
+    return 0;
+}
+
+/* --COMPRESSION CODEC--
+
+LZ4 BLOCK FORMAT: A SEQUENCE IS A TOKEN (LITERAL LENGTH << 4 | MATCH LENGTH - 4), EXTRA
+LENGTH BYTES WHEN A NIBBLE IS 15, THE LITERALS, A 2-BYTE OFFSET AND EXTRA MATCH LENGTH
+BYTES. THE LAST SEQUENCE ONLY HAS LITERALS. MATCHES ARE FOUND WITH A HASH OF 4 BYTES.
+
+*/
+
+static unsigned int lz_read32(const char* p){
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned int lz_hash(unsigned int v){
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* --HELPER FUNCTION--
+
+WRITES A LENGTH THAT DID NOT FIT IN ITS NIBBLE (len >= 15) AS EXTRA BYTES
+RETURNS NEXT OUTPUT POSITION OR,
+RETURNS NULL IF IT DOES NOT FIT BEFORE end
+
+*/
+
+static char* lz_putlen(char* op, char* end, int len){
+    for(len -= 15; len >= 255; len -= 255){
+        if(op >= end)
+        return NULL;
+        *op++ = (char) 255;
+    }
+    if(op >= end)
+    return NULL;
+    *op++ = (char) len;
+    return op;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES ONE SEQUENCE (match_len 0 FOR THE LAST, LITERALS ONLY)
+RETURNS NEXT OUTPUT POSITION OR,
+RETURNS NULL IF IT DOES NOT FIT BEFORE end
+
+*/
+
+static char* lz_sequence(char* op, char* end, const char* literals, int lit_len, int offset, int match_len){
+    if(op >= end)
+    return NULL;
+    char* token = op++;
+    *token = (char)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if(lit_len >= 15 && (op = lz_putlen(op, end, lit_len)) == NULL)
+    return NULL;
+    if(end - op < lit_len)
+    return NULL;
+    memcpy(op, literals, lit_len);
+    op += lit_len;
+    if(match_len == 0)
+    return op;
+    if(end - op < 2)
+    return NULL;
+    *op++ = (char)(offset & 0xff);
+    *op++ = (char)(offset >> 8);
+    *token |= (char)(match_len - 4 >= 15 ? 15 : match_len - 4);
+    if(match_len - 4 >= 15)
+    op = lz_putlen(op, end, match_len - 4);
+    return op;
+}
+
+/* --HELPER FUNCTION--
+
+COMPRESSES len BYTES OF src INTO AT MOST cap BYTES OF dst
+RETURNS COMPRESSED LENGTH OR,
+RETURNS -1 IF IT DOES NOT FIT
+
+*/
+
+static int lz_compress(const char* src, int len, char* dst, int cap){
+    int table[1 << LZ_HASH_BITS];
+    memset(table, -1, sizeof(table));
+    char* op = dst;
+    char* end = dst + cap;
+    int anchor = 0;
+    int ip = 0;
+    while(ip + 4 <= len){
+        unsigned int h = lz_hash(lz_read32(src + ip));
+        int ref = table[h];
+        table[h] = ip;
+        if(ref < 0 || ip - ref > 65535 || lz_read32(src + ref) != lz_read32(src + ip)){
+            ip++;
+            continue;
+        }
+        int match_len = 4;
+        while(ip + match_len < len && src[ref + match_len] == src[ip + match_len]){
+            match_len++;
+        }
+        op = lz_sequence(op, end, src + anchor, ip - anchor, ip - ref, match_len);
+        if(op == NULL)
+        return -1;
+        ip += match_len;
+        anchor = ip;
+    }
+    op = lz_sequence(op, end, src + anchor, len - anchor, 0, 0);
+    return op == NULL ? -1 : (int)(op - dst);
+}
+
+/* --HELPER FUNCTION--
+
+DECOMPRESSES clen BYTES OF src INTO AT MOST len BYTES OF dst
+RETURNS NUMBER OF BYTES PRODUCED OR,
+RETURNS -1 IF THE INPUT IS CORRUPT
+
+*/
+
+static int lz_decompress(const char* src, int clen, char* dst, int len){
+    const unsigned char* ip = (const unsigned char*) src;
+    const unsigned char* iend = ip + clen;
+    int op = 0;
+    while(ip < iend){
+        int token = *ip++;
+        int lit_len = token >> 4;
+        if(lit_len == 15){
+            int b;
+            do{
+                if(ip >= iend)
+                return -1;
+                b = *ip++;
+                lit_len += b;
+            } while(b == 255);
+        }
+        if(iend - ip < lit_len || len - op < lit_len)
+        return -1;
+        memcpy(dst + op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+        if(ip == iend)
+        break;
+        if(iend - ip < 2)
+        return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        int match_len = (token & 15) + 4;
+        if((token & 15) == 15){
+            int b;
+            do{
+                if(ip >= iend)
+                return -1;
+                b = *ip++;
+                match_len += b;
+            } while(b == 255);
+        }
+        if(offset == 0 || offset > op || len - op < match_len)
+        return -1;
+        //--THE MATCH MAY OVERLAP WHAT IT PRODUCES, COPY BYTE BY BYTE--
+        for(int k = 0; k < match_len; k++, op++){
+            dst[op] = dst[op - offset];
+        }
+    }
+    return op;
+}
+
+/* --HELPER FUNCTION--
+
+READS GROUP g OF AN OPEN FILE INTO image (GROUP_SIZE BYTES), DECOMPRESSING IT IF NEEDED.
+CALLER HOLDS THE FILE'S I-NODE LOCK
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int groupload(struct open_file* of, int g, char* image){
+    int* map = &of->blockmap[g * GROUP_BLOCKS];
+    if(map[GROUP_BLOCKS - 1] != COMPRESSED_GROUP){
+        for(int k = 0; k < GROUP_BLOCKS; k++){
+            if(map[k] > 0)
+            read_blocks(map[k], 1, image + k * BLOCK_SIZE);
+            else
+            memset(image + k * BLOCK_SIZE, 0, BLOCK_SIZE);
+        }
+        return 0;
+    }
+    char* packed = scratchget(GROUP_SIZE);
+    if(packed == NULL)
+    return -1;
+    int n = 0;
+    while(n < GROUP_BLOCKS - 1 && map[n] > 0){
+        read_blocks(map[n], 1, packed + n * BLOCK_SIZE);
+        n++;
+    }
+    int clen;
+    memcpy(&clen, packed, GROUP_HEADER_SIZE);
+    int len = -1;
+    if(clen >= 0 && clen <= n * BLOCK_SIZE - GROUP_HEADER_SIZE)
+    len = lz_decompress(packed + GROUP_HEADER_SIZE, clen, image, GROUP_SIZE);
+    scratchput(packed);
+    if(len < 0){
+        printf("Corrupt compressed group %d in file %d\n", g, of->inode_num);
+        return -1;
+    }
+    //--ONLY THE PART OF THE GROUP BEFORE THE END OF THE FILE IS STORED--
+    memset(image + len, 0, GROUP_SIZE - len);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES len BYTES OF buf AT offset OF GROUP g. THE PART OF THE GROUP BEFORE THE END OF THE
+FILE IS STORED COMPRESSED IF THE FILE HAS INODE_COMPRESS AND IT SAVES AT LEAST ONE BLOCK,
+OTHERWISE AS PLAIN BLOCKS, ALWAYS IN NEW BLOCKS. A GROUP OF ZEROS BECOMES A HOLE. THE NEW
+GROUP IS LEFT IN THE FILE'S GROUP CACHE.
+CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF THE DISK IS FULL
+
+*/
+
+static int groupwrite(struct open_file* of, int g, const char* buf, int offset, int len){
+    char* image = scratchget(GROUP_SIZE);
+    char* packed = scratchget(GROUP_SIZE);
+    int res = -1;
+    if(image == NULL || packed == NULL || groupload(of, g, image) != 0){
+        scratchput(image);
+        scratchput(packed);
+        return -1;
+    }
+    memcpy(image + offset, buf, len);
+    int end = of->node.file_size - g * GROUP_SIZE;
+    if(end < offset + len)
+    end = offset + len;
+    if(end > GROUP_SIZE)
+    end = GROUP_SIZE;
+    int n = (end + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    if(iszero(image, end))
+    n = 0;
+    int raw = n;
+    char* out = image;
+    if((of->node.flags & INODE_COMPRESS) && n > 1){
+        int cap = (n - 1) * BLOCK_SIZE - GROUP_HEADER_SIZE;
+        int clen = lz_compress(image, end, packed + GROUP_HEADER_SIZE, cap);
+        if(clen >= 0){
+            memcpy(packed, &clen, GROUP_HEADER_SIZE);
+            memset(packed + GROUP_HEADER_SIZE + clen, 0, GROUP_SIZE - GROUP_HEADER_SIZE - clen);
+            n = (GROUP_HEADER_SIZE + clen + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            out = packed;
+        }
+    }
+    int fresh[GROUP_BLOCKS];
+    int k;
+    for(k = 0; k < n; k++){
+        fresh[k] = allocblock(of->inode_num);
+        if(fresh[k] == -1)
+        break;
+        cachewrite(fresh[k], 1, out + k * BLOCK_SIZE);
+    }
+    if(k == n){
+        //--POINT THE GROUP AT THE NEW BLOCKS, THEN LET GO OF THE OLD ONES--
+        int old[GROUP_BLOCKS];
+        memcpy(old, &of->blockmap[g * GROUP_BLOCKS], sizeof(old));
+        res = 0;
+        for(int j = 0; j < GROUP_BLOCKS && res == 0; j++){
+            int ptr = j < n ? fresh[j] : 0;
+            if(n < raw && j == GROUP_BLOCKS - 1)
+            ptr = COMPRESSED_GROUP;
+            res = bmapset(of, g * GROUP_BLOCKS + j, ptr);
+        }
+        if(res == 0){
+            for(int j = 0; j < GROUP_BLOCKS; j++){
+                if(old[j] > 0)
+                blockref(old[j], -1);
+            }
+            pthread_mutex_lock(&of->cache_lock);
+            memcpy(of->cache, image, GROUP_SIZE);
+            of->cache_group = g;
+            pthread_mutex_unlock(&of->cache_lock);
+        }
+    }
+    else{
+        while(--k >= 0){
+            blockref(fresh[k], -1);
+        }
+    }
+    scratchput(image);
+    scratchput(packed);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS A DESCRIPTOR FOR AN I-NODE, SHARING ITS open_file IF THE FILE IS ALREADY OPEN.
+THE I-NODE COMES FROM THE I-NODE TABLE, OR FROM node IF IT IS SET (A SNAPSHOT CATALOG),
+AND THEN THE DESCRIPTOR GETS AN open_file OF ITS OWN. CALLER HOLDS fdt_lock FOR WRITING
+RETURNS FILE DESCRIPTOR OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int fdtinstall(int inode_index, const struct inode* node){
+    struct open_file* of = node == NULL ? fs->open_files[inode_index] : NULL;
+    if(of == NULL){
+        of = ofalloc();
+        if(of == NULL)
+        return -1;
+        of->inode_num = inode_index;
+        of->snapshot = -1;
+        of->refcount = 0;
+        of->unlinked = 0;
+        of->cache_group = -1;
+        of->advice = SFS_FADV_NORMAL;
+        of->ra_next = 0;
+        of->ra_start = 0;
+        of->ra_end = 0;
+        if(node != NULL)
+        of->node = *node;
+        if((node == NULL && readinode(inode_index, &of->node) != 0) || bmapload(of) != 0){
+            scratchput(of);
+            return -1;
+        }
+        pthread_mutex_init(&of->cache_lock, NULL);
+        if(node == NULL)
+        fs->open_files[inode_index] = of;
+    }
+    //--NO FREE SLOT LEFT, DOUBLE THE TABLE--
+    if(fs->fdt_free == -1){
+        int new_size = fs->fdt_size == 0 ? FDT_INITIAL_SIZE : fs->fdt_size * 2;
+        struct fdt_entry* grown = realloc(fs->fdt, new_size * sizeof(struct fdt_entry));
+        if(grown == NULL){
+            if(__atomic_load_n(&of->refcount, __ATOMIC_RELAXED) == 0){
+                if(node == NULL)
+                fs->open_files[inode_index] = NULL;
+                offree(of);
+            }
+            return -1;
+        }
+        fs->fdt = grown;
+        for(int i = new_size - 1; i >= fs->fdt_size; i--){
+            fs->fdt[i].of = NULL;
+            fs->fdt[i].rw_ptr = 0;
+            fs->fdt[i].next_free = fs->fdt_free;
+            fs->fdt_free = i;
+        }
+        fs->fdt_size = new_size;
+    }
+    int fd = fs->fdt_free;
+    fs->fdt_free = fs->fdt[fd].next_free;
+    __atomic_add_fetch(&of->refcount, 1, __ATOMIC_RELAXED);
+    fs->fdt[fd].of = of;
+    fs->fdt[fd].rw_ptr = of->node.file_size;
+    return fd;
+}
+
+/* --HELPER FUNCTION--
+
+LOOKS UP THE OPEN FILE OF A DESCRIPTOR, CALLER HOLDS fdt_lock
+RETURNS open_file OR,
+RETURNS NULL IF THE DESCRIPTOR IS NOT OPEN OR ITS FILE WAS REMOVED
+
+*/
+
+static struct open_file* fdtget(int fileID){
+    if(fileID < 0 || fileID >= fs->fdt_size)
+    return NULL;
+    struct open_file* of = fs->fdt[fileID].of;
+    if(of == NULL || of->unlinked)
+    return NULL;
+    return of;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS A REFERENCE TO AN open_file AND FREES IT WITH THE LAST ONE. CALLER HOLDS fdt_lock
+FOR WRITING, SO NO LOOKUP CAN FIND THE open_file WHILE IT IS FREED
+
+*/
+
+static void ofdrop(struct open_file* of){
+    if(__atomic_sub_fetch(&of->refcount, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+    if(of->snapshot != -1)
+    fs->snap_open[of->snapshot]--;
+    else if(!of->unlinked)
+    fs->open_files[of->inode_num] = NULL;
+    offree(of);
+}
+
+/* --HELPER FUNCTION--
+
+DROPS A REFERENCE TAKEN WITH fdtpin. ONLY THE LAST ONE NEEDS fdt_lock (SEE ofdrop)
+
+*/
+
+static void ofput(struct open_file* of){
+    int n = __atomic_load_n(&of->refcount, __ATOMIC_RELAXED);
+    while(n > 1){
+        if(__atomic_compare_exchange_n(&of->refcount, &n, n - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    }
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    ofdrop(of);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+}
+
+/* --HELPER FUNCTION--
+
+PINS THE open_file OF DESCRIPTOR fileID WITH A REFERENCE, SO A CALL CAN WORK ON IT
+WITHOUT HOLDING fdt_lock. A CALL THAT WRITES (write != 0) CANNOT PIN A SNAPSHOT FILE. IF
+rw_ptr IS SET IT GETS THE DESCRIPTOR'S OFFSET, WHICH MOVES advance BYTES IN THE SAME STEP
+BUT NEVER PAST THE MAXIMUM FILE SIZE (THE CALLER CUTS ITS LENGTH THE SAME WAY)
+RETURNS open_file OR,
+RETURNS NULL IF THE DESCRIPTOR IS NOT OPEN OR ITS FILE WAS REMOVED
+
+*/
+
+static struct open_file* fdtpin(int fileID, int write, int advance, int* rw_ptr){
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    struct open_file* of = fdtget(fileID);
+    if(of != NULL && write && of->snapshot != -1)
+    of = NULL;
+    if(of != NULL){
+        __atomic_add_fetch(&of->refcount, 1, __ATOMIC_RELAXED);
+        if(rw_ptr != NULL){
+            int old = __atomic_load_n(&fs->fdt[fileID].rw_ptr, __ATOMIC_RELAXED);
+            int step;
+            do{
+                step = advance < MAX_FILE_BLOCKS * BLOCK_SIZE - old ? advance : MAX_FILE_BLOCKS * BLOCK_SIZE - old;
+            }while(!__atomic_compare_exchange_n(&fs->fdt[fileID].rw_ptr, &old, old + step, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+            *rw_ptr = old;
+        }
+    }
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    return of;
+}
+
+/* --HELPER FUNCTION--
+
+ENDS A CALL STARTED WITH filebegin. A READ OR A WRITE THAT MOVED THE OFFSET TO from BUT
+STOPPED AT to MOVES IT BACK, UNLESS THE DESCRIPTOR WAS CLOSED, SEEKED OR MOVED BY
+ANOTHER CALL IN THE MEANTIME
+
+*/
+
+static void fileend(int fileID, struct open_file* of, int from, int to){
+    pthread_rwlock_unlock(&fs->inode_locks[of->inode_num]);
+    if(from != to){
+        pthread_rwlock_rdlock(&fs->fdt_lock);
+        if(fs->fdt[fileID].of == of)
+        __atomic_compare_exchange_n(&fs->fdt[fileID].rw_ptr, &from, to, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+        pthread_rwlock_unlock(&fs->fdt_lock);
+    }
+    ofput(of);
+    pthread_rwlock_unlock(&fs->io_lock);
+}
+
+/* --HELPER FUNCTION--
+
+STARTS A CALL ON THE FILE OPEN AS fileID: TAKES io_lock, PINS THE open_file (SEE fdtpin)
+AND TAKES ITS I-NODE LOCK, FOR WRITING IF write IS SET. sfs_remove CAN UNLINK A PINNED
+FILE, SO THAT IS CHECKED AGAIN UNDER THE I-NODE LOCK. fileend ENDS THE CALL
+RETURNS open_file OR,
+RETURNS NULL IF THE DESCRIPTOR IS NOT OPEN OR ITS FILE WAS REMOVED
+
+*/
+
+static struct open_file* filebegin(int fileID, int write, int advance, int* rw_ptr){
+    pthread_rwlock_rdlock(&fs->io_lock);
+    struct open_file* of = fdtpin(fileID, write, advance, rw_ptr);
+    if(of == NULL){
+        pthread_rwlock_unlock(&fs->io_lock);
+        return NULL;
+    }
+    if(write)
+    pthread_rwlock_wrlock(&fs->inode_locks[of->inode_num]);
+    else
+    pthread_rwlock_rdlock(&fs->inode_locks[of->inode_num]);
+    //--THE DESCRIPTOR IS DEAD, ITS OFFSET DOES NOT MATTER ANY MORE--
+    if(__atomic_load_n(&of->unlinked, __ATOMIC_ACQUIRE)){
+        fileend(fileID, of, 0, 0);
+        return NULL;
+    }
+    return of;
+}
+
+/* --HELPER FUNCTION--
+
+OPENS FILE name FOR sfs_fopen, CREATING IT IF IT DOES NOT EXIST
+RETURNS THE FILE DESCRIPTOR OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int fileopen(char* name){
+    int fd;
+    if(strlen(name) >= MAX_FILE_NAME_LENGTH)
+    return -1;
+
+    //--FAST PATH: LOCK-FREE LOOKUP CACHE--
+    int inode_index = dcache_lookup(name);
+    if(inode_index != -1){
+        pthread_rwlock_wrlock(&fs->fdt_lock);
+        //--sfs_remove INVALIDATES THE CACHE BEFORE IT CLEARS THE FDT, SO CHECK AGAIN--
+        if(dcache_lookup(name) == inode_index){
+            fd = fdtinstall(inode_index, NULL);
+            pthread_rwlock_unlock(&fs->fdt_lock);
+            return fd;
+        }
+        pthread_rwlock_unlock(&fs->fdt_lock);
+    }
+
+    //--CHECK IF FILE WITH name ALREADY EXISTS IN DIRECTORY--
+    pthread_rwlock_rdlock(&fs->dir_lock);
+    inode_index = dirlookup(name, NULL, NULL);
+    if(inode_index != -1){
+        printf("File found in directory\n");
+        dcache_set(name, inode_index);
+        pthread_rwlock_wrlock(&fs->fdt_lock);
+        fd = fdtinstall(inode_index, NULL);
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        pthread_rwlock_unlock(&fs->dir_lock);
+        return fd;
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+
+    //--FILE WAS NOT FOUND IN DIRECTORY--
+    jnl_begin();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    //--ANOTHER THREAD MAY HAVE CREATED IT IN THE MEANTIME--
+    inode_index = dirlookup(name, NULL, NULL);
+    if(inode_index == -1){
+        inode_index = allocinode();
+        if(inode_index == -1 || diradd(name, inode_index) != 0){
+            if(inode_index != -1)
+            releaseinode(inode_index);
+            pthread_rwlock_unlock(&fs->dir_lock);
+            jnl_end();
+            return -1;
+        }
+        dcache_set(name, inode_index);
+    }
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    fd = fdtinstall(inode_index, NULL);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    return fd;
+}
+
+int sfs_fopen(char* name){
+    long long start = tracestart();
+    int fd = fileopen(name);
+    if(fd != -1)
+    traceop(start, "open %s %d", name, fd);
+    return fd;
+}
+
+int sfs_fclose(int fileID){
+    long long start = tracestart();
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    if(fileID < 0 || fileID >= fs->fdt_size || fs->fdt[fileID].of == NULL){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        return -1;
+    }
+    //--THE SHARED STATE GOES WITH THE LAST DESCRIPTOR, OR THE LAST CALL STILL PINNING IT--
+    ofdrop(fs->fdt[fileID].of);
+    fs->fdt[fileID].of = NULL;
+    fs->fdt[fileID].rw_ptr = 0;
+    fs->fdt[fileID].next_free = fs->fdt_free;
+    fs->fdt_free = fileID;
+    //--BEFORE THE DESCRIPTOR CAN BE HANDED OUT AGAIN, SO THE LINE COMES BEFORE ITS NEXT open--
+    traceop(start, "close %d", fileID);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+RESERVES ONE RUN OF BLOCKS FOR THE HOLES OF AN OPEN FILE BETWEEN LOGICAL BLOCKS lblk AND
+last, SO A LARGE WRITE INTO THEM LANDS CONTIGUOUS ON DISK. CALLER HOLDS THE FILE'S
+I-NODE LOCK FOR WRITING
+RETURNS DISK ADDRESS OF THE FIRST BLOCK (THE LENGTH OF THE RUN IN len) OR,
+RETURNS -1 (len 0) IF THERE ARE FEWER THAN TWO HOLES OR NO FREE BLOCK
+
+*/
+
+static int holerun(struct open_file* of, int lblk, int last, int* len){
+    int want = 0;
+    *len = 0;
+    if(last >= MAX_FILE_BLOCKS)
+    last = MAX_FILE_BLOCKS - 1;
+    for(int k = lblk; k <= last; k++){
+        if(of->blockmap[k] == 0)
+        want++;
+    }
+    if(want < 2)
+    return -1;
+    int first = allocrun(of->inode_num, want, len);
+    if(first != -1)
+    printf("Blocks %d-%d reserved for file %d\n", first, first + *len - 1, of->inode_num);
+    return first;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES length BYTES OF buf AT OFFSET rw_ptr OF AN OPEN FILE AND GROWS ITS SIZE IF NEEDED.
+THE HOLES IT FILLS GET THEIR BLOCKS AS ONE RUN (SEE holerun), AND BLOCKS THAT END UP
+NEXT TO EACH OTHER ON DISK GO OUT AS ONE DEVICE WRITE.
+CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS NUMBER OF BYTES WRITTEN (SHORT IF THE FILE OR THE DISK IS FULL)
+
+*/
+
+static int filewrite(struct open_file* of, int rw_ptr, const char* buf, int length){
+    //--SMALL FILE, THE WRITE ONLY TOUCHES THE I-NODE RECORD--
+    if((of->node.flags & INODE_INLINE) && rw_ptr <= INODE_INLINE_CAPACITY - length){
+        memcpy(inlinedata(&of->node) + rw_ptr, buf, length);
+        if(of->node.file_size < rw_ptr + length)
+        of->node.file_size = rw_ptr + length;
+        putinode(of->inode_num, &of->node);
+        return length;
+    }
+    if((of->node.flags & INODE_INLINE) && inlinepromote(of) != 0)
+    return 0;
+    //--BLOCKS WRITTEN IN DEDUP MODE CAN BE SHARED BY ANY OTHER FILE--
+    if(fs->dedup_on)
+    of->node.flags |= INODE_SHARED;
+    void* buffer = scratchget(BLOCK_SIZE);
+    char* data_block = (char*) buffer;
+    //--GATHER ADJACENT BLOCKS (ALWAYS THE CASE IN LOG MODE) INTO ONE DEVICE WRITE. IN DEDUP
+    //--MODE A BLOCK MUST BE ON DISK BEFORE IT IS INDEXED, SO EACH ONE IS WRITTEN AT ONCE--
+    struct log_run run = {NULL, 0, 0};
+    if(!fs->dedup_on)
+    run.data = scratchget(LOG_SEGMENT_BLOCKS * BLOCK_SIZE);
+    int resv = 0; //next reserved block
+    int resv_len = 0; //reserved blocks left
+    int i = 0;
+    while(i < length){
+        int lblk = (rw_ptr + i) / BLOCK_SIZE;
+        int position = (rw_ptr + i) % BLOCK_SIZE;
+        int chunk = BLOCK_SIZE - position;
+        if(chunk > length - i)
+        chunk = length - i;
+        if(lblk >= MAX_FILE_BLOCKS)
+        break;
+        //--COMPRESSED FILE OR GROUP, THE WRITE COVERS AS MUCH OF THE GROUP AS IT CAN--
+        int g = lblk / GROUP_BLOCKS;
+        if((of->node.flags & INODE_COMPRESS) || of->blockmap[g * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+            int offset = rw_ptr + i - g * GROUP_SIZE;
+            int span = GROUP_SIZE - offset;
+            if(span > length - i)
+            span = length - i;
+            if(groupwrite(of, g, buf + i, offset, span) != 0)
+            break;
+            i += span;
+            continue;
+        }
+        int had_block = of->blockmap[lblk] != 0;
+        //--PARTIAL BLOCK, MERGE WITH WHAT IS ALREADY THERE--
+        if(chunk < BLOCK_SIZE){
+            if(had_block)
+            cacheread(of->blockmap[lblk], 1, data_block, 0);
+            else
+            memset(data_block, 0, BLOCK_SIZE);
+        }
+        memcpy(data_block + position, buf + i, chunk);
+        //--A BLOCK OF ZEROS IN A HOLE STAYS A HOLE--
+        if(!had_block && iszero(data_block, BLOCK_SIZE)){
+            i += chunk;
+            continue;
+        }
+        //--SAME CONTENT ALREADY ON DISK, SHARE THAT BLOCK INSTEAD OF WRITING IT--
+        unsigned long long hash[2] = {0, 0};
+        if(fs->dedup_on && dedupmap(of, lblk, data_block, hash) == 0){
+            i += chunk;
+            continue;
+        }
+        //--ALLOCATE BLOCKS TO THE FILE NECESSARY FOR THE WRITE, FROM THE RESERVED RUN IF THERE IS ONE--
+        int block;
+        if(!had_block && resv_len == 0 && run.data != NULL && !fs->log_on)
+        resv = holerun(of, lblk, (rw_ptr + length - 1) / BLOCK_SIZE, &resv_len);
+        if(!had_block && resv_len > 0){
+            block = bmapset(of, lblk, resv) == 0 ? resv : -1;
+            if(block != -1){
+                resv++;
+                resv_len--;
+            }
+        }
+        else
+        block = bmapalloc(of, lblk);
+        //--COPY ON WRITE, THE BLOCK MAY ALSO BELONG TO A CLONE OR A SNAPSHOT (ALWAYS IN LOG MODE)--
+        if(block != -1 && had_block && ((of->node.flags & INODE_SHARED) || fs->log_on))
+        block = bmapcow(of, lblk);
+        if(block == -1)
+        break;
+        if(run.data != NULL)
+        logappend(&run, block, data_block);
+        else
+        cachewrite(block, 1, data_block);
+        if(fs->dedup_on)
+        dedup_insert(hash, block);
+        i += chunk;
+    }
+    logflush(&run);
+    //--HOLES THAT STAYED HOLES (ZEROS) OR A WRITE CUT SHORT LEAVE PART OF THE RUN UNUSED--
+    while(resv_len-- > 0){
+        blockref(resv++, -1);
+    }
+    scratchput(run.data);
+    scratchput(buffer);
+    if(of->node.file_size < rw_ptr + i)
+    of->node.file_size = rw_ptr + i;
+    putinode(of->inode_num, &of->node);
+    return i;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES length BYTES OF buf AT THE POINTER OF DESCRIPTOR fileID AND MOVES THE POINTER.
+full IS LEFT AT THE DISK SIZE IN BLOCKS IF THE WRITE STOPPED SHORT OF THE MAXIMUM FILE SIZE
+(THE DISK RAN OUT OF BLOCKS), 0 OTHERWISE
+RETURNS NUMBER OF BYTES WRITTEN OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int fdtwrite(int fileID, const char* buf, int length, int* full){
+    *full = 0;
+    if(length < 0)
+    return -1;
+    //--NO WRITE GOES PAST THE MAXIMUM FILE SIZE, SO NEITHER DOES THE OFFSET--
+    if(length > MAX_FILE_BLOCKS * BLOCK_SIZE)
+    length = MAX_FILE_BLOCKS * BLOCK_SIZE;
+    jnl_begin();
+    int rw_ptr;
+    struct open_file* of = filebegin(fileID, 1, length, &rw_ptr);
+    if(of == NULL){
+        jnl_end();
+        return -1;
+    }
+    if(length > MAX_FILE_BLOCKS * BLOCK_SIZE - rw_ptr)
+    length = MAX_FILE_BLOCKS * BLOCK_SIZE - rw_ptr;
+    __atomic_add_fetch(&fs->heat[of->inode_num], 1, __ATOMIC_RELAXED);
+    int written = filewrite(of, rw_ptr, buf, length);
+    if(written < length && rw_ptr + written < MAX_FILE_BLOCKS * BLOCK_SIZE)
+    *full = NUM_BLOCKS;
+    fileend(fileID, of, rw_ptr + length, rw_ptr + written);
+    jnl_end();
+    return written;
+}
+
+int sfs_fwrite(int fileID, const char* buf, int length){
+    long long start = tracestart();
+    int full;
+    int written = fdtwrite(fileID, buf, length, &full);
+    //--OUT OF BLOCKS: BLOCKS FREED BY THE RUNNING TRANSACTION COME BACK WITH A COMMIT, AND
+    //--WITH sfs_autogrow SET THE DISK GROWS. THEN WRITE THE REST--
+    while(full && ((freepending() && jnl_commit() == 0) || growfs(0, full) == 0)){
+        int more = fdtwrite(fileID, buf + written, length - written, &full);
+        if(more <= 0)
+        break;
+        written += more;
+    }
+    if(written >= 0)
+    traceop(start, "write %d %d", fileID, written);
+    return written;
+}
+
+/* --HELPER FUNCTION--
+
+LOADS THE PLAIN BLOCKS OF AN OPEN FILE IN LOGICAL BLOCKS [first, last] INTO THE BLOCK
+CACHE, ONE cachefill PER RUN OF BLOCKS THAT FOLLOW EACH OTHER ON DISK, AT MOST max_run
+BLOCKS LONG. CALLER HOLDS THE FILE'S I-NODE LOCK
+RETURNS NUMBER OF BLOCKS LOADED
+
+*/
+
+static int fileprefetch(struct open_file* of, int first, int last, int max_run, long long* counter){
+    int* map = of->blockmap;
+    int loaded = 0;
+    if(last >= MAX_FILE_BLOCKS)
+    last = MAX_FILE_BLOCKS - 1;
+    int lblk = first;
+    while(lblk <= last){
+        if(map[lblk] <= 0 || map[lblk / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+            lblk++;
+            continue;
+        }
+        int n = 1;
+        while(lblk + n <= last && n < max_run && map[lblk + n] == map[lblk] + n
+              && map[(lblk + n) / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] != COMPRESSED_GROUP){
+            n++;
+        }
+        loaded += cachefill(map[lblk], n, counter);
+        lblk += n;
+    }
+    return loaded;
+}
+
+/* --HELPER FUNCTION--
+
+READS AHEAD OF A READER OF AN OPEN FILE WHOSE NEXT BYTE IS IN LOGICAL BLOCK next, ra
+BLOCKS AT A TIME. A NEW WINDOW IS ONLY LOADED ONCE THE READER IS HALFWAY THROUGH THE LAST
+ONE, SO THE BLOCKS COME IN LARGE DEVICE READS. CALLER HOLDS THE FILE'S I-NODE LOCK
+
+*/
+
+static void readahead(struct open_file* of, int next, int ra){
+    int start = __atomic_load_n(&of->ra_start, __ATOMIC_RELAXED);
+    int end = __atomic_load_n(&of->ra_end, __ATOMIC_RELAXED);
+    int last = (of->node.file_size - 1) / BLOCK_SIZE;
+    if(next > last || (next >= start && end - next > ra / 2))
+    return;
+    int from = next >= start && end > next ? end : next;
+    __atomic_store_n(&of->ra_start, next, __ATOMIC_RELAXED);
+    __atomic_store_n(&of->ra_end, next + ra, __ATOMIC_RELAXED);
+    if(from < next + ra)
+    fileprefetch(of, from, next + ra - 1 < last ? next + ra - 1 : last, ra, &fs->cache_stats.readahead);
+}
+
+/* --HELPER FUNCTION--
+
+READS UP TO length BYTES AT OFFSET rw_ptr OF AN OPEN FILE INTO buf, NEVER PAST ITS END.
+HOLES READ AS ZEROS, AND WHOLE BLOCKS THAT FOLLOW EACH OTHER ON DISK ARE READ WITH ONE
+DEVICE READ. DATA BLOCKS GO THROUGH THE BLOCK CACHE, AND THE READ IS FOLLOWED BY A
+READAHEAD AS THE FILE'S ADVICE SAYS. CALLER HOLDS THE FILE'S I-NODE LOCK
+RETURNS NUMBER OF BYTES READ
+
+*/
+
+static int fileread(struct open_file* of, int rw_ptr, char* buf, int length){
+    //--NEVER READ PAST THE END OF THE FILE--
+    if(length > of->node.file_size - rw_ptr)
+    length = of->node.file_size - rw_ptr;
+    if(length < 0)
+    length = 0;
+    //--SMALL FILE, SERVED FROM THE CACHED I-NODE--
+    if(of->node.flags & INODE_INLINE){
+        memcpy(buf, inlinedata(&of->node) + rw_ptr, length);
+        return length;
+    }
+    //--A SEQUENTIAL READER IS DONE WITH EVERY BLOCK IT READS TO THE END--
+    int advice = __atomic_load_n(&of->advice, __ATOMIC_RELAXED);
+    int behind = advice == SFS_FADV_SEQUENTIAL;
+    void* buffer = scratchget(BLOCK_SIZE);
+    char* data_block = (char*) buffer;
+    int i = 0;
+    while(i < length){
+        int lblk = (rw_ptr + i) / BLOCK_SIZE;
+        int position = (rw_ptr + i) % BLOCK_SIZE;
+        int chunk = BLOCK_SIZE - position;
+        if(chunk > length - i)
+        chunk = length - i;
+        //--COMPRESSED GROUP, DECOMPRESSED ONCE INTO THE CACHE AND SERVED FROM THERE--
+        int g = lblk / GROUP_BLOCKS;
+        if(of->blockmap[g * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+            int offset = rw_ptr + i - g * GROUP_SIZE;
+            int span = GROUP_SIZE - offset;
+            if(span > length - i)
+            span = length - i;
+            pthread_mutex_lock(&of->cache_lock);
+            int res = 0;
+            if(of->cache_group != g){
+                of->cache_group = -1;
+                res = groupload(of, g, of->cache);
+                if(res == 0)
+                of->cache_group = g;
+            }
+            if(res == 0)
+            memcpy(buf + i, of->cache + offset, span);
+            pthread_mutex_unlock(&of->cache_lock);
+            if(res != 0)
+            break;
+            i += span;
+            continue;
+        }
+        if(of->blockmap[lblk] == 0)
+        memset(buf + i, 0, chunk);
+        else if(chunk == BLOCK_SIZE){
+            //--EXTEND THE READ OVER THE WHOLE BLOCKS THAT FOLLOW ON DISK--
+            int n = 1;
+            while(lblk + n < MAX_FILE_BLOCKS && (n + 1) * BLOCK_SIZE <= length - i && of->blockmap[lblk + n] == of->blockmap[lblk] + n
+                  && of->blockmap[(lblk + n) / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] != COMPRESSED_GROUP){
+                n++;
+            }
+            cacheread(of->blockmap[lblk], n, buf + i, behind);
+            chunk = n * BLOCK_SIZE;
+        }
+        else{
+            cacheread(of->blockmap[lblk], 1, data_block, behind && position + chunk == BLOCK_SIZE);
+            memcpy(buf + i, data_block + position, chunk);
+        }
+        i += chunk;
+    }
+    scratchput(buffer);
+    //--READ AHEAD FOR A SEQUENTIAL READER, OR FOR ONE THAT GOES ON WHERE IT STOPPED--
+    int sequential = __atomic_exchange_n(&of->ra_next, rw_ptr + i, __ATOMIC_RELAXED) == rw_ptr;
+    if(i > 0 && advice == SFS_FADV_SEQUENTIAL)
+    readahead(of, (rw_ptr + i) / BLOCK_SIZE, READAHEAD_SEQ_BLOCKS);
+    else if(i > 0 && advice == SFS_FADV_NORMAL && sequential)
+    readahead(of, (rw_ptr + i) / BLOCK_SIZE, READAHEAD_BLOCKS);
+    return i;
+}
+
+int sfs_fread(int fileID, char* buf, int length){
+    long long start = tracestart();
+    if(length < 0)
+    return -1;
+    if(length > MAX_FILE_BLOCKS * BLOCK_SIZE)
+    length = MAX_FILE_BLOCKS * BLOCK_SIZE;
+    int rw_ptr;
+    struct open_file* of = filebegin(fileID, 0, length, &rw_ptr);
+    if(of == NULL)
+    return -1;
+    if(length > MAX_FILE_BLOCKS * BLOCK_SIZE - rw_ptr)
+    length = MAX_FILE_BLOCKS * BLOCK_SIZE - rw_ptr;
+    __atomic_add_fetch(&fs->heat[of->inode_num], 1, __ATOMIC_RELAXED);
+    int got = fileread(of, rw_ptr, buf, length);
+    fileend(fileID, of, rw_ptr + length, rw_ptr + got);
+    traceop(start, "read %d %d", fileID, got);
+    return got;
+}
+
+int sfs_fseek(int fileID, int loc){
+    long long start = tracestart();
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    struct open_file* of = fdtget(fileID);
+    if(of == NULL || loc < 0 || loc > MAX_FILE_BLOCKS * BLOCK_SIZE){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        return -1;
+    }
+    __atomic_store_n(&fs->fdt[fileID].rw_ptr, loc, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    traceop(start, "seek %d %d", fileID, loc);
+    return 0;
+}
+
+/* --COMPRESSION ATTRIBUTE--
+
+TURNS COMPRESSION OF THE FILE OPEN AS fileID ON (enable != 0) OR OFF. IT APPLIES TO
+GROUPS WRITTEN FROM NOW ON, GROUPS ALREADY ON DISK STAY AS THEY ARE UNTIL REWRITTEN
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_fcompress(int fileID, int enable){
+    jnl_begin();
+    struct open_file* of = filebegin(fileID, 1, 0, NULL);
+    if(of == NULL){
+        jnl_end();
+        return -1;
+    }
+    if(enable)
+    of->node.flags |= INODE_COMPRESS;
+    else
+    of->node.flags &= ~INODE_COMPRESS;
+    putinode(of->inode_num, &of->node);
+    fileend(fileID, of, 0, 0);
+    jnl_end();
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+ZEROES len BYTES AT position OF LOGICAL BLOCK lblk OF AN OPEN FILE, WHICH HAS A PLAIN DATA
+BLOCK. THE BLOCK IS RELEASED IF NOTHING BUT ZEROS IS LEFT IN IT, AND COPIED FIRST IF IT IS
+SHARED. CALLER HOLDS THE FILE'S I-NODE LOCK FOR WRITING AND IS INSIDE jnl_begin
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int blockclear(struct open_file* of, int lblk, int position, int len){
+    char* data_block = scratchget(BLOCK_SIZE);
+    int block = of->blockmap[lblk];
+    int res = 0;
+    if(data_block == NULL)
+    return -1;
+    read_blocks(block, 1, data_block);
+    memset(data_block + position, 0, len);
+    if(iszero(data_block, BLOCK_SIZE)){
+        res = bmapset(of, lblk, 0);
+        if(res == 0)
+        blockref(block, -1);
+    }
+    else{
+        if((of->node.flags & INODE_SHARED) || fs->log_on)
+        block = bmapcow(of, lblk);
+        if(block == -1)
+        res = -1;
+        else
+        cachewrite(block, 1, data_block);
+    }
+    scratchput(data_block);
+    return res;
+}
+
+/* --TRUNCATE--
+
+SETS THE SIZE OF THE FILE OPEN AS fileID. SHRINKING RELEASES ONLY THE BLOCKS PAST THE NEW
+END AND ZEROES THE REST OF THE LAST BLOCK, GROWING LEAVES A HOLE THAT READS AS ZEROS. A
+CALL THAT FAILS LEAVES THE SIZE ALONE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_ftruncate(int fileID, int size){
+    if(size < 0 || size > MAX_FILE_BLOCKS * BLOCK_SIZE)
+    return -1;
+    jnl_begin();
+    struct open_file* of = filebegin(fileID, 1, 0, NULL);
+    if(of == NULL){
+        jnl_end();
+        return -1;
+    }
+    int res = 0;
+    int old_size = of->node.file_size;
+    if(of->node.flags & INODE_INLINE){
+        if(size <= INODE_INLINE_CAPACITY){
+            if(size < of->node.file_size)
+            memset(inlinedata(&of->node) + size, 0, INODE_INLINE_CAPACITY - size);
+        }
+        else
+        res = inlinepromote(of);
+    }
+    else if(size < of->node.file_size){
+        int keep = (size + BLOCK_SIZE - 1) / BLOCK_SIZE; //blocks that stay
+        int g = size / GROUP_SIZE;
+        int* map = of->blockmap;
+        //--THE LAST GROUP IS COMPRESSED, REWRITE IT WITHOUT THE BYTES PAST THE END--
+        if(size % GROUP_SIZE != 0 && map[g * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+            char* zero = scratchzero(BLOCK_SIZE);
+            int offset = size - g * GROUP_SIZE;
+            of->node.file_size = size;
+            res = zero == NULL ? -1 : groupwrite(of, g, zero, offset, (BLOCK_SIZE - offset % BLOCK_SIZE) % BLOCK_SIZE);
+            scratchput(zero);
+            keep = (g + 1) * GROUP_BLOCKS;
+        }
+        //--THE LAST BLOCK IS PARTLY PAST THE END, ZERO THAT PART--
+        else if(size % BLOCK_SIZE != 0 && map[keep - 1] > 0)
+        res = blockclear(of, keep - 1, size % BLOCK_SIZE, BLOCK_SIZE - size % BLOCK_SIZE);
+        //--RELEASE EVERYTHING PAST THE END, A WHOLE INDIRECT BLOCK AT ONCE--
+        int direct_end = keep < NUM_DIRECT_POINTERS_PER_INODE ? NUM_DIRECT_POINTERS_PER_INODE : MAX_FILE_BLOCKS;
+        for(int lblk = keep; res == 0 && lblk < direct_end; lblk++){
+            int old = map[lblk];
+            if(old == 0)
+            continue;
+            res = bmapset(of, lblk, 0);
+            if(res == 0 && old > 0)
+            blockref(old, -1);
+        }
+        if(res == 0 && keep <= NUM_DIRECT_POINTERS_PER_INODE && of->node.indirect_ptr != 0){
+            indirectunref(of->node.indirect_ptr);
+            of->node.indirect_ptr = 0;
+            memset(map + NUM_DIRECT_POINTERS_PER_INODE, 0, (MAX_FILE_BLOCKS - NUM_DIRECT_POINTERS_PER_INODE) * sizeof(int));
+        }
+        pthread_mutex_lock(&of->cache_lock);
+        of->cache_group = -1;
+        pthread_mutex_unlock(&of->cache_lock);
+    }
+    //--groupwrite TRIMS THE LAST GROUP BY THE NEW SIZE, A FAILED CALL PUTS THE OLD ONE BACK--
+    if(res == 0){
+        of->node.file_size = size;
+        putinode(of->inode_num, &of->node);
+    }
+    else
+    of->node.file_size = old_size;
+    fileend(fileID, of, 0, 0);
+    jnl_end();
+    return res == 0 ? 0 : -1;
+}
+
+/* --PREALLOCATE--
+
+RESERVES DISK BLOCKS FOR EVERY HOLE IN [offset, offset + len) OF THE FILE OPEN AS fileID,
+IN AS FEW CONTIGUOUS RUNS AS POSSIBLE, AND GROWS THE FILE TO offset + len IF IT IS
+SHORTER. RESERVED BLOCKS ARE ZEROED. COMPRESSED FILES ALWAYS WRITE NEW BLOCKS, SO FOR
+THEM ONLY THE SIZE CHANGES. A CALL THAT FAILS GIVES BACK THE BLOCKS IT RESERVED AND
+LEAVES THE SIZE ALONE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE OR IF THE DISK FILLS UP
+
+*/
+
+int sfs_fallocate(int fileID, int offset, int len){
+    if(offset < 0 || len <= 0 || len > MAX_FILE_BLOCKS * BLOCK_SIZE - offset)
+    return -1;
+    jnl_begin();
+    struct open_file* of = filebegin(fileID, 1, 0, NULL);
+    if(of == NULL){
+        jnl_end();
+        return -1;
+    }
+    int res = 0;
+    if((of->node.flags & INODE_INLINE) && offset + len > INODE_INLINE_CAPACITY)
+    res = inlinepromote(of);
+    if(res == 0 && !(of->node.flags & (INODE_INLINE | INODE_COMPRESS))){
+        int lblk = offset / BLOCK_SIZE;
+        int last = (offset + len - 1) / BLOCK_SIZE;
+        char* zero = scratchzero(ZERO_CHUNK_BLOCKS * BLOCK_SIZE);
+        //--THE POINTERS OF THE RANGE BEFORE THE CALL, TO UNDO IT IF THE DISK FILLS UP--
+        int* before = scratchget((last - lblk + 1) * sizeof(int));
+        int indirect = of->node.indirect_ptr;
+        if(zero == NULL || before == NULL)
+        res = -1;
+        else
+        memcpy(before, of->blockmap + lblk, (last - lblk + 1) * sizeof(int));
+        while(res == 0 && lblk <= last){
+            int g = lblk / GROUP_BLOCKS;
+            if(of->blockmap[lblk] != 0 || of->blockmap[g * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+                lblk++;
+                continue;
+            }
+            //--ONE RUN FOR THE WHOLE HOLE IF THE DISK HAS ONE--
+            int want = 0;
+            while(lblk + want <= last && of->blockmap[lblk + want] == 0){
+                want++;
+            }
+            int run;
+            int first = allocrun(of->inode_num, want, &run);
+            if(first == -1){
+                res = -1;
+                break;
+            }
+            for(int k = 0; k < run; k += ZERO_CHUNK_BLOCKS){
+                cachewrite(first + k, run - k < ZERO_CHUNK_BLOCKS ? run - k : ZERO_CHUNK_BLOCKS, zero);
+            }
+            for(int k = 0; k < run; k++){
+                if(res == 0)
+                res = bmapset(of, lblk + k, first + k);
+                if(res != 0)
+                blockref(first + k, -1);
+            }
+            printf("Blocks %d-%d reserved for file %d\n", first, first + run - 1, of->inode_num);
+            lblk += run;
+        }
+        //--THE DISK FILLED UP, GIVE BACK WHAT THIS CALL RESERVED--
+        if(res != 0 && before != NULL){
+            for(int k = offset / BLOCK_SIZE; k <= last; k++){
+                int block = of->blockmap[k];
+                if(block > 0 && before[k - offset / BLOCK_SIZE] == 0 && bmapset(of, k, 0) == 0)
+                blockref(block, -1);
+            }
+            if(indirect == 0 && of->node.indirect_ptr != 0){
+                indirectunref(of->node.indirect_ptr);
+                of->node.indirect_ptr = 0;
+            }
+        }
+        scratchput(zero);
+        scratchput(before);
+    }
+    if(res == 0 && offset + len > of->node.file_size)
+    of->node.file_size = offset + len;
+    putinode(of->inode_num, &of->node);
+    fileend(fileID, of, 0, 0);
+    jnl_end();
+    return res == 0 ? 0 : -1;
+}
+
+/* --PUNCH HOLE--
+
+TURNS [offset, offset + len) OF THE FILE OPEN AS fileID INTO A HOLE: WHOLE BLOCKS IN THE
+RANGE ARE RELEASED (THE INDIRECT BLOCK TOO IF IT IS LEFT EMPTY) AND THE PARTS OF BLOCKS AT
+ITS EDGES ARE ZEROED. A COMPRESSED GROUP IS REWRITTEN WITHOUT THE RANGE. THE SIZE OF THE
+FILE DOES NOT CHANGE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_punch_hole(int fileID, int offset, int len){
+    if(offset < 0 || len <= 0)
+    return -1;
+    jnl_begin();
+    struct open_file* of = filebegin(fileID, 1, 0, NULL);
+    if(of == NULL){
+        jnl_end();
+        return -1;
+    }
+    int res = 0;
+    //--NOTHING IS STORED PAST THE END OF THE FILE--
+    int end = len > of->node.file_size - offset ? of->node.file_size : offset + len;
+    if(end > offset && (of->node.flags & INODE_INLINE))
+    memset(inlinedata(&of->node) + offset, 0, end - offset);
+    else if(end > offset){
+        char* zero = scratchzero(GROUP_SIZE);
+        int* map = of->blockmap;
+        if(zero == NULL)
+        res = -1;
+        int pos = offset;
+        while(res == 0 && pos < end){
+            int lblk = pos / BLOCK_SIZE;
+            int position = pos % BLOCK_SIZE;
+            int chunk = BLOCK_SIZE - position;
+            if(chunk > end - pos)
+            chunk = end - pos;
+            int g = lblk / GROUP_BLOCKS;
+            if(map[g * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP){
+                int goff = pos - g * GROUP_SIZE;
+                int span = GROUP_SIZE - goff;
+                if(span > end - pos)
+                span = end - pos;
+                res = groupwrite(of, g, zero, goff, span);
+                pos += span;
+                continue;
+            }
+            int old = map[lblk];
+            if(old > 0 && chunk == BLOCK_SIZE){
+                res = bmapset(of, lblk, 0);
+                if(res == 0)
+                blockref(old, -1);
+            }
+            else if(old > 0)
+            res = blockclear(of, lblk, position, chunk);
+            pos += chunk;
+        }
+        scratchput(zero);
+        //--NO BLOCK LEFT BELOW THE INDIRECT BLOCK, RELEASE IT--
+        if(res == 0 && of->node.indirect_ptr != 0){
+            int lblk = NUM_DIRECT_POINTERS_PER_INODE;
+            while(lblk < MAX_FILE_BLOCKS && map[lblk] == 0){
+                lblk++;
+            }
+            if(lblk == MAX_FILE_BLOCKS){
+                indirectunref(of->node.indirect_ptr);
+                of->node.indirect_ptr = 0;
+            }
+        }
+        pthread_mutex_lock(&of->cache_lock);
+        of->cache_group = -1;
+        pthread_mutex_unlock(&of->cache_lock);
+    }
+    putinode(of->inode_num, &of->node);
+    fileend(fileID, of, 0, 0);
+    jnl_end();
+    return res == 0 ? 0 : -1;
+}
+
+/* --HELPER FUNCTION--
+
+POINTS LOGICAL BLOCK dlblk OF dst AT THE BLOCK (OR HOLE) BEHIND LOGICAL BLOCK slblk OF src
+AND MARKS BOTH FILES INODE_SHARED, SO A LATER WRITE TO EITHER COPIES THE BLOCK FIRST.
+CALLER HOLDS BOTH FILES' I-NODE LOCKS FOR WRITING AND IS INSIDE jnl_begin
+RETURNS 1 IF THE BLOCK IS SHARED,
+RETURNS 0 IF IT HAS TO BE COPIED (INLINE SOURCE, COMPRESSED DATA, REFERENCE COUNT FULL),
+RETURNS -1 ON FAILURE
+
+*/
+
+static int blockshare(struct open_file* src, int slblk, struct open_file* dst, int dlblk){
+    if(slblk >= MAX_FILE_BLOCKS || dlblk >= MAX_FILE_BLOCKS || (src->node.flags & INODE_INLINE) || (dst->node.flags & INODE_COMPRESS))
+    return 0;
+    if((dst->node.flags & INODE_INLINE) && inlinepromote(dst) != 0)
+    return -1;
+    if(src->blockmap[slblk / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP || dst->blockmap[dlblk / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP)
+    return 0;
+    int block = src->blockmap[slblk];
+    int old = dst->blockmap[dlblk];
+    if(block != old){
+        if(block > 0 && blockref(block, 1) == -1)
+        return 0;
+        if(block > 0){
+            src->node.flags |= INODE_SHARED;
+            dst->node.flags |= INODE_SHARED;
+        }
+        if(bmapset(dst, dlblk, block) != 0){
+            if(block > 0)
+            blockref(block, -1);
+            return -1;
+        }
+        if(old > 0)
+        blockref(old, -1);
+    }
+    if(dst->node.file_size < (dlblk + 1) * BLOCK_SIZE)
+    dst->node.file_size = (dlblk + 1) * BLOCK_SIZE;
+    return 1;
+}
+
+/* --COPY RANGE--
+
+COPIES len BYTES AT src_off OF THE FILE OPEN AS src_fd TO dst_off OF THE FILE OPEN AS
+dst_fd WITHOUT GOING THROUGH A CALLER BUFFER. WHOLE BLOCKS AT THE SAME POSITION IN A
+BLOCK ON BOTH SIDES ARE SHARED (COPY ON WRITE, LIKE sfs_clone) AND HOLES STAY HOLES, THE
+REST IS MOVED COPY_CHUNK_BLOCKS AT A TIME. THE COPY STOPS AT THE END OF THE SOURCE AND
+THE FILE POINTERS DO NOT MOVE. OVERLAPPING RANGES OF ONE FILE AND RANGES THAT END PAST
+THE MAXIMUM FILE SIZE ARE REFUSED
+RETURNS NUMBER OF BYTES COPIED OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_copy_range(int src_fd, int src_off, int dst_fd, int dst_off, int len){
+    if(src_off < 0 || dst_off < 0 || len < 0)
+    return -1;
+    if(src_off > MAX_FILE_BLOCKS * BLOCK_SIZE - len || dst_off > MAX_FILE_BLOCKS * BLOCK_SIZE - len)
+    return -1;
+    jnl_begin();
+    pthread_rwlock_rdlock(&fs->io_lock);
+    struct open_file* src = fdtpin(src_fd, 1, 0, NULL);
+    struct open_file* dst = fdtpin(dst_fd, 1, 0, NULL);
+    if(src == NULL || dst == NULL || (src == dst && src_off < dst_off + len && dst_off < src_off + len)){
+        if(src != NULL)
+        ofput(src);
+        if(dst != NULL)
+        ofput(dst);
+        pthread_rwlock_unlock(&fs->io_lock);
+        jnl_end();
+        return -1;
+    }
+    //--LOWER I-NODE FIRST, SO TWO COPIES IN OPPOSITE DIRECTIONS CANNOT DEADLOCK--
+    struct open_file* first = src->inode_num < dst->inode_num ? src : dst;
+    struct open_file* second = first == src ? dst : src;
+    pthread_rwlock_wrlock(&fs->inode_locks[first->inode_num]);
+    if(second != first)
+    pthread_rwlock_wrlock(&fs->inode_locks[second->inode_num]);
+
+    if(len > src->node.file_size - src_off)
+    len = src->node.file_size - src_off > 0 ? src->node.file_size - src_off : 0;
+    //--EITHER FILE MAY HAVE BEEN REMOVED SINCE IT WAS PINNED (SEE filebegin)--
+    int gone = __atomic_load_n(&src->unlinked, __ATOMIC_ACQUIRE) || __atomic_load_n(&dst->unlinked, __ATOMIC_ACQUIRE);
+    char* bounce = !gone ? scratchget(COPY_CHUNK_BLOCKS * BLOCK_SIZE) : NULL;
+    int done = 0;
+    while(bounce != NULL && done < len){
+        int from = src_off + done;
+        int to = dst_off + done;
+        if(from % BLOCK_SIZE == 0 && to % BLOCK_SIZE == 0 && len - done >= BLOCK_SIZE){
+            int res = blockshare(src, from / BLOCK_SIZE, dst, to / BLOCK_SIZE);
+            if(res == -1)
+            break;
+            if(res == 1){
+                done += BLOCK_SIZE;
+                continue;
+            }
+        }
+        //--SAME POSITION IN A BLOCK ON BOTH SIDES, COPY UP TO THE NEXT BOUNDARY AND SHARE FROM THERE--
+        int n = len - done;
+        if(from % BLOCK_SIZE == to % BLOCK_SIZE && n > BLOCK_SIZE - from % BLOCK_SIZE)
+        n = BLOCK_SIZE - from % BLOCK_SIZE;
+        else if(n > COPY_CHUNK_BLOCKS * BLOCK_SIZE)
+        n = COPY_CHUNK_BLOCKS * BLOCK_SIZE;
+        int got = fileread(src, from, bounce, n);
+        int put = got > 0 ? filewrite(dst, to, bounce, got) : 0;
+        done += put;
+        if(put < n)
+        break;
+    }
+    if(bounce != NULL){
+        putinode(dst->inode_num, &dst->node);
+        if(src != dst)
+        putinode(src->inode_num, &src->node);
+    }
+    scratchput(bounce);
+    if(done > 0)
+    printf("%d bytes of file %d copied to file %d\n", done, src->inode_num, dst->inode_num);
+
+    if(second != first)
+    pthread_rwlock_unlock(&fs->inode_locks[second->inode_num]);
+    pthread_rwlock_unlock(&fs->inode_locks[first->inode_num]);
+    ofput(src);
+    ofput(dst);
+    pthread_rwlock_unlock(&fs->io_lock);
+    jnl_end();
+    return bounce == NULL ? -1 : done;
+}
+
+int sfs_remove(char* file){
+    long long start = tracestart();
+    int dir_block, entry;
+    jnl_begin();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    int inode_index = dirlookup(file, &dir_block, &entry);
+    if(inode_index == -1){
+        pthread_rwlock_unlock(&fs->dir_lock);
+        jnl_end();
+        return -1;
+    }
+    //--NEW LOCK-FREE LOOKUPS MISS FROM HERE ON--
+    dcache_set(file, -1);
+
+    //--DESCRIPTORS STILL HELD ON THE FILE FAIL FROM NOW ON UNTIL THEY ARE CLOSED--
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    struct open_file* of = fs->open_files[inode_index];
+    if(of != NULL){
+        __atomic_store_n(&of->unlinked, 1, __ATOMIC_RELEASE);
+        fs->open_files[inode_index] = NULL;
+    }
+    pthread_rwlock_unlock(&fs->fdt_lock);
+
+    //--DIRECTORY ENTRY, I-NODE AND BYTEMAP ARE UPDATED IN ONE TRANSACTION--
+    pthread_rwlock_wrlock(&fs->inode_locks[inode_index]);
+    struct dir_entry cleared;
+    memset(&cleared, 0, sizeof(cleared));
+    jnl_patch(dir_block, entry * sizeof(struct dir_entry), &cleared, sizeof(cleared));
+    releaseinode(inode_index);
+    pthread_rwlock_unlock(&fs->inode_locks[inode_index]);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    printf("File %s was removed\n", file);
+    traceop(start, "remove %s", file);
+    return 0;
+}
+
+/* --BATCH OPERATIONS--
+
+sfs_create_many, sfs_stat_many AND sfs_remove_many WORK ON A WHOLE ARRAY OF NAMES UNDER
+ONE DIRECTORY LOCK AND AS ONE JOURNAL OPERATION. THE DIRECTORY IS READ ONCE INTO A
+dir_image WITH A HASH INDEX OF ITS NAMES, THE I-NODE TABLE IS READ ONCE, AND EVERY
+DIRECTORY BLOCK THAT CHANGED IS WRITTEN BACK ONCE. I-NODE AND BYTEMAP UPDATES ARE
+ABSORBED BY THE JOURNAL, SO EACH OF THOSE BLOCKS IS ALSO WRITTEN ONCE PER COMMIT.
+A BATCH THAT CHANGES MORE BLOCKS THAN A TRANSACTION HOLDS RUNS ALONE AND IS COMMITTED
+IN PARTS, BETWEEN TWO FILES (SEE dirimage_split).
+
+*/
+
+struct dir_image {
+    struct inode directory;
+    int directory_dirty;
+    struct dir_entry* entries; //every directory block, back to back
+    unsigned char dirty[NUM_DIRECT_POINTERS_PER_INODE];
+    short* index; //DIR_INDEX_SIZE entries, directory slot + 1, 0 IF EMPTY
+    int next_free; //no free slot below this one
+};
+
+/* --HELPER FUNCTION--
+
+ALLOCATES A DIRECTORY IMAGE TOGETHER WITH ITS BLOCKS AND INDEX, FREED WITH A SINGLE free
+RETURNS THE IMAGE OR,
+RETURNS NULL ON FAILURE
+
+*/
+
+static struct dir_image* dirimage_alloc(void){
+    struct dir_image* img = malloc(sizeof(struct dir_image) + NUM_DIRECT_POINTERS_PER_INODE * BLOCK_SIZE + DIR_INDEX_SIZE * sizeof(short));
+    if(img == NULL)
+    return NULL;
+    img->entries = (struct dir_entry*)(img + 1);
+    img->index = (short*)((char*)img->entries + NUM_DIRECT_POINTERS_PER_INODE * BLOCK_SIZE);
+    return img;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS DIRECTORY SLOT slot TO THE NAME INDEX OF A DIRECTORY IMAGE
+
+*/
+
+static void dirimage_index(struct dir_image* img, const char* name, int slot){
+    unsigned int h = namehash(name) & (DIR_INDEX_SIZE - 1);
+    while(img->index[h] != 0){
+        h = (h + 1) & (DIR_INDEX_SIZE - 1);
+    }
+    img->index[h] = slot + 1;
+}
+
+/* --HELPER FUNCTION--
+
+READS THE WHOLE DIRECTORY INTO img AND INDEXES IT, CALLER HOLDS dir_lock
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int dirimage_load(struct dir_image* img){
+    img->directory_dirty = 0;
+    memset(img->entries, 0, NUM_DIRECT_POINTERS_PER_INODE * BLOCK_SIZE);
+    memset(img->dirty, 0, sizeof(img->dirty));
+    memset(img->index, 0, DIR_INDEX_SIZE * sizeof(short));
+    img->next_free = 0;
+    if(readinode(0, &img->directory) != 0)
+    return 1;
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(img->directory.ptrs[i] == 0)
+        continue;
+        if(jnl_read(img->directory.ptrs[i], img->entries + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK) != 1)
+        return 1;
+        for(int k = 0; k < NUM_DIRECTORY_ENTRIES_PER_BLOCK; k++){
+            if(img->entries[i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k].file_ptr != 0)
+            dirimage_index(img, img->entries[i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k].file_name, i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k);
+        }
+    }
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+LOOKS UP name IN A DIRECTORY IMAGE
+RETURNS DIRECTORY SLOT OR,
+RETURNS -1 IF THE FILE DOES NOT EXIST
+
+*/
+
+static int dirimage_find(struct dir_image* img, const char* name){
+    unsigned int h = namehash(name) & (DIR_INDEX_SIZE - 1);
+    while(img->index[h] != 0){
+        int slot = img->index[h] - 1;
+        struct dir_entry* e = &img->entries[slot];
+        //--ENTRIES REMOVED IN THIS BATCH STAY IN THE INDEX BUT ARE EMPTY--
+        if(e->file_ptr != 0 && strcmp(e->file_name, name) == 0)
+        return slot;
+        h = (h + 1) & (DIR_INDEX_SIZE - 1);
+    }
+    return -1;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS AN ENTRY TO A DIRECTORY IMAGE, GROWING THE DIRECTORY IF IT IS FULL
+RETURNS DIRECTORY SLOT OR,
+RETURNS -1 IF THE DIRECTORY IS FULL
+
+*/
+
+static int dirimage_add(struct dir_image* img, const char* name, int inode_index){
+    int end = NUM_DIRECT_POINTERS_PER_INODE * NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+    for(int slot = img->next_free; slot < end; slot++){
+        int i = slot / NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+        int k = slot % NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+        if(img->directory.ptrs[i] == 0){
+            //--CREATE NEW DIRECTORY PAGE--
+            int freeblock = allocblock(0);
+            if(freeblock == -1)
+            return -1;
+            memset(img->entries + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK, 0, BLOCK_SIZE);
+            img->directory.ptrs[i] = freeblock;
+            img->directory.file_size += BLOCK_SIZE;
+            img->directory_dirty = 1;
+            img->dirty[i] = 1;
+        }
+        struct dir_entry* e = &img->entries[i * NUM_DIRECTORY_ENTRIES_PER_BLOCK + k];
+        if(e->file_ptr == 0){
+            strcpy(e->file_name, name);
+            e->file_ptr = inode_index;
+            img->dirty[i] = 1;
+            img->next_free = slot + 1;
+            dirimage_index(img, name, slot);
+            return slot;
+        }
+    }
+    img->next_free = end;
+    return -1;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES EVERY CHANGED BLOCK OF A DIRECTORY IMAGE BACK, ONCE EACH
+
+*/
+
+static void dirimage_flush(struct dir_image* img){
+    for(int i = 0; i < NUM_DIRECT_POINTERS_PER_INODE; i++){
+        if(img->dirty[i])
+        jnl_write(img->directory.ptrs[i], img->entries + i * NUM_DIRECTORY_ENTRIES_PER_BLOCK);
+        img->dirty[i] = 0;
+    }
+    if(img->directory_dirty)
+    putinode(0, &img->directory);
+    img->directory_dirty = 0;
+}
+
+/* --HELPER FUNCTION--
+
+COMMITS WHAT A BATCH HAS DONE SO FAR, DIRECTORY INCLUDED, ONCE THE RUNNING TRANSACTION
+IS NEARLY FULL, SO IT IS NEVER SPLIT IN THE MIDDLE OF A FILE. CALLED BETWEEN TWO FILES
+
+*/
+
+static void dirimage_split(struct dir_image* img){
+    if(!jnl_full())
+    return;
+    dirimage_flush(img);
+    jnl_split();
+}
+
+/* --BATCH CREATE--
+
+CREATES EVERY FILE IN names THAT DOES NOT EXIST YET
+status[i] IS SET TO THE I-NODE OF names[i] (NEW OR EXISTING) OR -1 IF IT COULD NOT BE CREATED
+RETURNS NUMBER OF NAMES WITH status >= 0 OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_create_many(char** names, int n, int* status){
+    if(names == NULL || status == NULL || n < 0)
+    return -1;
+    struct dir_image* img = dirimage_alloc();
+    struct inode* table = scratchget(NUM_INODE_BLOCKS * BLOCK_SIZE);
+    if(img == NULL || table == NULL){
+        free(img);
+        scratchput(table);
+        return -1;
+    }
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    if(dirimage_load(img) != 0){
+        pthread_rwlock_unlock(&fs->dir_lock);
+        jnl_end();
+        free(img);
+        scratchput(table);
+        return -1;
+    }
+
+    int ok = 0;
+    int next[NUM_AGS]; //no free i-node of group g below next[g], see agpick
+    for(int g = 0; g < NUM_AGS; g++){
+        next[g] = g * AG_INODES;
+    }
+    for(int j = 0; j < n; j++){
+        status[j] = -1;
+    }
+    pthread_mutex_lock(&fs->alloc_lock);
+    jnl_read_range(1, NUM_INODE_BLOCKS, table);
+    for(int j = 0; j < n; j++){
+        if(names[j] == NULL || strlen(names[j]) >= MAX_FILE_NAME_LENGTH)
+        continue;
+        dirimage_split(img);
+        int slot = dirimage_find(img, names[j]);
+        if(slot != -1){
+            status[j] = img->entries[slot].file_ptr;
+            ok++;
+            continue;
+        }
+        //--CLAIM AN INACTIVE I-NODE OF THE IN-MEMORY TABLE, IN THE GROUP allocinode WOULD PICK--
+        int inode_num = agpick(table, next);
+        if(inode_num == -1)
+        break;
+        struct inode* node = &table[inode_num];
+        memset(node, 0, sizeof(struct inode));
+        node->active = 1;
+        node->flags = INODE_INLINE;
+        //--alloc_lock IS NOT RECURSIVE AND THE DIRECTORY MAY NEED A NEW BLOCK--
+        pthread_mutex_unlock(&fs->alloc_lock);
+        slot = dirimage_add(img, names[j], inode_num);
+        pthread_mutex_lock(&fs->alloc_lock);
+        if(slot == -1){
+            node->active = 0;
+            break;
+        }
+        putinode(inode_num, node);
+        fs->free_inodes--;
+        dcache_set(names[j], inode_num);
+        status[j] = inode_num;
+        ok++;
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+    dirimage_flush(img);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    free(img);
+    scratchput(table);
+    return ok;
+}
+
+/* --BATCH STAT--
+
+LOOKS UP EVERY NAME OF names, out[i] GETS ITS NAME, I-NODE AND SIZE (I-NODE -1 IF MISSING)
+RETURNS NUMBER OF FILES FOUND OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_stat_many(char** names, int n, struct sfs_dirent* out){
+    if(names == NULL || out == NULL || n < 0)
+    return -1;
+    struct dir_image* img = dirimage_alloc();
+    struct inode* table = scratchget(NUM_INODE_BLOCKS * BLOCK_SIZE);
+    if(img == NULL || table == NULL){
+        free(img);
+        scratchput(table);
+        return -1;
+    }
+    pthread_rwlock_rdlock(&fs->dir_lock);
+    if(dirimage_load(img) != 0 || jnl_read_range(1, NUM_INODE_BLOCKS, table) != NUM_INODE_BLOCKS){
+        pthread_rwlock_unlock(&fs->dir_lock);
+        free(img);
+        scratchput(table);
+        return -1;
+    }
+    int found = 0;
+    for(int j = 0; j < n; j++){
+        memset(&out[j], 0, sizeof(struct sfs_dirent));
+        out[j].inode = -1;
+        out[j].size = -1;
+        if(names[j] == NULL)
+        continue;
+        strncpy(out[j].name, names[j], MAXFILENAME - 1);
+        int slot = strlen(names[j]) < MAX_FILE_NAME_LENGTH ? dirimage_find(img, names[j]) : -1;
+        if(slot == -1)
+        continue;
+        int inode_index = img->entries[slot].file_ptr;
+        out[j].inode = inode_index;
+        out[j].size = table[inode_index].file_size;
+        found++;
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    free(img);
+    scratchput(table);
+    return found;
+}
+
+/* --BATCH REMOVE--
+
+REMOVES EVERY FILE OF names
+status[i] IS SET TO 0 IF names[i] WAS REMOVED OR -1 IF IT DID NOT EXIST
+RETURNS NUMBER OF FILES REMOVED OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_remove_many(char** names, int n, int* status){
+    if(names == NULL || status == NULL || n < 0)
+    return -1;
+    struct dir_image* img = dirimage_alloc();
+    if(img == NULL)
+    return -1;
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    if(dirimage_load(img) != 0){
+        pthread_rwlock_unlock(&fs->dir_lock);
+        jnl_end();
+        free(img);
+        return -1;
+    }
+    int removed = 0;
+    for(int j = 0; j < n; j++){
+        status[j] = -1;
+        int slot = names[j] != NULL && strlen(names[j]) < MAX_FILE_NAME_LENGTH ? dirimage_find(img, names[j]) : -1;
+        if(slot == -1)
+        continue;
+        dirimage_split(img);
+        int i = slot / NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+        struct dir_entry* e = &img->entries[slot];
+        int inode_index = e->file_ptr;
+        //--SAME ORDER AS sfs_remove: CACHE, DESCRIPTORS, THEN THE I-NODE--
+        dcache_set(names[j], -1);
+        pthread_rwlock_wrlock(&fs->fdt_lock);
+        struct open_file* of = fs->open_files[inode_index];
+        if(of != NULL){
+            __atomic_store_n(&of->unlinked, 1, __ATOMIC_RELEASE);
+            fs->open_files[inode_index] = NULL;
+        }
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        pthread_rwlock_wrlock(&fs->inode_locks[inode_index]);
+        releaseinode(inode_index);
+        pthread_rwlock_unlock(&fs->inode_locks[inode_index]);
+        memset(e, 0, sizeof(struct dir_entry));
+        img->dirty[i] = 1;
+        status[j] = 0;
+        removed++;
+    }
+    dirimage_flush(img);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    free(img);
+    return removed;
+}
+
+/* --SNAPSHOTS AND CLONES--
+
+sfs_snapshot_create COPIES THE DIRECTORY AND I-NODES INTO A CATALOG, sfs_clone COPIES ONE
+I-NODE. NEITHER COPIES DATA: THE COPIES TAKE A REFERENCE ON THE BLOCKS, AND THE FIRST WRITE
+TO A SHARED BLOCK COPIES IT (SEE bmapcow). A SNAPSHOT IS READ NEXT TO THE LIVE FILE
+SYSTEM: sfs_snapshot_open GIVES A READ-ONLY DESCRIPTOR ON ONE OF ITS FILES AND
+sfs_snapshot_opendir A CURSOR OVER ITS CATALOG, WHILE THE LIVE FILES STAY WRITABLE.
+
+*/
+
+/* --HELPER FUNCTION--
+
+READS THE HEADER AND CATALOG OF SNAPSHOT id
+RETURNS THE CATALOG (FREED BY THE CALLER) OR,
+RETURNS NULL IF THE SNAPSHOT DOES NOT EXIST
+
+*/
+
+static struct snapshot_entry* snapload(int id, struct snapshot_header* hdr){
+    if(id < 0 || id >= SFS_MAX_SNAPSHOTS)
+    return NULL;
+    struct superblock* sb = malloc(BLOCK_SIZE);
+    if(sb == NULL || jnl_read(0, sb) != 1){
+        free(sb);
+        return NULL;
+    }
+    int header = sb->snapshots[id];
+    free(sb);
+    if(header == 0 || read_blocks(header, 1, hdr) != 1)
+    return NULL;
+    if(hdr->nblocks < 0 || hdr->nblocks > SNAPSHOT_MAX_BLOCKS || hdr->count < 0 || hdr->count > hdr->nblocks * BLOCK_SIZE / (int)sizeof(struct snapshot_entry))
+    return NULL;
+    for(int i = 0; i < hdr->nblocks; i++){
+        if(!validblock(hdr->blocks[i]))
+        return NULL;
+    }
+    char* catalog = malloc((hdr->nblocks + 1) * BLOCK_SIZE);
+    if(catalog == NULL)
+    return NULL;
+    for(int i = 0; i < hdr->nblocks; i++){
+        read_blocks(hdr->blocks[i], 1, catalog + i * BLOCK_SIZE);
+    }
+    return (struct snapshot_entry*) catalog;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS THE REFERENCES OF THE FIRST count FILES OF A CATALOG
+
+*/
+
+static void snaprelease(struct snapshot_entry* catalog, int count){
+    for(int k = 0; k < count; k++){
+        inoderef(&catalog[k].node, -1);
+    }
+}
+
+/* --SNAPSHOT CREATE--
+
+TAKES A POINT-IN-TIME SNAPSHOT OF EVERY FILE
+RETURNS SNAPSHOT ID OR,
+RETURNS -1 IF THERE IS NO FREE SNAPSHOT SLOT OR NOT ENOUGH SPACE FOR THE CATALOG
+
+*/
+
+int sfs_snapshot_create(void){
+    struct dir_image* img = dirimage_alloc();
+    struct inode* table = malloc(NUM_INODE_BLOCKS * BLOCK_SIZE);
+    struct superblock* sb = malloc(BLOCK_SIZE);
+    struct snapshot_header* hdr = calloc(1, BLOCK_SIZE);
+    struct snapshot_entry* catalog = calloc(1, NUM_INODES * sizeof(struct snapshot_entry) + BLOCK_SIZE);
+    int id = -1;
+    if(img == NULL || table == NULL || sb == NULL || hdr == NULL || catalog == NULL){
+        free(img);
+        free(table);
+        free(sb);
+        free(hdr);
+        free(catalog);
+        return -1;
+    }
+    //--NO CALL IS IN FLIGHT WHILE io_lock IS HELD, SO THE I-NODE TABLE IS STABLE WHILE IT IS
+    //--COPIED. EVERY FILE CHANGES ITS BYTEMAP ENTRIES AND I-NODE, SO IT RUNS ALONE (SEE sfs_journal.c)--
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    if(jnl_read(0, sb) == 1 && dirimage_load(img) == 0 && jnl_read_range(1, NUM_INODE_BLOCKS, table) == NUM_INODE_BLOCKS){
+        for(id = 0; id < SFS_MAX_SNAPSHOTS && sb->snapshots[id] != 0; id++);
+        if(id == SFS_MAX_SNAPSHOTS)
+        id = -1;
+    }
+    int count = 0;
+    int header = -1;
+    int allocated = 0;
+    if(id != -1){
+        int end = NUM_DIRECT_POINTERS_PER_INODE * NUM_DIRECTORY_ENTRIES_PER_BLOCK;
+        for(int slot = 0; slot < end; slot++){
+            struct dir_entry* e = &img->entries[slot];
+            if(img->directory.ptrs[slot / NUM_DIRECTORY_ENTRIES_PER_BLOCK] == 0 || e->file_ptr == 0)
+            continue;
+            struct inode* node = &table[e->file_ptr];
+            if(inoderef(node, 1) != 0){
+                id = -1;
+                break;
+            }
+            memcpy(catalog[count].file_name, e->file_name, MAX_FILE_NAME_LENGTH);
+            catalog[count].inode_num = e->file_ptr;
+            catalog[count].node = *node;
+            count++;
+        }
+        hdr->count = count;
+        hdr->nblocks = (count * (int)sizeof(struct snapshot_entry) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        if(id != -1)
+        header = allocblock(0);
+        for(allocated = 0; header != -1 && allocated < hdr->nblocks; allocated++){
+            hdr->blocks[allocated] = allocblock(0);
+            if(hdr->blocks[allocated] == -1)
+            break;
+        }
+        //--NOT ENOUGH SPACE, GIVE EVERYTHING BACK--
+        if(id == -1 || header == -1 || allocated < hdr->nblocks){
+            snaprelease(catalog, count);
+            for(int i = 0; i < allocated; i++){
+                blockref(hdr->blocks[i], -1);
+            }
+            if(header != -1)
+            blockref(header, -1);
+            id = -1;
+        }
+    }
+    if(id != -1){
+        for(int i = 0; i < hdr->nblocks; i++){
+            cachewrite(hdr->blocks[i], 1, (char*) catalog + i * BLOCK_SIZE);
+        }
+        cachewrite(header, 1, hdr);
+        //--THE NEXT WRITE TO ANY OF THESE FILES COPIES THE BLOCKS IT CHANGES--
+        for(int k = 0; k < count; k++){
+            struct inode* node = &catalog[k].node;
+            if(node->flags & (INODE_INLINE | INODE_SHARED))
+            continue;
+            node->flags |= INODE_SHARED;
+            putinode(catalog[k].inode_num, node);
+            if(fs->open_files[catalog[k].inode_num] != NULL)
+            fs->open_files[catalog[k].inode_num]->node.flags |= INODE_SHARED;
+        }
+        jnl_patch(0, offsetof(struct superblock, snapshots) + id * sizeof(int), &header, sizeof(int));
+        printf("Snapshot %d created with %d files\n", id, count);
+    }
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    free(img);
+    free(table);
+    free(sb);
+    free(hdr);
+    free(catalog);
+    return id;
+}
+
+/* --SNAPSHOT OPEN--
+
+OPENS FILE name AS IT WAS WHEN SNAPSHOT id WAS TAKEN. THE DESCRIPTOR IS READ-ONLY (WRITES,
+TRUNCATES AND THE OTHER CALLS THAT CHANGE A FILE FAIL ON IT) AND IS CLOSED WITH
+sfs_fclose. THE SNAPSHOT CANNOT BE DELETED WHILE IT IS OPEN
+RETURNS THE FILE DESCRIPTOR OR,
+RETURNS -1 IF THE SNAPSHOT OR THE FILE DOES NOT EXIST
+
+*/
+
+int sfs_snapshot_open(int id, char* name){
+    struct snapshot_header* hdr = malloc(BLOCK_SIZE);
+    if(hdr == NULL || !fs->mounted){
+        free(hdr);
+        return -1;
+    }
+    //--dir_lock KEEPS sfs_snapshot_delete OUT UNTIL THE DESCRIPTOR IS COUNTED--
+    pthread_rwlock_rdlock(&fs->dir_lock);
+    struct snapshot_entry* catalog = snapload(id, hdr);
+    int fd = -1;
+    for(int k = 0; catalog != NULL && k < hdr->count; k++){
+        if(strncmp(catalog[k].file_name, name, MAX_FILE_NAME_LENGTH) != 0)
+        continue;
+        pthread_rwlock_wrlock(&fs->fdt_lock);
+        fd = fdtinstall(catalog[k].inode_num, &catalog[k].node);
+        if(fd != -1){
+            fs->fdt[fd].of->snapshot = id;
+            fs->snap_open[id]++;
+        }
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        break;
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    free(hdr);
+    free(catalog);
+    return fd;
+}
+
+/* --SNAPSHOT DIRECTORY--
+
+OPENS A CURSOR OVER THE FILES OF SNAPSHOT id, READ WITH sfs_readdir_plus AND CLOSED
+WITH sfs_closedir. THE CURSOR HOLDS ITS OWN COPY OF THE CATALOG
+RETURNS THE CURSOR OR,
+RETURNS NULL IF THE SNAPSHOT DOES NOT EXIST
+
+*/
+
+SFS_DIR* sfs_snapshot_opendir(int id){
+    struct snapshot_header* hdr = malloc(BLOCK_SIZE);
+    SFS_DIR* dir = calloc(1, sizeof(SFS_DIR));
+    if(hdr != NULL && dir != NULL && fs->mounted){
+        pthread_rwlock_rdlock(&fs->dir_lock);
+        dir->catalog = snapload(id, hdr);
+        dir->count = hdr->count;
+        pthread_rwlock_unlock(&fs->dir_lock);
+    }
+    free(hdr);
+    if(dir != NULL && dir->catalog == NULL){
+        free(dir);
+        dir = NULL;
+    }
+    return dir;
+}
+
+/* --SNAPSHOT DELETE--
+
+DELETES SNAPSHOT id AND DROPS ITS REFERENCES, BLOCKS ONLY IT STILL HELD BECOME FREE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF THE SNAPSHOT DOES NOT EXIST OR ONE OF ITS FILES IS OPEN
+
+*/
+
+int sfs_snapshot_delete(int id){
+    struct snapshot_header* hdr = malloc(BLOCK_SIZE);
+    if(hdr == NULL)
+    return -1;
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    int busy = id >= 0 && id < SFS_MAX_SNAPSHOTS && fs->snap_open[id] > 0;
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    struct snapshot_entry* catalog = !busy ? snapload(id, hdr) : NULL;
+    int res = -1;
+    if(catalog != NULL){
+        int header = 0;
+        struct superblock* sb = malloc(BLOCK_SIZE);
+        if(sb != NULL && jnl_read(0, sb) == 1){
+            snaprelease(catalog, hdr->count);
+            for(int i = 0; i < hdr->nblocks; i++){
+                blockref(hdr->blocks[i], -1);
+            }
+            blockref(sb->snapshots[id], -1);
+            jnl_patch(0, offsetof(struct superblock, snapshots) + id * sizeof(int), &header, sizeof(int));
+            printf("Snapshot %d deleted\n", id);
+            res = 0;
+        }
+        free(sb);
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    free(hdr);
+    free(catalog);
+    return res;
+}
+
+/* --CLONE--
+
+CREATES dst AS A COPY OF src THAT SHARES ALL OF ITS BLOCKS
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF src DOES NOT EXIST, dst ALREADY EXISTS OR THERE IS NO SPACE LEFT
+
+*/
+
+int sfs_clone(char* src, char* dst){
+    if(strlen(src) >= MAX_FILE_NAME_LENGTH || strlen(dst) >= MAX_FILE_NAME_LENGTH)
+    return -1;
+    jnl_begin();
+    pthread_rwlock_wrlock(&fs->dir_lock);
+    int src_inode = dirlookup(src, NULL, NULL);
+    int dst_inode = -1;
+    if(src_inode != -1 && dirlookup(dst, NULL, NULL) == -1){
+        pthread_rwlock_wrlock(&fs->fdt_lock);
+        pthread_rwlock_wrlock(&fs->inode_locks[src_inode]);
+        //--AN OPEN FILE'S CACHED I-NODE IS THE MOST RECENT ONE--
+        struct inode node;
+        struct open_file* of = fs->open_files[src_inode];
+        int res = 0;
+        if(of != NULL)
+        node = of->node;
+        else
+        res = readinode(src_inode, &node);
+        if(res == 0 && inoderef(&node, 1) == 0){
+            dst_inode = allocinode();
+            if(dst_inode == -1)
+            inoderef(&node, -1);
+        }
+        if(dst_inode != -1){
+            if(!(node.flags & (INODE_INLINE | INODE_SHARED))){
+                node.flags |= INODE_SHARED;
+                putinode(src_inode, &node);
+                if(of != NULL)
+                of->node.flags |= INODE_SHARED;
+            }
+            putinode(dst_inode, &node);
+        }
+        pthread_rwlock_unlock(&fs->inode_locks[src_inode]);
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        if(dst_inode != -1 && diradd(dst, dst_inode) != 0){
+            releaseinode(dst_inode);
+            dst_inode = -1;
+        }
+    }
+    if(dst_inode != -1){
+        dcache_set(dst, dst_inode);
+        printf("File %s cloned to %s\n", src, dst);
+    }
+    pthread_rwlock_unlock(&fs->dir_lock);
+    jnl_end();
+    return dst_inode != -1 ? 0 : -1;
+}
+
+/* --DEFRAGMENTATION--
+
+A FILE IS FRAGMENTED WHEN TWO OF ITS CONSECUTIVE DATA BLOCKS (IN LOGICAL ORDER, HOLES AND
+COMPRESSED GROUP MARKERS SKIPPED) ARE NOT NEXT TO EACH OTHER ON DISK. THE DEFRAGMENTER
+COPIES SUCH A FILE INTO ONE RUN OF FREE BLOCKS IN ITS ALLOCATION GROUP AND SWAPS THE
+POINTERS IN A SINGLE TRANSACTION, SO A CRASH LEAVES EITHER THE OLD OR THE NEW COPY. A
+CONTIGUOUS FILE IS ALSO MOVED WHEN ITS GROUP HAS A RUN BEFORE IT, WHICH PACKS FILES
+TOWARDS THE START OF EACH GROUP AND LEAVES THE FREE SPACE IN ONE PIECE AT THE END.
+FILES THAT SHARE BLOCKS (CLONES, SNAPSHOTS, DEDUP) ARE LEFT WHERE THEY ARE.
+
+*/
+
+/* --HELPER FUNCTION--
+
+COUNTS THE STEPS BETWEEN CONSECUTIVE DATA BLOCKS OF A BLOCK MAP (pairs) AND HOW MANY OF
+THEM ARE NOT CONTIGUOUS ON DISK (breaks)
+RETURNS NUMBER OF DATA BLOCKS IN THE MAP
+
+*/
+
+static int fragcount(const int* map, int* breaks, int* pairs){
+    int prev = 0;
+    int count = 0;
+    for(int lblk = 0; lblk < MAX_FILE_BLOCKS; lblk++){
+        if(map[lblk] <= 0)
+        continue;
+        if(prev != 0){
+            (*pairs)++;
+            if(map[lblk] != prev + 1)
+            (*breaks)++;
+        }
+        prev = map[lblk];
+        count++;
+    }
+    return count;
+}
+
+/* --HELPER FUNCTION--
+
+GETS THE OPEN FILE OBJECT OF FILE inode_num, OR LOADS THE FILE INTO tmp IF IT IS NOT
+OPEN. CALLER HOLDS fdt_lock AND THE FILE'S I-NODE LOCK
+RETURNS THE OBJECT OR,
+RETURNS NULL IF THE FILE DOES NOT EXIST OR KEEPS ITS DATA INLINE
+
+*/
+
+static struct open_file* defragload(int inode_num, struct open_file* tmp){
+    struct open_file* of = fs->open_files[inode_num];
+    if(of == NULL){
+        tmp->inode_num = inode_num;
+        if(readinode(inode_num, &tmp->node) != 0 || !tmp->node.active || (tmp->node.flags & INODE_INLINE) || bmapload(tmp) != 0)
+        return NULL;
+        of = tmp;
+    }
+    if(of->node.flags & INODE_INLINE)
+    return NULL;
+    return of;
+}
+
+/* --FRAGMENTATION SCORE--
+
+RETURNS THE PERCENTAGE OF STEPS BETWEEN CONSECUTIVE DATA BLOCKS OF ALL FILES THAT ARE NOT
+CONTIGUOUS ON DISK (0 IF NO FILE HAS TWO DATA BLOCKS) OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_fragmentation(void){
+    struct open_file* tmp = ofalloc();
+    if(tmp == NULL || !fs->mounted){
+        scratchput(tmp);
+        return -1;
+    }
+    int breaks = 0;
+    int pairs = 0;
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    for(int n = 1; n < NUM_INODES; n++){
+        pthread_rwlock_rdlock(&fs->inode_locks[n]);
+        struct open_file* of = defragload(n, tmp);
+        if(of != NULL)
+        fragcount(of->blockmap, &breaks, &pairs);
+        pthread_rwlock_unlock(&fs->inode_locks[n]);
+    }
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    scratchput(tmp);
+    return pairs == 0 ? 0 : breaks * 100 / pairs;
+}
+
+/* --HELPER FUNCTION--
+
+MOVES FILE inode_num INTO ONE RUN OF FREE BLOCKS IF THAT MAKES IT CONTIGUOUS OR MOVES IT
+TOWARDS THE START OF ITS ALLOCATION GROUP
+RETURNS NUMBER OF BLOCKS MOVED (0 IF THE FILE WAS LEFT ALONE) OR,
+RETURNS -1 IF THE FILE SYSTEM IS NOT THE LIVE ONE
+
+*/
+
+static int defragfile(int inode_num){
+    struct open_file* tmp = ofalloc();
+    int* lblks = malloc(2 * MAX_FILE_BLOCKS * sizeof(int));
+    int* old = lblks + MAX_FILE_BLOCKS;
+    char* data = NULL;
+    int moved = 0;
+    if(tmp == NULL || lblks == NULL){
+        scratchput(tmp);
+        free(lblks);
+        return 0;
+    }
+    jnl_begin();
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    if(!fs->mounted){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        jnl_end();
+        scratchput(tmp);
+        free(lblks);
+        return -1;
+    }
+    pthread_rwlock_wrlock(&fs->inode_locks[inode_num]);
+    struct open_file* of = defragload(inode_num, tmp);
+    if(of == NULL || (of->node.flags & INODE_SHARED))
+    goto done;
+
+    int breaks = 0;
+    int pairs = 0;
+    int count = fragcount(of->blockmap, &breaks, &pairs);
+    if(count == 0)
+    goto done;
+    for(int lblk = 0, i = 0; lblk < MAX_FILE_BLOCKS; lblk++){
+        if(of->blockmap[lblk] <= 0)
+        continue;
+        //--A BLOCK ANOTHER OWNER STILL POINTS TO CANNOT MOVE--
+        if(blockref(of->blockmap[lblk], 0) != 1)
+        goto done;
+        lblks[i] = lblk;
+        old[i++] = of->blockmap[lblk];
+    }
+    int len;
+    int first = allocrun(inode_num, count, &len);
+    if(first == -1)
+    goto done;
+    int home = inode_num / AG_INODES;
+    int first_ag = (first - DATA_BLOCKS_OFFSET) / AG_BLOCKS;
+    int old_ag = (old[0] - DATA_BLOCKS_OFFSET) / AG_BLOCKS;
+    int better = breaks > 0 || (first_ag == home && (old_ag != home || first < old[0]));
+    data = malloc(count * BLOCK_SIZE);
+    if(len < count || !better || data == NULL){
+        for(int k = 0; k < len; k++){
+            blockref(first + k, -1);
+        }
+        goto done;
+    }
+
+    //--COPY, THEN SWAP EVERY POINTER IN THIS TRANSACTION AND LET GO OF THE OLD BLOCKS--
+    for(int i = 0; i < count; i++){
+        read_blocks(old[i], 1, data + i * BLOCK_SIZE);
+    }
+    cachewrite(first, count, data);
+    for(int i = 0; i < count; i++){
+        bmapset(of, lblks[i], first + i);
+    }
+    putinode(inode_num, &of->node);
+    for(int i = 0; i < count; i++){
+        blockref(old[i], -1);
+    }
+    moved = count;
+    printf("File %d moved to blocks %d-%d\n", inode_num, first, first + count - 1);
+
+    done:
+    pthread_rwlock_unlock(&fs->inode_locks[inode_num]);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    jnl_end();
+    free(data);
+    scratchput(tmp);
+    free(lblks);
+    return moved;
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF THE DEFRAG THREAD: ONE PASS OVER ALL FILES, SLEEPING AFTER EACH MOVE SO THAT THE
+AVERAGE STAYS AT defrag_rate BLOCKS PER SECOND
+
+*/
+
+static void* defragworker(void* arg){
+    fsbind(arg);
+    for(int n = 1; n < NUM_INODES && !__atomic_load_n(&fs->defrag_cancel, __ATOMIC_ACQUIRE); n++){
+        int moved = defragfile(n);
+        if(moved == -1)
+        break;
+        if(moved == 0)
+        continue;
+        fs->defrag_stats.files_moved++;
+        fs->defrag_stats.blocks_moved += moved;
+        if(fs->defrag_rate <= 0)
+        continue;
+        //--SLEEP IN SLICES SO A STOP REQUEST IS NOT HELD UP--
+        long long wait = moved * 1000000000LL / fs->defrag_rate;
+        while(wait > 0 && !__atomic_load_n(&fs->defrag_cancel, __ATOMIC_ACQUIRE)){
+            struct timespec slice = {0, wait < DEFRAG_SLICE_NS ? wait : DEFRAG_SLICE_NS};
+            nanosleep(&slice, NULL);
+            wait -= slice.tv_nsec;
+        }
+    }
+    fs->defrag_stats.score_after = sfs_fragmentation();
+    printf("Defrag: fragmentation %d%% -> %d%%, %d files (%d blocks) moved\n", fs->defrag_stats.score_before, fs->defrag_stats.score_after, fs->defrag_stats.files_moved, fs->defrag_stats.blocks_moved);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+WAITS FOR THE DEFRAG THREAD, ASKING IT TO STOP AFTER THE CURRENT FILE IF cancel IS SET
+
+*/
+
+static void defragjoin(int cancel){
+    if(!fs->defrag_running)
+    return;
+    if(cancel)
+    __atomic_store_n(&fs->defrag_cancel, 1, __ATOMIC_RELEASE);
+    pthread_join(fs->defrag_thread, NULL);
+    fs->defrag_running = 0;
+}
+
+/* --DEFRAG START--
+
+STARTS ONE DEFRAGMENTATION PASS IN THE BACKGROUND, MOVING AT MOST rate BLOCKS PER SECOND
+(0 FOR NO LIMIT). THE FILE SYSTEM STAYS USABLE WHILE IT RUNS
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF A PASS IS ALREADY RUNNING OR THE THREAD COULD NOT START
+
+*/
+
+int sfs_defrag_start(int rate){
+    if(fs->defrag_running || !fs->mounted)
+    return -1;
+    memset(&fs->defrag_stats, 0, sizeof(fs->defrag_stats));
+    fs->defrag_stats.score_before = sfs_fragmentation();
+    fs->defrag_rate = rate;
+    fs->defrag_cancel = 0;
+    if(pthread_create(&fs->defrag_thread, NULL, defragworker, fs) != 0)
+    return -1;
+    fs->defrag_running = 1;
+    return 0;
+}
+
+/* --DEFRAG WAIT--
+
+WAITS FOR THE DEFRAGMENTATION PASS TO FINISH AND COPIES ITS REPORT INTO stats (IF NOT NULL)
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO PASS WAS STARTED
+
+*/
+
+int sfs_defrag_wait(struct sfs_defrag_stats* stats){
+    if(!fs->defrag_running)
+    return -1;
+    defragjoin(0);
+    if(stats != NULL)
+    *stats = fs->defrag_stats;
+    return 0;
+}
+
+/* --DEFRAG STOP--
+
+STOPS THE DEFRAGMENTATION PASS AFTER THE FILE IT IS MOVING AND COPIES ITS REPORT INTO
+stats (IF NOT NULL). EVERY FILE IS EITHER FULLY MOVED OR NOT MOVED
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO PASS WAS STARTED
+
+*/
+
+int sfs_defrag_stop(struct sfs_defrag_stats* stats){
+    if(!fs->defrag_running)
+    return -1;
+    defragjoin(1);
+    if(stats != NULL)
+    *stats = fs->defrag_stats;
+    return 0;
+}
+
+/* --LOG MODE--
+
+THE LOG HEAD ADVANCES ONE SEGMENT AT A TIME THROUGH THE DATA BLOCKS (SEE logalloc), AND
+THE BLOCKS WRITTEN AT IT ARE GATHERED IN A log_run UNTIL THEY STOP BEING CONSECUTIVE.
+THE CLEANER PICKS SEGMENTS THAT ARE AT MOST LOG_CLEAN_PERCENT FULL, COPIES THE BLOCKS OF
+EVERY FILE THAT LIVE IN THEM TO THE HEAD AND SWAPS THE POINTERS IN ONE TRANSACTION PER
+FILE. BLOCKS THAT ARE SHARED, INDIRECT BLOCKS AND THE DIRECTORY STAY WHERE THEY ARE.
+
+*/
+
+/* --HELPER FUNCTION--
+
+RETURNS THE NUMBER OF DATA BLOCKS IN SEGMENT seg (THE LAST ONE MAY BE SHORT)
+
+*/
+
+static int segmentsize(int seg){
+    int end = (seg + 1) * LOG_SEGMENT_BLOCKS;
+    return (end < NUM_DATA_BLOCKS ? end : NUM_DATA_BLOCKS) - seg * LOG_SEGMENT_BLOCKS;
+}
+
+/* --HELPER FUNCTION--
+
+COUNTS THE USED BLOCKS OF SEGMENT seg IN A BYTEMAP
+RETURNS THE COUNT
+
+*/
+
+static int segmentlive(const unsigned char* bytemap, int seg){
+    int live = 0;
+    for(int i = seg * LOG_SEGMENT_BLOCKS; i < (seg + 1) * LOG_SEGMENT_BLOCKS && i < NUM_DATA_BLOCKS; i++){
+        if(bytemap[i] != 0)
+        live++;
+    }
+    return live;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF THE LOG MAY APPEND AT DATA BLOCK i, WHOSE BYTEMAP ENTRY IS refs: IT IS
+ALLOCATABLE AND NOT IN A SEGMENT THE CLEANER IS EMPTYING. CALLER HOLDS alloc_lock
+
+*/
+
+static int logfree(unsigned char refs, int i){
+    return allocatable(refs, i) && (fs->log_victim == NULL || !fs->log_victim[i / LOG_SEGMENT_BLOCKS]);
+}
+
+/* --HELPER FUNCTION--
+
+SEARCHES DATA BLOCKS [first, end) OF ONE SEGMENT FOR A BLOCK THE LOG MAY APPEND AT. A
+SEGMENT LIES IN ONE BYTEMAP BLOCK, WHICH IS READ INTO bytemap UNLESS *loaded SAYS IT IS
+THERE ALREADY. CALLER HOLDS alloc_lock
+RETURNS INDEX OF FREE BLOCK OR,
+RETURNS -1 IF THERE IS NONE
+RETURNS -2 FOR ALL OTHER FAILURE
+
+*/
+
+static int logscan(unsigned char* bytemap, int* loaded, int first, int end){
+    if(first / BLOCK_SIZE != *loaded){
+        *loaded = first / BLOCK_SIZE;
+        if(jnl_read(BYTEMAP_OFFSET + *loaded, bytemap) != 1){
+            *loaded = -1;
+            return -2;
+        }
+    }
+    for(int i = first; i < end; i++){
+        if(logfree(bytemap[i % BLOCK_SIZE], i))
+        return i;
+    }
+    return -1;
+}
+
+/* --HELPER FUNCTION--
+
+FINDS THE BLOCK THE LOG APPENDS AT: THE NEXT FREE BLOCK OF THE SEGMENT THE HEAD IS IN,
+ELSE THE FIRST BLOCK OF THE NEXT EMPTY SEGMENT, ELSE (NO SEGMENT IS EMPTY) THE NEXT FREE
+BLOCK AFTER THE HEAD. SEGMENTS ARE PICKED BY seg_live, SO AT MOST THE BYTEMAP BLOCK OF
+THE HEAD'S SEGMENT IS READ UNTIL NO SEGMENT IS EMPTY. CALLER HOLDS alloc_lock
+RETURNS INDEX OF FREE BLOCK OR,
+RETURNS -1 IF ALL BLOCKS FULL
+RETURNS -2 FOR ALL OTHER FAILURE
+
+*/
+
+static int logalloc(void){
+    unsigned char* bytemap = scratchget(BLOCK_SIZE);
+    if(bytemap == NULL || fs->seg_live == NULL){
+        scratchput(bytemap);
+        return -2;
+    }
+    int loaded = -1; //bytemap block held in bytemap
+    int found = -1;
+    int head = fs->log_head / LOG_SEGMENT_BLOCKS;
+    if(fs->log_head % LOG_SEGMENT_BLOCKS != 0 && fs->seg_live[head] < segmentsize(head))
+    found = logscan(bytemap, &loaded, fs->log_head, head * LOG_SEGMENT_BLOCKS + segmentsize(head));
+    //--EVERY ENTRY OF AN EMPTY SEGMENT IS 0, NONE HAS TO BE READ--
+    int next = (fs->log_head + LOG_SEGMENT_BLOCKS - 1) / LOG_SEGMENT_BLOCKS;
+    for(int n = 0; n < NUM_SEGMENTS && found == -1; n++){
+        int seg = (next + n) % NUM_SEGMENTS;
+        if(fs->seg_live[seg] != 0)
+        continue;
+        for(int i = seg * LOG_SEGMENT_BLOCKS; i < seg * LOG_SEGMENT_BLOCKS + segmentsize(seg) && found == -1; i++){
+            if(logfree(0, i))
+            found = i;
+        }
+    }
+    //--NO EMPTY SEGMENT LEFT, THREAD THE LOG THROUGH THE HOLES AFTER THE HEAD, BACK ROUND TO IT--
+    for(int n = 0; n <= NUM_SEGMENTS && found == -1; n++){
+        int seg = (head + n) % NUM_SEGMENTS;
+        int first = seg * LOG_SEGMENT_BLOCKS;
+        int end = first + segmentsize(seg);
+        if(n == 0)
+        first = fs->log_head;
+        else if(n == NUM_SEGMENTS)
+        end = fs->log_head;
+        if(first < end && fs->seg_live[seg] < segmentsize(seg))
+        found = logscan(bytemap, &loaded, first, end);
+    }
+    scratchput(bytemap);
+    if(found >= 0)
+    fs->log_head = (found + 1) % NUM_DATA_BLOCKS;
+    return found;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES OUT THE BLOCKS GATHERED IN run AS ONE DEVICE WRITE AND EMPTIES IT
+
+*/
+
+static void logflush(struct log_run* run){
+    if(run->len == 0)
+    return;
+    cachewrite(run->first, run->len, run->data);
+    if(fs->log_on){
+        __atomic_add_fetch(&fs->log_stats.blocks_appended, run->len, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&fs->log_stats.device_writes, 1, __ATOMIC_RELAXED);
+    }
+    run->len = 0;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS ONE BLOCK OF data, GOING TO DISK ADDRESS block, TO run. THE RUN IS WRITTEN OUT
+FIRST IF block DOES NOT FOLLOW IT OR IT IS A SEGMENT LONG
+
+*/
+
+static void logappend(struct log_run* run, int block, const char* data){
+    if(run->len > 0 && (block != run->first + run->len || run->len == LOG_SEGMENT_BLOCKS))
+    logflush(run);
+    if(run->len == 0)
+    run->first = block;
+    memcpy(run->data + run->len * BLOCK_SIZE, data, BLOCK_SIZE);
+    run->len++;
+}
+
+/* --HELPER FUNCTION--
+
+COUNTS THE USED BLOCKS OF EVERY SEGMENT INTO live AND GIVES THE SEGMENT THE HEAD IS
+FILLING IN head (EACH IF NOT NULL)
+RETURNS NUMBER OF EMPTY SEGMENTS OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int logsegments(int* live, int* head){
+    pthread_mutex_lock(&fs->alloc_lock);
+    //--IN LOG MODE THE COUNTS ARE KEPT, OTHERWISE THEY COME FROM THE BYTEMAP--
+    unsigned char* bytemap = fs->seg_live == NULL ? bytemapload() : NULL;
+    int empty = -1;
+    if(head != NULL)
+    *head = (fs->log_head + NUM_DATA_BLOCKS - 1) % NUM_DATA_BLOCKS / LOG_SEGMENT_BLOCKS;
+    if(bytemap != NULL || fs->seg_live != NULL){
+        empty = 0;
+        for(int seg = 0; seg < NUM_SEGMENTS; seg++){
+            int n = bytemap != NULL ? segmentlive(bytemap, seg) : fs->seg_live[seg];
+            if(n == 0)
+            empty++;
+            if(live != NULL)
+            live[seg] = n;
+        }
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+    scratchput(bytemap);
+    return empty;
+}
+
+/* --HELPER FUNCTION--
+
+MOVES THE BLOCKS OF FILE inode_num THAT LIE IN A victim SEGMENT TO THE LOG HEAD, USING
+tmp, data AND run AS SCRATCH
+RETURNS NUMBER OF BLOCKS MOVED OR,
+RETURNS -1 IF THE FILE SYSTEM IS NOT THE LIVE ONE
+
+*/
+
+static int logcleanfile(int inode_num, const unsigned char* victim, struct open_file* tmp, char* data, struct log_run* run){
+    int moved = 0;
+    jnl_begin();
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    if(!fs->mounted){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        jnl_end();
+        return -1;
+    }
+    pthread_rwlock_wrlock(&fs->inode_locks[inode_num]);
+    struct open_file* of = defragload(inode_num, tmp);
+    if(of != NULL && !(of->node.flags & INODE_SHARED)){
+        //--THE INDIRECT BLOCK IS METADATA, IT MOVES THROUGH THE JOURNAL--
+        int indirect = of->node.indirect_ptr;
+        if(indirect > 0 && victim[(indirect - DATA_BLOCKS_OFFSET) / LOG_SEGMENT_BLOCKS] && blockref(indirect, 0) == 1){
+            int fresh = allocblock(inode_num);
+            if(fresh != -1 && jnl_read(indirect, data) == 1 && jnl_write(fresh, data) == 1){
+                of->node.indirect_ptr = fresh;
+                blockref(indirect, -1);
+                moved++;
+            }
+            else if(fresh != -1)
+            blockref(fresh, -1);
+        }
+        for(int lblk = 0; lblk < MAX_FILE_BLOCKS; lblk++){
+            int old = of->blockmap[lblk];
+            if(old <= 0 || !victim[(old - DATA_BLOCKS_OFFSET) / LOG_SEGMENT_BLOCKS] || blockref(old, 0) != 1)
+            continue;
+            int fresh = allocblock(inode_num);
+            if(fresh == -1)
+            break;
+            read_blocks(old, 1, data);
+            logappend(run, fresh, data);
+            bmapset(of, lblk, fresh);
+            blockref(old, -1);
+            moved++;
+        }
+        logflush(run);
+        if(moved > 0)
+        putinode(inode_num, &of->node);
+    }
+    pthread_rwlock_unlock(&fs->inode_locks[inode_num]);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    jnl_end();
+    return moved;
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF THE CLEANER THREAD: WHILE FEWER THAN LOG_CLEAN_FREE SEGMENTS ARE EMPTY, EMPTIES THE
+SEGMENTS THAT ARE AT MOST LOG_CLEAN_PERCENT FULL, THEN WAITS LOG_CLEAN_INTERVAL_NS
+
+*/
+
+static void* logworker(void* arg){
+    fsbind(arg);
+    struct open_file* tmp = ofalloc();
+    int* live = malloc(NUM_SEGMENTS * sizeof(int));
+    unsigned char* victim = malloc(NUM_SEGMENTS);
+    char* data = malloc(BLOCK_SIZE);
+    struct log_run run = {malloc(LOG_SEGMENT_BLOCKS * BLOCK_SIZE), 0, 0};
+    while(tmp != NULL && live != NULL && victim != NULL && data != NULL && run.data != NULL && !__atomic_load_n(&fs->log_cancel, __ATOMIC_ACQUIRE)){
+        int head;
+        int empty = logsegments(live, &head);
+        int victims = 0;
+        memset(victim, 0, NUM_SEGMENTS);
+        if(empty != -1 && empty < LOG_CLEAN_FREE){
+            //--EMPTIEST FIRST, WHILE THE LIVE BLOCKS OF THE VICTIMS FIT IN THE FREE BLOCKS OF THE OTHERS--
+            int room = 0;
+            for(int seg = 0; seg < NUM_SEGMENTS; seg++){
+                room += segmentsize(seg) - live[seg];
+            }
+            for(int fill = 1; fill * 100 <= LOG_CLEAN_PERCENT * LOG_SEGMENT_BLOCKS; fill++){
+                for(int seg = 0; seg < NUM_SEGMENTS; seg++){
+                    if(seg == head || live[seg] != fill || room < segmentsize(seg))
+                    continue;
+                    victim[seg] = 1;
+                    victims++;
+                    room -= segmentsize(seg);
+                }
+            }
+        }
+        if(victims > 0){
+            //--THE HEAD STAYS OUT OF THE VICTIMS WHILE THEY ARE EMPTIED--
+            pthread_mutex_lock(&fs->alloc_lock);
+            fs->log_victim = victim;
+            pthread_mutex_unlock(&fs->alloc_lock);
+            int moved = 0;
+            for(int n = 1; n < NUM_INODES && !__atomic_load_n(&fs->log_cancel, __ATOMIC_ACQUIRE); n++){
+                int k = logcleanfile(n, victim, tmp, data, &run);
+                if(k == -1)
+                break;
+                moved += k;
+            }
+            pthread_mutex_lock(&fs->alloc_lock);
+            fs->log_victim = NULL;
+            pthread_mutex_unlock(&fs->alloc_lock);
+            int cleaned = 0;
+            if(logsegments(live, NULL) != -1){
+                for(int seg = 0; seg < NUM_SEGMENTS; seg++){
+                    if(victim[seg] && live[seg] == 0)
+                    cleaned++;
+                }
+            }
+            __atomic_add_fetch(&fs->log_stats.segments_cleaned, cleaned, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&fs->log_stats.blocks_cleaned, moved, __ATOMIC_RELAXED);
+            if(cleaned > 0)
+            printf("Log cleaner: %d segments emptied, %d blocks moved\n", cleaned, moved);
+        }
+        struct timespec pause = {0, LOG_CLEAN_INTERVAL_NS};
+        nanosleep(&pause, NULL);
+    }
+    scratchput(tmp);
+    free(live);
+    free(victim);
+    free(data);
+    free(run.data);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+STOPS THE CLEANER THREAD AND WAITS FOR IT
+
+*/
+
+static void logjoin(void){
+    if(!fs->log_running)
+    return;
+    __atomic_store_n(&fs->log_cancel, 1, __ATOMIC_RELEASE);
+    pthread_join(fs->log_thread, NULL);
+    fs->log_running = 0;
+}
+
+/* --LOG MODE SWITCH--
+
+TURNS LOG MODE ON (enable != 0) OR OFF FOR THE MOUNTED FILE SYSTEM AND STARTS OR STOPS
+THE SEGMENT CLEANER WITH IT. A NEW MOUNT STARTS WITH LOG MODE OFF
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO FILE SYSTEM IS MOUNTED, THE BYTEMAP COULD NOT BE READ OR THE CLEANER
+COULD NOT START
+
+*/
+
+int sfs_logmode(int enable){
+    if(!fs->mounted)
+    return -1;
+    //--THE CLEANER TAKES fdt_lock, STOP IT BEFORE WAITING FOR THE WRITERS--
+    if(!enable)
+    logjoin();
+    //--NO WRITE IS IN FLIGHT WHILE io_lock IS HELD FOR WRITING--
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    pthread_mutex_lock(&fs->alloc_lock);
+    //--THE LIVE COUNT OF EACH SEGMENT IS KEPT WHILE LOG MODE IS ON, SEE logalloc--
+    int res = 0;
+    if(enable && fs->seg_live == NULL){
+        fs->seg_live = calloc(NUM_SEGMENTS, sizeof(int));
+        if(fs->seg_live == NULL || agload() != 0){
+            free(fs->seg_live);
+            fs->seg_live = NULL;
+            res = -1;
+        }
+    }
+    else if(!enable){
+        free(fs->seg_live);
+        fs->seg_live = NULL;
+    }
+    if(res == 0)
+    fs->log_on = enable != 0;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    if(res != 0)
+    return -1;
+    if(enable && !fs->log_running){
+        fs->log_cancel = 0;
+        if(pthread_create(&fs->log_thread, NULL, logworker, fs) != 0)
+        return -1;
+        fs->log_running = 1;
+    }
+    return 0;
+}
+
+/* --LOG COUNTERS--
+
+COPIES THE LOG MODE COUNTERS INTO stats. blocks_appended / device_writes IS THE AVERAGE
+NUMBER OF BLOCKS PER DEVICE WRITE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_log_stats(struct sfs_log_stats* stats){
+    if(stats == NULL || !fs->mounted)
+    return -1;
+    stats->blocks_appended = __atomic_load_n(&fs->log_stats.blocks_appended, __ATOMIC_RELAXED);
+    stats->device_writes = __atomic_load_n(&fs->log_stats.device_writes, __ATOMIC_RELAXED);
+    stats->segments_cleaned = __atomic_load_n(&fs->log_stats.segments_cleaned, __ATOMIC_RELAXED);
+    stats->blocks_cleaned = __atomic_load_n(&fs->log_stats.blocks_cleaned, __ATOMIC_RELAXED);
+    stats->free_segments = logsegments(NULL, NULL);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF THE PREFETCH THREAD: LOADS THE RUNS IN THE PREFETCH QUEUE INTO THE BLOCK CACHE
+UNTIL THE QUEUE IS EMPTY
+
+*/
+
+static void* prefetchworker(void* arg){
+    fsbind(arg);
+    pthread_mutex_lock(&fs->bcache_lock);
+    while(fs->prefetch_count > 0){
+        struct prefetch_req req = fs->prefetch_queue[fs->prefetch_next];
+        fs->prefetch_next = (fs->prefetch_next + 1) % PREFETCH_QUEUE;
+        fs->prefetch_count--;
+        pthread_mutex_unlock(&fs->bcache_lock);
+        cachefill(req.block, req.count, &fs->cache_stats.prefetched);
+        pthread_mutex_lock(&fs->bcache_lock);
+    }
+    fs->prefetch_running = 0;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS n RUNS OF BLOCKS TO THE PREFETCH QUEUE (AS MANY AS FIT) AND STARTS THE PREFETCH
+THREAD IF IT IS NOT RUNNING. CALLER HOLDS NO LOCK
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF THE THREAD COULD NOT START
+
+*/
+
+static int prefetchqueue(const struct prefetch_req* reqs, int n){
+    pthread_mutex_lock(&fs->prefetch_lock);
+    pthread_mutex_lock(&fs->bcache_lock);
+    for(int k = 0; k < n && fs->prefetch_count < PREFETCH_QUEUE; k++){
+        fs->prefetch_queue[(fs->prefetch_next + fs->prefetch_count) % PREFETCH_QUEUE] = reqs[k];
+        fs->prefetch_count++;
+    }
+    int start = !fs->prefetch_running;
+    fs->prefetch_running = 1;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    int res = 0;
+    if(start){
+        //--THE LAST THREAD EMPTIED THE QUEUE AND IS EXITING OR GONE--
+        if(fs->prefetch_started)
+        pthread_join(fs->prefetch_thread, NULL);
+        fs->prefetch_started = pthread_create(&fs->prefetch_thread, NULL, prefetchworker, fs) == 0;
+        if(!fs->prefetch_started){
+            pthread_mutex_lock(&fs->bcache_lock);
+            fs->prefetch_count = 0;
+            fs->prefetch_running = 0;
+            pthread_mutex_unlock(&fs->bcache_lock);
+            res = -1;
+        }
+    }
+    pthread_mutex_unlock(&fs->prefetch_lock);
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+EMPTIES THE PREFETCH QUEUE AND WAITS FOR THE PREFETCH THREAD
+
+*/
+
+static void prefetchjoin(void){
+    pthread_mutex_lock(&fs->prefetch_lock);
+    pthread_mutex_lock(&fs->bcache_lock);
+    fs->prefetch_count = 0;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    if(fs->prefetch_started){
+        pthread_join(fs->prefetch_thread, NULL);
+        fs->prefetch_started = 0;
+    }
+    pthread_mutex_unlock(&fs->prefetch_lock);
+}
+
+/* --FILE ACCESS ADVICE--
+
+TELLS THE BLOCK CACHE HOW BYTES [offset, offset + len) OF AN OPEN FILE (UP TO ITS END IF
+len IS 0) ARE GOING TO BE READ:
+SFS_FADV_NORMAL       READ AHEAD OF A READER THAT GOES ON WHERE IT STOPPED (THE DEFAULT)
+SFS_FADV_SEQUENTIAL   READ FURTHER AHEAD, AND EVICT THE BLOCKS BEHIND THE READER FIRST
+SFS_FADV_RANDOM       NEVER READ AHEAD
+SFS_FADV_WILLNEED     LOAD THE RANGE INTO THE CACHE IN THE BACKGROUND
+SFS_FADV_DONTNEED     DROP THE RANGE FROM THE CACHE
+THE FIRST THREE HOLD FOR THE WHOLE FILE AND EVERY DESCRIPTOR OF IT UNTIL IT IS CLOSED.
+INLINE FILES AND COMPRESSED GROUPS HAVE NO BLOCKS IN THE CACHE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_fadvise(int fileID, int offset, int len, int advice){
+    if(offset < 0 || len < 0 || advice < SFS_FADV_NORMAL || advice > SFS_FADV_DONTNEED)
+    return -1;
+    struct open_file* of = filebegin(fileID, 0, 0, NULL);
+    if(of == NULL)
+    return -1;
+    if(advice != SFS_FADV_WILLNEED && advice != SFS_FADV_DONTNEED){
+        __atomic_store_n(&of->advice, advice, __ATOMIC_RELAXED);
+        fileend(fileID, of, 0, 0);
+        return 0;
+    }
+    struct prefetch_req reqs[PREFETCH_QUEUE];
+    int nreqs = 0;
+    int end = len == 0 || len > of->node.file_size - offset ? of->node.file_size : offset + len;
+    int* map = of->blockmap;
+    for(int lblk = offset / BLOCK_SIZE; lblk * BLOCK_SIZE < end && !(of->node.flags & INODE_INLINE); lblk++){
+        if(map[lblk] <= 0 || map[lblk / GROUP_BLOCKS * GROUP_BLOCKS + GROUP_BLOCKS - 1] == COMPRESSED_GROUP)
+        continue;
+        if(advice == SFS_FADV_DONTNEED)
+        cachedrop(map[lblk]);
+        //--EXTEND THE LAST RUN IF THE BLOCK FOLLOWS IT ON DISK--
+        else if(nreqs > 0 && reqs[nreqs - 1].block + reqs[nreqs - 1].count == map[lblk] && reqs[nreqs - 1].count < PREFETCH_RUN_BLOCKS)
+        reqs[nreqs - 1].count++;
+        else if(nreqs < PREFETCH_QUEUE){
+            reqs[nreqs].block = map[lblk];
+            reqs[nreqs].count = 1;
+            nreqs++;
+        }
+    }
+    //--THE DECOMPRESSED GROUP IS CACHED IN THE OPEN FILE--
+    if(advice == SFS_FADV_DONTNEED){
+        pthread_mutex_lock(&of->cache_lock);
+        of->cache_group = -1;
+        pthread_mutex_unlock(&of->cache_lock);
+    }
+    fileend(fileID, of, 0, 0);
+    if(nreqs > 0)
+    return prefetchqueue(reqs, nreqs);
+    return 0;
+}
+
+/* --CACHE COUNTERS--
+
+COPIES THE BLOCK CACHE COUNTERS INTO stats. hits / (hits + misses) IS THE HIT RATE OF THE
+DATA BLOCKS READ
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int sfs_cache_stats(struct sfs_cache_stats* stats){
+    if(stats == NULL || !fs->mounted)
+    return -1;
+    pthread_mutex_lock(&fs->bcache_lock);
+    *stats = fs->cache_stats;
+    stats->cached_blocks = 0;
+    for(int e = 0; e < fs->bcache_blocks; e++){
+        if(fs->bcache[e].block != 0)
+        stats->cached_blocks++;
+    }
+    pthread_mutex_unlock(&fs->bcache_lock);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+GROWS THE MOUNTED DISK TO disk_size BYTES OR, IF full IS SET (THE DISK SIZE IN BLOCKS A
+WRITE RAN OUT OF BLOCKS AT), BY grow_step BYTES AND BY MORE IF THE NEW BYTEMAP NEEDS IT.
+A WRITER THAT FINDS THE DISK ALREADY GROWN BY ANOTHER ONE LEAVES IT AS IT IS
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int growfs(long long disk_size, int full){
+    if(!fs->mounted)
+    return -1;
+    if(fs->geo.slow_blocks > 0){
+        printf("Cannot grow %s, it spans two images\n", fs->path);
+        return -1;
+    }
+    long long step = __atomic_load_n(&fs->grow_step, __ATOMIC_RELAXED);
+    if(full && step <= 0)
+    return -1;
+    pthread_mutex_lock(&fs->grow_lock);
+    if(full && full != NUM_BLOCKS){
+        pthread_mutex_unlock(&fs->grow_lock);
+        return 0;
+    }
+    //--THE CLEANER SIZES ITS TABLES BY THE NUMBER OF SEGMENTS, IT IS RESTARTED AFTERWARDS--
+    int cleaner = fs->log_running;
+    logjoin();
+    unsigned char* bytemap = NULL;
+    unsigned char* old = NULL;
+    struct dedup_entry* index = NULL;
+    int* slot = NULL;
+    int* freed = NULL;
+    int* live = NULL;
+    int res = -1;
+    //--NO CALL IS IN FLIGHT WHILE io_lock IS HELD FOR WRITING, NO BLOCK MOVES WHILE fdt_lock IS--
+    jnl_begin_excl();
+    pthread_rwlock_wrlock(&fs->io_lock);
+    pthread_rwlock_wrlock(&fs->fdt_lock);
+    pthread_mutex_lock(&fs->alloc_lock);
+    pthread_mutex_lock(&fs->dedup_lock);
+    long long size = full ? (long long)NUM_BLOCKS * BLOCK_SIZE + step : disk_size;
+    struct geometry g = fs->geo;
+    g.num_blocks = size / BLOCK_SIZE > INT_MAX / 2 ? 0 : (int)(size / BLOCK_SIZE);
+    if(g.num_blocks <= NUM_BLOCKS || geolayout(&g) != 0 || g.data_blocks <= NUM_DATA_BLOCKS){
+        printf("Cannot grow %s to %lld bytes\n", fs->path, size);
+        goto done;
+    }
+    while(full && NUM_BLOCKS - g.bytemap_start > GROW_JOURNAL_BLOCKS){
+        g.num_blocks += NUM_BLOCKS - g.bytemap_start;
+        geolayout(&g);
+    }
+    int inside = NUM_BLOCKS - g.bytemap_start; //new bytemap blocks inside the old disk
+    if(inside > GROW_JOURNAL_BLOCKS){
+        printf("Cannot grow %s to %lld bytes, its bytemap would not fit past the old end\n", fs->path, size);
+        goto done;
+    }
+    bytemap = calloc(g.bytemap_blocks, BLOCK_SIZE);
+    int dedup = fs->dedup_index != NULL;
+    if(dedup){
+        index = calloc(g.dedup_size, sizeof(struct dedup_entry));
+        slot = calloc(g.data_blocks, sizeof(int));
+    }
+    freed = calloc(g.data_blocks, sizeof(int));
+    int log = fs->seg_live != NULL;
+    if(log)
+    live = calloc((g.data_blocks + LOG_SEGMENT_BLOCKS - 1) / LOG_SEGMENT_BLOCKS, sizeof(int));
+    old = bytemapload();
+    if(bytemap == NULL || (dedup && (index == NULL || slot == NULL)) || freed == NULL || (log && live == NULL)
+       || old == NULL || extend_disk(g.num_blocks) != 0)
+    goto done;
+    memcpy(bytemap, old, NUM_DATA_BLOCKS);
+
+    //--NOTHING POINTS PAST THE OLD END BEFORE THE COMMIT, THAT PART IS WRITTEN IN PLACE--
+    int first = inside > 0 ? inside : 0;
+    if(write_blocks(g.bytemap_start + first, g.bytemap_blocks - first, bytemap + first * BLOCK_SIZE) != g.bytemap_blocks - first)
+    goto done;
+    for(int b = 0; b < first; b++){
+        if(jnl_write(g.bytemap_start + b, bytemap + b * BLOCK_SIZE) != 1)
+        goto done;
+    }
+    int layout[3] = {g.data_blocks, g.bytemap_start, g.bytemap_blocks};
+    if(jnl_patch(0, offsetof(struct superblock, fs_sz), &g.num_blocks, sizeof(int)) != 1
+       || jnl_patch(0, offsetof(struct superblock, data_sz), layout, sizeof(layout)) != 1)
+    goto done;
+
+    //--SWITCH TO THE NEW LAYOUT AND REHASH THE FINGERPRINT INDEX INTO ITS NEW SIZE--
+    struct dedup_entry* prev = fs->dedup_index;
+    int prev_size = DEDUP_INDEX_SIZE;
+    memcpy(freed, fs->free_seq, NUM_DATA_BLOCKS * sizeof(int));
+    fs->free_blocks += g.data_blocks - NUM_DATA_BLOCKS;
+    fs->geo.num_blocks = g.num_blocks;
+    fs->geo.data_blocks = g.data_blocks;
+    fs->geo.bytemap_start = g.bytemap_start;
+    fs->geo.bytemap_blocks = g.bytemap_blocks;
+    fs->geo.dedup_size = g.dedup_size;
+    fs->dedup_index = index;
+    index = prev;
+    free(fs->dedup_slot);
+    fs->dedup_slot = slot;
+    slot = NULL;
+    free(fs->free_seq);
+    fs->free_seq = freed;
+    freed = NULL;
+    if(log){
+        free(fs->seg_live);
+        fs->seg_live = live;
+        live = NULL;
+    }
+    for(int h = 0; dedup && h < prev_size; h++){
+        if(index[h].block == 0)
+        continue;
+        int k = dedup_probe(index[h].hash, 0);
+        fs->dedup_index[k] = index[h];
+        fs->dedup_slot[index[h].block - DATA_BLOCKS_OFFSET] = k + 1;
+    }
+    agload();
+    res = 0;
+    printf("%s grown to %d blocks (%d data blocks)\n", fs->path, NUM_BLOCKS, NUM_DATA_BLOCKS);
+
+    done:
+    pthread_mutex_unlock(&fs->dedup_lock);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    pthread_rwlock_unlock(&fs->io_lock);
+    jnl_end();
+    scratchput(old);
+    free(bytemap);
+    free(index);
+    free(slot);
+    free(freed);
+    free(live);
+    //--THE NEW SIZE IS ON DISK WHEN THE CALL RETURNS, AND THE OLD BYTEMAP IS FREE TO ALLOCATE--
+    if(res == 0 && (jnl_commit() != 0 || jnl_checkpoint() != 0))
+    res = -1;
+    if(cleaner && fs->log_on)
+    sfs_logmode(1);
+    pthread_mutex_unlock(&fs->grow_lock);
+    return res;
+}
+
+/* --GROW--
+
+GROWS THE MOUNTED FILE SYSTEM TO disk_size BYTES WHILE IT STAYS IN USE, SEE --GROWING--.
+AT MOST GROW_JOURNAL_BLOCKS BLOCKS OF THE NEW BYTEMAP MAY LIE INSIDE THE OLD DISK, SO A
+DISK GROWS BY ABOUT THE SIZE OF ITS BYTEMAP OR MORE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO LIVE FILE SYSTEM IS MOUNTED OR THE DISK CANNOT GROW TO disk_size
+
+*/
+
+int sfs_grow(long long disk_size){
+    return growfs(disk_size, 0);
+}
+
+/* --AUTOMATIC GROW--
+
+MAKES A WRITE THAT RUNS OUT OF BLOCKS GROW THE DISK BY step BYTES (MORE IF THE NEW
+BYTEMAP NEEDS IT) AND GO ON, step 0 TURNS IT OFF. A NEW MOUNT STARTS WITH IT OFF
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO FILE SYSTEM IS MOUNTED
+
+*/
+
+int sfs_autogrow(long long step){
+    if(!fs->mounted || step < 0)
+    return -1;
+    __atomic_store_n(&fs->grow_step, step, __ATOMIC_RELAXED);
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS THE TIER FILE inode_num TAKES NEW BLOCKS FROM (SEE --TIERS--), -1 ON A ONE-IMAGE
+DISK. THE DIRECTORY AND THE SNAPSHOT CATALOGS STAY FAST. CALLER HOLDS fdt_lock
+
+*/
+
+static int tierof(int inode_num){
+    if(fs->geo.slow_blocks == 0)
+    return -1;
+    if(inode_num == 0)
+    return SFS_TIER_FAST;
+    struct open_file* of = fs->open_files[inode_num];
+    struct inode node;
+    if(of != NULL)
+    node.flags = of->node.flags;
+    else if(readinode(inode_num, &node) != 0)
+    return SFS_TIER_FAST;
+    return (node.flags & INODE_SLOW) ? SFS_TIER_SLOW : SFS_TIER_FAST;
+}
+
+/* --HELPER FUNCTION--
+
+COUNTS THE FREE DATA BLOCKS OF EACH TIER
+
+*/
+
+static void tierfree(int* fast, int* slow){
+    *fast = 0;
+    *slow = 0;
+    pthread_mutex_lock(&fs->alloc_lock);
+    unsigned char* bytemap = bytemapload();
+    for(int i = 0; bytemap != NULL && i < NUM_DATA_BLOCKS; i++){
+        if(bytemap[i] != 0)
+        continue;
+        if(i >= fs->geo.slow_start)
+        (*slow)++;
+        else
+        (*fast)++;
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+    scratchput(bytemap);
+}
+
+/* --HELPER FUNCTION--
+
+MOVES THE BLOCKS OF FILE inode_num THAT ARE NOT IN TIER tier THERE, AS FAR AS IT HAS ROOM,
+AND MAKES IT TAKE ITS NEW BLOCKS FROM THAT TIER. BLOCKS SHARED WITH ANOTHER OWNER STAY,
+NOTHING MOVES IN LOG MODE
+RETURNS NUMBER OF BLOCKS MOVED OR,
+RETURNS -1 IF THE FILE SYSTEM IS NOT THE LIVE ONE
+
+*/
+
+static int tiermove(int inode_num, int tier){
+    struct open_file* tmp = ofalloc();
+    char* data = scratchget(BLOCK_SIZE);
+    int moved = 0;
+    if(tmp == NULL || data == NULL){
+        scratchput(tmp);
+        scratchput(data);
+        return 0;
+    }
+    int slow = DATA_BLOCKS_OFFSET + fs->geo.slow_start;
+    jnl_begin();
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    if(!fs->mounted){
+        pthread_rwlock_unlock(&fs->fdt_lock);
+        jnl_end();
+        scratchput(tmp);
+        scratchput(data);
+        return -1;
+    }
+    pthread_mutex_lock(&fs->alloc_lock);
+    int log = fs->log_on;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    pthread_rwlock_wrlock(&fs->inode_locks[inode_num]);
+    struct open_file* of = log ? NULL : defragload(inode_num, tmp);
+    if(of != NULL && !(of->node.flags & INODE_SHARED)){
+        //--THE INDIRECT BLOCK IS METADATA, IT MOVES THROUGH THE JOURNAL--
+        int indirect = of->node.indirect_ptr;
+        if(indirect > 0 && (indirect >= slow) != tier && blockref(indirect, 0) == 1){
+            int fresh = allocin(inode_num, tier, 0);
+            if(fresh != -1 && jnl_read(indirect, data) == 1 && jnl_write(fresh, data) == 1){
+                of->node.indirect_ptr = fresh;
+                blockref(indirect, -1);
+                moved++;
+            }
+            else if(fresh != -1)
+            blockref(fresh, -1);
+        }
+        for(int lblk = 0; lblk < MAX_FILE_BLOCKS; lblk++){
+            int old = of->blockmap[lblk];
+            if(old <= 0 || (old >= slow) == tier || blockref(old, 0) != 1)
+            continue;
+            int fresh = allocin(inode_num, tier, 0);
+            if(fresh == -1)
+            break;
+            read_blocks(old, 1, data);
+            cachewrite(fresh, 1, data);
+            bmapset(of, lblk, fresh);
+            blockref(old, -1);
+            moved++;
+        }
+        if(tier == SFS_TIER_SLOW)
+        of->node.flags |= INODE_SLOW;
+        else
+        of->node.flags &= ~INODE_SLOW;
+        putinode(inode_num, &of->node);
+    }
+    pthread_rwlock_unlock(&fs->inode_locks[inode_num]);
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    jnl_end();
+    scratchput(tmp);
+    scratchput(data);
+    if(of != NULL){
+        pthread_mutex_lock(&fs->bcache_lock);
+        if(tier == SFS_TIER_SLOW)
+        fs->tier_stats.demotions++;
+        else
+        fs->tier_stats.promotions++;
+        fs->tier_stats.blocks_moved += moved;
+        pthread_mutex_unlock(&fs->bcache_lock);
+    }
+    return moved;
+}
+
+/* --HELPER FUNCTION--
+
+ONE PASS OF THE TIER THREAD: FOLDS THE HEAT OF EVERY FILE INTO score (AND idle, THE PASSES
+SINCE ITS LAST ACCESS), THEN SENDS COLD FILES TO THE SLOW TIER AND HOT ONES TO THE FAST
+TIER, SEE --TIERS--
+
+*/
+
+static void tierpass(unsigned int* score, unsigned char* idle){
+    for(int n = 1; n < NUM_INODES; n++){
+        unsigned int h = __atomic_exchange_n(&fs->heat[n], 0, __ATOMIC_RELAXED);
+        score[n] = score[n] / 2 + h;
+        idle[n] = h != 0 ? 0 : idle[n] < 255 ? idle[n] + 1 : 255;
+    }
+    //--IN LOG MODE THE LOG HEAD DECIDES WHERE BLOCKS GO--
+    pthread_mutex_lock(&fs->alloc_lock);
+    int log = fs->log_on;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    if(log)
+    return;
+    int fast, slow;
+    tierfree(&fast, &slow);
+    int reserve = fs->geo.slow_start * TIER_RESERVE_PERCENT / 100;
+    for(int n = 1; n < NUM_INODES && !__atomic_load_n(&fs->tier_cancel, __ATOMIC_ACQUIRE); n++){
+        struct inode node;
+        if(readinode(n, &node) != 0 || !node.active || (node.flags & (INODE_INLINE | INODE_SHARED)))
+        continue;
+        int tier;
+        if(!(node.flags & INODE_SLOW) && idle[n] >= TIER_COLD_PASSES)
+        tier = SFS_TIER_SLOW;
+        else if((node.flags & INODE_SLOW) && score[n] >= TIER_HOT_SCORE && fast - node.file_size / BLOCK_SIZE - 2 >= reserve)
+        tier = SFS_TIER_FAST;
+        else
+        continue;
+        int moved = tiermove(n, tier);
+        if(moved == -1)
+        break;
+        fast += tier == SFS_TIER_SLOW ? moved : -moved;
+        if(moved > 0)
+        printf("File %d moved to the %s tier (%d blocks)\n", n, tier == SFS_TIER_SLOW ? "slow" : "fast", moved);
+    }
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF THE TIER THREAD: A tierpass EVERY TIER_INTERVAL_NS UNTIL tier_cancel IS SET
+
+*/
+
+static void* tierworker(void* arg){
+    fsbind(arg);
+    unsigned int* score = calloc(NUM_INODES, sizeof(unsigned int));
+    unsigned char* idle = calloc(NUM_INODES, 1);
+    while(score != NULL && idle != NULL && !__atomic_load_n(&fs->tier_cancel, __ATOMIC_ACQUIRE)){
+        tierpass(score, idle);
+        struct timespec pause = {0, TIER_INTERVAL_NS};
+        nanosleep(&pause, NULL);
+    }
+    free(score);
+    free(idle);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+STARTS THE TIER THREAD OF THE MOUNTED FILE SYSTEM
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF IT COULD NOT START
+
+*/
+
+static int tierstart(void){
+    fs->tier_cancel = 0;
+    if(pthread_create(&fs->tier_thread, NULL, tierworker, fs) != 0)
+    return -1;
+    fs->tier_running = 1;
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+STOPS THE TIER THREAD AND WAITS FOR IT
+
+*/
+
+static void tierjoin(void){
+    if(!fs->tier_running)
+    return;
+    __atomic_store_n(&fs->tier_cancel, 1, __ATOMIC_RELEASE);
+    pthread_join(fs->tier_thread, NULL);
+    fs->tier_running = 0;
+}
+
+/* --MOVE A FILE BETWEEN TIERS--
+
+MOVES THE OPEN FILE fileID TO TIER tier (SFS_TIER_FAST OR SFS_TIER_SLOW) NOW, ITS NEW
+BLOCKS COME FROM THERE TOO. THE TIER THREAD MAY MOVE IT AGAIN LATER
+RETURNS NUMBER OF BLOCKS MOVED OR,
+RETURNS -1 IF THE DISK IS ONE IMAGE, fileID IS NOT OPEN OR IT IS A SNAPSHOT FILE
+
+*/
+
+int sfs_ftier(int fileID, int tier){
+    if(!fs->mounted || fs->geo.slow_blocks == 0 || (tier != SFS_TIER_FAST && tier != SFS_TIER_SLOW))
+    return -1;
+    pthread_rwlock_rdlock(&fs->fdt_lock);
+    struct open_file* of = fdtget(fileID);
+    int inode_num = of != NULL && of->snapshot == -1 ? of->inode_num : -1;
+    pthread_rwlock_unlock(&fs->fdt_lock);
+    if(inode_num == -1)
+    return -1;
+    return tiermove(inode_num, tier);
+}
+
+/* --TIER COUNTERS--
+
+COPIES THE TIER COUNTERS INTO stats. fast_reads / (fast_reads + slow_reads) IS THE SHARE
+OF DATA BLOCK READS THE FAST IMAGE SERVED
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF THE DISK IS ONE IMAGE
+
+*/
+
+int sfs_tier_stats(struct sfs_tier_stats* stats){
+    if(stats == NULL || !fs->mounted || fs->geo.slow_blocks == 0)
+    return -1;
+    int fast, slow;
+    tierfree(&fast, &slow);
+    pthread_mutex_lock(&fs->bcache_lock);
+    *stats = fs->tier_stats;
+    pthread_mutex_unlock(&fs->bcache_lock);
+    stats->fast_free = fast;
+    stats->slow_free = slow;
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS THE TIME IN MICROSECONDS IF CALLS ARE TRACED (SEE --TRACING--), 0 IF THEY ARE NOT
+
+*/
+
+static long long tracestart(void){
+    if(__atomic_load_n(&fs->trace, __ATOMIC_RELAXED) == NULL)
+    return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES THE TRACE LINE OF A CALL THAT STARTED AT start (FROM tracestart), NOTHING IF start IS
+0 OR TRACING HAS STOPPED SINCE
+
+*/
+
+static void traceop(long long start, const char* format, ...){
+    if(start == 0)
+    return;
+    pthread_mutex_lock(&fs->trace_lock);
+    if(fs->trace != NULL){
+        va_list args;
+        va_start(args, format);
+        fprintf(fs->trace, "%lld ", start - fs->trace_epoch);
+        vfprintf(fs->trace, format, args);
+        fputc('\n', fs->trace);
+        va_end(args);
+    }
+    pthread_mutex_unlock(&fs->trace_lock);
+}
+
+/* --TRACE CALLS--
+
+STARTS WRITING A LINE FOR EVERY FILE CALL TO THE FILE path (SEE --TRACING--), REPLACING IT
+IF IT EXISTS. A NULL path STOPS THE TRACE, AND UNMOUNTING STOPS IT TOO
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NOTHING IS MOUNTED OR path CANNOT BE WRITTEN
+
+*/
+
+int sfs_trace(const char* path){
+    FILE* trace = NULL;
+    if(path != NULL){
+        if(!fs->mounted)
+        return -1;
+        trace = fopen(path, "w");
+        if(trace == NULL){
+            printf("Cannot write trace %s\n", path);
+            return -1;
+        }
+        fprintf(trace, "# sfs trace of %s\n", fs->path);
+    }
+    pthread_mutex_lock(&fs->trace_lock);
+    FILE* old = fs->trace;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fs->trace_epoch = now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+    __atomic_store_n(&fs->trace, trace, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&fs->trace_lock);
+    if(old != NULL)
+    fclose(old);
+    return 0;
+}
+
+/* --INSTANCES--
+
+sfs_mount OPENS A DISK FILE AS AN INSTANCE WITH ITS OWN DESCRIPTORS, TABLES, LOCKS,
+JOURNAL AND DISK, SO ONE PROCESS CAN SERVE MANY DISKS FROM MANY THREADS. sfs_use MAKES AN
+INSTANCE THE ONE EVERY sfs_ CALL OF THE CALLING THREAD WORKS ON; THE HANDLE FUNCTIONS
+BELOW DO THAT AROUND ONE CALL. THREADS THAT NEVER CALL sfs_use WORK ON THE DEFAULT
+INSTANCE, THE ONE mksfs MOUNTS ON sfs_disk.
+
+THE HANDLE FUNCTIONS COVER THE FILE CALLS ONLY: EVERY OTHER CALL (DIRECTORY, SNAPSHOTS,
+fsck, MODES, COUNTERS) REACHES AN INSTANCE THROUGH sfs_use. A THREAD STAYS BOUND UNTIL IT
+CALLS sfs_use AGAIN, sfs_use(NULL) WHEN IT IS DONE WITH THE INSTANCE, AND sfs_umount
+REFUSES AN INSTANCE THAT ANOTHER THREAD IS STILL BOUND TO, WITH sfs_use OR INSIDE A
+HANDLE FUNCTION. ONCE sfs_umount HAS STARTED NO THREAD CAN BIND THE INSTANCE AGAIN.
+
+*/
+
+/* --HELPER FUNCTION--
+
+COUNTS THE CALLING THREAD AS A USER OF f (SEE sfs_umount) AND MAKES f ITS INSTANCE
+RETURNS THE INSTANCE IT REPLACES OR,
+RETURNS NULL IF f IS NULL OR BEING UNMOUNTED
+
+*/
+
+static struct sfs* fsenter(struct sfs* f){
+    if(f == NULL)
+    return NULL;
+    int n = __atomic_load_n(&f->users, __ATOMIC_RELAXED);
+    do{
+        if(n < 0)
+        return NULL;
+    } while(!__atomic_compare_exchange_n(&f->users, &n, n + 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    return fsbind(f);
+}
+
+/* --HELPER FUNCTION--
+
+UNDOES fsenter: MAKES prev THE INSTANCE OF THE CALLING THREAD AGAIN AND STOPS COUNTING IT
+AS A USER OF f
+
+*/
+
+static void fsleave(struct sfs* f, struct sfs* prev){
+    fsbind(prev);
+    __atomic_sub_fetch(&f->users, 1, __ATOMIC_RELEASE);
+}
+
+/* --HELPER FUNCTION--
+
+UNMOUNTS AN INSTANCE IF IT IS MOUNTED AND FREES IT
+
+*/
+
+static void fsfree(struct sfs* f){
+    struct sfs* prev = fsbind(f);
+    sfs_unmount();
+    sfsreset();
+    fsbind(prev);
+    pthread_rwlock_destroy(&f->io_lock);
+    pthread_rwlock_destroy(&f->fdt_lock);
+    pthread_rwlock_destroy(&f->dir_lock);
+    pthread_mutex_destroy(&f->alloc_lock);
+    pthread_mutex_destroy(&f->dedup_lock);
+    pthread_mutex_destroy(&f->dcache_lock);
+    pthread_mutex_destroy(&f->scratch_lock);
+    pthread_mutex_destroy(&f->bcache_lock);
+    pthread_mutex_destroy(&f->prefetch_lock);
+    pthread_mutex_destroy(&f->grow_lock);
+    pthread_mutex_destroy(&f->trace_lock);
+    jnl_destroy(f->jnl);
+    disk_destroy(f->disk);
+    free(f->path);
+    free(f->slow_path);
+    free(f);
+}
+
+/* --MOUNT--
+
+MOUNTS THE DISK FILE path AS A NEW INSTANCE. WITH opts->create A NEW FILE SYSTEM IS MADE
+WITH THE GEOMETRY IN opts (0 FIELDS TAKE THE GEOMETRY OF mksfs(1)), OTHERWISE (OR IF opts
+IS NULL) THE EXISTING ONE IS MOUNTED. A DISK WITH A SLOW TIER (SEE --TIERS--) IS MADE AND
+MOUNTED WITH ITS SECOND IMAGE IN opts->slow_path, AND STARTS ITS TIER THREAD
+RETURNS THE INSTANCE OR,
+RETURNS NULL ON FAILURE
+
+*/
+
+sfs_t* sfs_mount(const char* path, const struct sfs_mount_opts* opts){
+    if(path == NULL)
+    return NULL;
+    struct sfs* f = calloc(1, sizeof(struct sfs));
+    if(f == NULL)
+    return NULL;
+    f->fdt_free = -1;
+    pthread_rwlock_init(&f->io_lock, NULL);
+    pthread_rwlock_init(&f->fdt_lock, NULL);
+    pthread_rwlock_init(&f->dir_lock, NULL);
+    pthread_mutex_init(&f->alloc_lock, NULL);
+    pthread_mutex_init(&f->dedup_lock, NULL);
+    pthread_mutex_init(&f->dcache_lock, NULL);
+    pthread_mutex_init(&f->scratch_lock, NULL);
+    pthread_mutex_init(&f->bcache_lock, NULL);
+    pthread_mutex_init(&f->prefetch_lock, NULL);
+    pthread_mutex_init(&f->grow_lock, NULL);
+    pthread_mutex_init(&f->trace_lock, NULL);
+    f->path = strdup(path);
+    f->disk = disk_create();
+    f->jnl = jnl_create();
+    if(opts != NULL && opts->slow_path != NULL){
+        f->slow_path = strdup(opts->slow_path);
+        f->slow_size = opts->slow_size;
+        f->slow_latency = opts->slow_latency;
+    }
+    if(f->path == NULL || f->disk == NULL || f->jnl == NULL || (opts != NULL && opts->slow_path != NULL && f->slow_path == NULL)){
+        fsfree(f);
+        return NULL;
+    }
+
+    struct sfs* prev = fsbind(f);
+    if(opts != NULL && opts->create){
+        int block_size = opts->block_size > 0 ? opts->block_size : DEFAULT_BLOCK_SIZE;
+        long long disk_size = opts->disk_size > 0 ? opts->disk_size : (long long)block_size * DEFAULT_NUM_BLOCKS;
+        int num_inodes = opts->num_inodes > 0 ? opts->num_inodes : DEFAULT_NUM_INODES;
+        sfs_mkfs(block_size, disk_size, num_inodes);
+    }
+    else
+    mksfs(0);
+    if(f->mounted && f->geo.slow_blocks > 0 && tierstart() != 0)
+    sfs_unmount();
+    int mounted = f->mounted;
+    fsbind(prev);
+    if(!mounted){
+        fsfree(f);
+        return NULL;
+    }
+    return f;
+}
+
+/* --UNMOUNT AN INSTANCE--
+
+UNMOUNTS AN INSTANCE MADE BY sfs_mount AND FREES IT. THE CALLING THREAD MAY STILL BE BOUND
+TO IT (IT IS MOVED BACK TO THE DEFAULT INSTANCE), NO OTHER THREAD MAY (SEE --INSTANCES--)
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF fsys IS NULL OR ANOTHER THREAD IS STILL BOUND TO IT
+
+*/
+
+int sfs_umount(sfs_t* fsys){
+    if(fsys == NULL)
+    return -1;
+    //--ONLY THE CALLER'S OWN BINDING MAY BE LEFT, AND NO THREAD CAN BIND IT FROM NOW ON--
+    int users = fs == fsys ? 1 : 0;
+    if(!__atomic_compare_exchange_n(&fsys->users, &users, -1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+        printf("%s is still in use by another thread\n", fsys->path);
+        return -1;
+    }
+    if(fs == fsys)
+    fsbind(&sfs_default);
+    fsfree(fsys);
+    return 0;
+}
+
+/* --USE AN INSTANCE--
+
+MAKES fsys (THE DEFAULT INSTANCE IF NULL) THE INSTANCE OF EVERY LATER sfs_ CALL OF THE
+CALLING THREAD, WHICH STAYS BOUND TO IT UNTIL ITS NEXT sfs_use. AN INSTANCE BEING
+UNMOUNTED IS NOT BOUND, THE THREAD KEEPS THE ONE IT HAS
+RETURNS THE INSTANCE IT REPLACES, NULL FOR THE DEFAULT ONE
+
+*/
+
+sfs_t* sfs_use(sfs_t* fsys){
+    struct sfs* prev = fs;
+    if(fsys == NULL)
+    fsbind(&sfs_default);
+    else if(fsenter(fsys) == NULL)
+    return prev == &sfs_default ? NULL : prev;
+    if(prev != &sfs_default)
+    __atomic_sub_fetch(&prev->users, 1, __ATOMIC_RELEASE);
+    return prev == &sfs_default ? NULL : prev;
+}
+
+//--THE FILE CALLS ON AN INSTANCE, EACH RUNS THE CALL OF THE SAME MEANING ON fsys (-1 IF IT IS BEING UNMOUNTED)--
+
+int sfs_open(sfs_t* fsys, char* name){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
+    return -1;
+    int res = sfs_fopen(name);
+    fsleave(fsys, prev);
+    return res;
+}
+
+int sfs_close(sfs_t* fsys, int fileID){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
+    return -1;
+    int res = sfs_fclose(fileID);
+    fsleave(fsys, prev);
+    return res;
+}
+
+int sfs_write(sfs_t* fsys, int fileID, const char* buf, int length){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
+    return -1;
+    int res = sfs_fwrite(fileID, buf, length);
+    fsleave(fsys, prev);
+    return res;
+}
+
+int sfs_read(sfs_t* fsys, int fileID, char* buf, int length){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
+    return -1;
+    int res = sfs_fread(fileID, buf, length);
+    fsleave(fsys, prev);
+    return res;
+}
+
+int sfs_seek(sfs_t* fsys, int fileID, int loc){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
+    return -1;
+    int res = sfs_fseek(fileID, loc);
+    fsleave(fsys, prev);
+    return res;
+}
+
+int sfs_unlink(sfs_t* fsys, char* name){
+    struct sfs* prev = fsenter(fsys);
+    if(prev == NULL)
     return -1;
+    int res = sfs_remove(name);
+    fsleave(fsys, prev);
+    return res;
 }
@@ -3,8 +3,96 @@
 
 // You can add more into this file.
 
+#define MAXFILENAME 28 //longest file name, including the terminating '\0'
+#define SFS_MAX_SNAPSHOTS 8
+
+//--ONE ENTRY RETURNED BY sfs_readdir_plus--
+struct sfs_dirent {
+    char name[MAXFILENAME];
+    int inode;
+    int size;
+};
+
+//--COUNTERS RETURNED BY sfs_dedup_stats--
+struct sfs_dedup_stats {
+    long long blocks_written; //data blocks written while dedup was on
+    long long blocks_shared; //of those, pointed at a block already on disk
+    long long lookups; //fingerprint index lookups
+    long long probes; //index slots examined by those lookups
+    long long lookup_ns; //time spent hashing and looking up
+    int unique_blocks; //blocks in the fingerprint index
+};
+
+//--REPORT RETURNED BY sfs_defrag_wait AND sfs_defrag_stop--
+struct sfs_defrag_stats {
+    int score_before; //sfs_fragmentation when the pass started
+    int score_after; //and when it ended
+    int files_moved;
+    int blocks_moved;
+};
+
+//--COUNTERS RETURNED BY sfs_log_stats--
+struct sfs_log_stats {
+    long long blocks_appended; //data blocks written at the log head
+    long long device_writes; //write_blocks calls that carried them
+    int free_segments; //empty segments when the counters were read
+    int segments_cleaned; //emptied by the cleaner
+    int blocks_cleaned; //live blocks it moved to do so
+};
+
+//--COUNTERS RETURNED BY sfs_cache_stats--
+struct sfs_cache_stats {
+    long long hits; //data blocks read from the block cache
+    long long misses; //data blocks read from the disk
+    long long readahead; //blocks loaded ahead of sequential readers
+    long long prefetched; //blocks loaded for SFS_FADV_WILLNEED
+    long long evictions;
+    int cached_blocks; //blocks in the cache when the counters were read
+};
+
+//--ADVICE OF sfs_fadvise, THE VALUES OF posix_fadvise--
+#define SFS_FADV_NORMAL 0
+#define SFS_FADV_RANDOM 1
+#define SFS_FADV_SEQUENTIAL 2
+#define SFS_FADV_WILLNEED 3
+#define SFS_FADV_DONTNEED 4
+
+//--COUNTERS RETURNED BY sfs_tier_stats--
+struct sfs_tier_stats {
+    long long fast_reads; //data blocks read from the fast image
+    long long slow_reads; //data blocks read from the slow image
+    long long promotions; //files moved to the fast tier
+    long long demotions; //files moved to the slow tier
+    long long blocks_moved;
+    int fast_free; //free data blocks of each tier when the counters were read
+    int slow_free;
+};
+
+//--TIERS OF sfs_ftier--
+#define SFS_TIER_FAST 0
+#define SFS_TIER_SLOW 1
+
+//--OPTIONS OF sfs_mount--
+struct sfs_mount_opts {
+    int create; //make a new file system instead of mounting the one on disk
+    int block_size; //geometry of the new file system, 0 FOR THE DEFAULT
+    long long disk_size; //both images together
+    int num_inodes; //with create, the directory's included, see sfs_max_files
+    const char* slow_path; //second image holding the slow tier, NULL FOR ONE IMAGE
+    long long slow_size; //bytes of disk_size the slow image holds, with create
+    int slow_latency; //microseconds the slow image takes per block read or written
+};
+
+typedef struct sfs_dir SFS_DIR;
+
+typedef struct sfs sfs_t;
+
 void mksfs(int);
 
+int sfs_mkfs(int, long long, int);
+
+int sfs_max_files(int);
+
 int sfs_getnextfilename(char*);
 
 int sfs_getfilesize(const char*);
@@ -21,4 +109,96 @@ int sfs_fseek(int, int);
 
 int sfs_remove(char*);
 
+int sfs_sync(void);
+
+int sfs_unmount(void);
+
+int sfs_fsck(void);
+
+SFS_DIR* sfs_opendir(void);
+
+int sfs_readdir_plus(SFS_DIR*, struct sfs_dirent*, int);
+
+int sfs_telldir(SFS_DIR*);
+
+int sfs_seekdir(SFS_DIR*, int);
+
+int sfs_closedir(SFS_DIR*);
+
+int sfs_create_many(char**, int, int*);
+
+int sfs_stat_many(char**, int, struct sfs_dirent*);
+
+int sfs_remove_many(char**, int, int*);
+
+int sfs_snapshot_create(void);
+
+int sfs_snapshot_open(int, char*);
+
+SFS_DIR* sfs_snapshot_opendir(int);
+
+int sfs_snapshot_delete(int);
+
+int sfs_clone(char*, char*);
+
+int sfs_dedup(int);
+
+int sfs_dedup_stats(struct sfs_dedup_stats*);
+
+int sfs_fcompress(int, int);
+
+int sfs_ftruncate(int, int);
+
+int sfs_fallocate(int, int, int);
+
+int sfs_punch_hole(int, int, int);
+
+int sfs_copy_range(int, int, int, int, int);
+
+int sfs_fragmentation(void);
+
+int sfs_defrag_start(int);
+
+int sfs_defrag_wait(struct sfs_defrag_stats*);
+
+int sfs_defrag_stop(struct sfs_defrag_stats*);
+
+int sfs_logmode(int);
+
+int sfs_log_stats(struct sfs_log_stats*);
+
+long long sfs_heap_allocs(void);
+
+int sfs_fadvise(int, int, int, int);
+
+int sfs_cache_stats(struct sfs_cache_stats*);
+
+int sfs_grow(long long);
+
+int sfs_autogrow(long long);
+
+int sfs_ftier(int, int);
+
+int sfs_tier_stats(struct sfs_tier_stats*);
+
+int sfs_trace(const char*);
+
+sfs_t* sfs_mount(const char*, const struct sfs_mount_opts*);
+
+int sfs_umount(sfs_t*);
+
+sfs_t* sfs_use(sfs_t*);
+
+int sfs_open(sfs_t*, char*);
+
+int sfs_close(sfs_t*, int);
+
+int sfs_write(sfs_t*, int, const char*, int);
+
+int sfs_read(sfs_t*, int, char*, int);
+
+int sfs_seek(sfs_t*, int, int);
+
+int sfs_unlink(sfs_t*, char*);
+
 #endif
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "sfs_api.h"
+#include "disk_emu.h"
+
+/* --IMPORTANT INFORMATION REGARDING sfs_bench--
+
+RUNS THE STANDARD MICROBENCHMARKS AGAINST A FRESH IMAGE AND WRITES THE RESULTS AS JSON:
+
+    sfs_bench [-f FILES] [-b BLOCK_SIZE] [-s DISK_SIZE] [-o OUTPUT] [IMAGE]
+
+IN THIS ORDER, ON ONE IMAGE (BENCH_IMAGE BY DEFAULT):
+
+    create      sfs_fopen OF FILES NEW NAMES
+    open        sfs_fopen OF THE SAME NAMES AGAIN
+    list        ONE PASS OVER THE DIRECTORY WITH sfs_readdir_plus, LIST_PASSES TIMES
+    seq_write   sfs_fwrite OF A SEQ_FILE_SIZE FILE IN CALLS OF EACH OF seq_sizes BYTES
+    seq_read    sfs_fread OF THAT FILE BACK IN CALLS OF THE SAME SIZE
+    rand_read   sfs_fseek AND sfs_fread OF AN ALIGNED 4 KB PIECE OF THE LAST FILE,
+                RAND_READS TIMES
+    remove      sfs_remove OF THE FILES NAMES
+
+THE READS START WITH THE FILE DROPPED FROM THE BLOCK CACHE (SFS_FADV_DONTNEED), SO THEY
+SHOW WHAT THE DEVICE COSTS. FOR EACH BENCHMARK THE OUTPUT GIVES THE CALLS, THE SECONDS
+THEY TOOK, CALLS AND MB PER SECOND, THE 50TH AND 99TH PERCENTILE LATENCY AND THE
+read_blocks AND write_blocks CALLS PER CALL FROM THE COUNTERS OF disk_emu. THE FILE
+SYSTEM'S OWN MESSAGES GO TO /dev/null WHILE THE BENCHMARKS RUN.
+
+*/
+
+#define BENCH_IMAGE "sfs_bench_disk"
+#define BENCH_BLOCK_SIZE 4096
+#define BENCH_DISK_SIZE (256LL << 20)
+#define BENCH_FILES 1000
+#define SEQ_FILE_SIZE (4 << 20) //fits the largest file of 4 KB blocks
+#define RAND_READS 2000
+#define RAND_READ_SIZE 4096
+#define LIST_PASSES 100
+#define MAX_BENCHES 16
+
+static const int seq_sizes[] = {4096, 65536, 1 << 20};
+#define NUM_SEQ_SIZES ((int)(sizeof(seq_sizes) / sizeof(seq_sizes[0])))
+
+struct bench {
+    const char* name;
+    int size; //bytes per call, 0 IF THE CALLS MOVE NO DATA
+    long long* latency; //nanoseconds of each call
+    int count;
+    int failed;
+    long long bytes;
+    long long elapsed; //nanoseconds of the whole benchmark
+    long long reads; //read_blocks calls during the benchmark
+    long long writes; //write_blocks calls during the benchmark
+};
+
+static struct bench benches[MAX_BENCHES];
+static int num_benches = 0;
+
+/* --HELPER FUNCTION--
+
+RETURNS THE TIME IN NANOSECONDS
+
+*/
+
+static long long now_ns(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* --HELPER FUNCTION--
+
+STARTS BENCHMARK name OF UP TO calls CALLS OF size BYTES
+RETURNS THE BENCHMARK OR,
+RETURNS NULL IF OUT OF MEMORY
+
+*/
+
+static struct bench* benchstart(const char* name, int size, int calls){
+    if(num_benches == MAX_BENCHES)
+    return NULL;
+    struct bench* b = &benches[num_benches];
+    memset(b, 0, sizeof(*b));
+    b->name = name;
+    b->size = size;
+    b->latency = malloc(calls * sizeof(long long));
+    if(b->latency == NULL)
+    return NULL;
+    long long blocks_read, blocks_written;
+    disk_counters(&b->reads, &b->writes, &blocks_read, &blocks_written);
+    b->elapsed = now_ns();
+    num_benches++;
+    return b;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS A CALL THAT STARTED AT start AND MOVED bytes (-1 IF IT FAILED) TO b
+
+*/
+
+static void benchcall(struct bench* b, long long start, int bytes){
+    b->latency[b->count++] = now_ns() - start;
+    if(bytes < 0)
+    b->failed++;
+    else
+    b->bytes += bytes;
+}
+
+static void benchstop(struct bench* b){
+    long long reads, writes, blocks_read, blocks_written;
+    b->elapsed = now_ns() - b->elapsed;
+    disk_counters(&reads, &writes, &blocks_read, &blocks_written);
+    b->reads = reads - b->reads;
+    b->writes = writes - b->writes;
+}
+
+/* --HELPER FUNCTION--
+
+DROPS file FROM THE BLOCK CACHE AND OPENS IT AT ITS START
+RETURNS THE FILE DESCRIPTOR OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int coldopen(char* file){
+    int fd = sfs_fopen(file);
+    if(fd == -1)
+    return -1;
+    sfs_fadvise(fd, 0, 0, SFS_FADV_DONTNEED);
+    sfs_fseek(fd, 0);
+    return fd;
+}
+
+static void benchnames(char** names, int files){
+    struct bench* b = benchstart("create", 0, files);
+    for(int i = 0; b != NULL && i < files; i++){
+        long long start = now_ns();
+        int fd = sfs_fopen(names[i]);
+        benchcall(b, start, fd == -1 ? -1 : 0);
+        sfs_fclose(fd);
+    }
+    if(b != NULL)
+    benchstop(b);
+
+    b = benchstart("open", 0, files);
+    for(int i = 0; b != NULL && i < files; i++){
+        long long start = now_ns();
+        int fd = sfs_fopen(names[i]);
+        benchcall(b, start, fd == -1 ? -1 : 0);
+        sfs_fclose(fd);
+    }
+    if(b != NULL)
+    benchstop(b);
+
+    b = benchstart("list", 0, LIST_PASSES);
+    struct sfs_dirent ents[64];
+    for(int pass = 0; b != NULL && pass < LIST_PASSES; pass++){
+        long long start = now_ns();
+        SFS_DIR* dir = sfs_opendir();
+        int seen = 0;
+        int n;
+        while(dir != NULL && (n = sfs_readdir_plus(dir, ents, 64)) > 0){
+            seen += n;
+        }
+        if(dir != NULL)
+        sfs_closedir(dir);
+        benchcall(b, start, seen >= files ? 0 : -1);
+    }
+    if(b != NULL)
+    benchstop(b);
+}
+
+static void benchseq(char* buf){
+    char file[MAXFILENAME];
+    for(int k = 0; k < NUM_SEQ_SIZES; k++){
+        int size = seq_sizes[k];
+        int calls = SEQ_FILE_SIZE / size;
+        sprintf(file, "seq%d", size);
+        struct bench* b = benchstart("seq_write", size, calls);
+        int fd = sfs_fopen(file);
+        for(int i = 0; b != NULL && fd != -1 && i < calls; i++){
+            long long start = now_ns();
+            int n = sfs_fwrite(fd, buf, size);
+            benchcall(b, start, n == size ? n : -1);
+        }
+        sfs_fclose(fd);
+        if(b != NULL)
+        benchstop(b);
+
+        fd = coldopen(file);
+        b = benchstart("seq_read", size, calls);
+        for(int i = 0; b != NULL && fd != -1 && i < calls; i++){
+            long long start = now_ns();
+            int n = sfs_fread(fd, buf, size);
+            benchcall(b, start, n == size ? n : -1);
+        }
+        sfs_fclose(fd);
+        if(b != NULL)
+        benchstop(b);
+    }
+
+    //--THE FILE OF THE LARGEST CALLS IS THE ONE READ AT RANDOM--
+    unsigned int seed = 1;
+    int fd = coldopen(file);
+    sfs_fadvise(fd, 0, 0, SFS_FADV_RANDOM);
+    struct bench* b = benchstart("rand_read", RAND_READ_SIZE, RAND_READS);
+    for(int i = 0; b != NULL && fd != -1 && i < RAND_READS; i++){
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        int offset = (int)(seed % (SEQ_FILE_SIZE / RAND_READ_SIZE)) * RAND_READ_SIZE;
+        long long start = now_ns();
+        sfs_fseek(fd, offset);
+        int n = sfs_fread(fd, buf, RAND_READ_SIZE);
+        benchcall(b, start, n == RAND_READ_SIZE ? n : -1);
+    }
+    sfs_fclose(fd);
+    if(b != NULL)
+    benchstop(b);
+}
+
+static void benchremove(char** names, int files){
+    struct bench* b = benchstart("remove", 0, files);
+    for(int i = 0; b != NULL && i < files; i++){
+        long long start = now_ns();
+        benchcall(b, start, sfs_remove(names[i]) == 0 ? 0 : -1);
+    }
+    if(b != NULL)
+    benchstop(b);
+}
+
+static int cmplatency(const void* a, const void* b){
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS THE pct PERCENTILE OF THE SORTED LATENCIES OF b IN MICROSECONDS
+
+*/
+
+static double percentile(const struct bench* b, int pct){
+    if(b->count == 0)
+    return 0;
+    return b->latency[(long long)(b->count - 1) * pct / 100] / 1e3;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES THE RESULTS OF EVERY BENCHMARK TO out AS ONE JSON OBJECT
+
+*/
+
+static void writejson(FILE* out, const char* image, const struct sfs_mount_opts* opts, int files){
+    fprintf(out, "{\n");
+    fprintf(out, "  \"image\": \"%s\",\n", image);
+    fprintf(out, "  \"block_size\": %d,\n", opts->block_size);
+    fprintf(out, "  \"disk_size\": %lld,\n", opts->disk_size);
+    fprintf(out, "  \"files\": %d,\n", files);
+    fprintf(out, "  \"benchmarks\": [\n");
+    for(int i = 0; i < num_benches; i++){
+        struct bench* b = &benches[i];
+        qsort(b->latency, b->count, sizeof(long long), cmplatency);
+        double secs = b->elapsed / 1e9;
+        int calls = b->count > 0 ? b->count : 1;
+        fprintf(out, "    {\"name\": \"%s\", \"size\": %d, \"ops\": %d, \"failed\": %d, \"seconds\": %.6f, ", b->name, b->size, b->count, b->failed, secs);
+        fprintf(out, "\"ops_per_sec\": %.1f, \"mb_per_sec\": %.2f, ", secs > 0 ? b->count / secs : 0.0, secs > 0 ? b->bytes / secs / 1e6 : 0.0);
+        fprintf(out, "\"p50_us\": %.1f, \"p99_us\": %.1f, ", percentile(b, 50), percentile(b, 99));
+        fprintf(out, "\"reads_per_op\": %.3f, \"writes_per_op\": %.3f}%s\n", (double)b->reads / calls, (double)b->writes / calls, i + 1 < num_benches ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static void usage(void){
+    printf("usage: sfs_bench [-f FILES] [-b BLOCK_SIZE] [-s DISK_SIZE] [-o OUTPUT] [IMAGE]\n");
+}
+
+int main(int argc, char* argv[]){
+    struct sfs_mount_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.create = 1;
+    opts.block_size = BENCH_BLOCK_SIZE;
+    opts.disk_size = BENCH_DISK_SIZE;
+    int files = BENCH_FILES;
+    const char* output = NULL;
+    int c;
+    while((c = getopt(argc, argv, "f:b:s:o:")) != -1){
+        switch(c){
+            case 'f': files = atoi(optarg); break;
+            case 'b': opts.block_size = atoi(optarg); break;
+            case 's': opts.disk_size = atoll(optarg); break;
+            case 'o': output = optarg; break;
+            default: usage(); return 2;
+        }
+    }
+    if(argc - optind > 1 || files < 1){
+        usage();
+        return 2;
+    }
+    const char* image = optind < argc ? argv[optind] : BENCH_IMAGE;
+    opts.num_inodes = files + NUM_SEQ_SIZES + 1;
+    //--THE DIRECTORY MUST NAME EVERY FILE, OR THE CREATES WOULD START FAILING HALFWAY--
+    int max_files = sfs_max_files(opts.block_size);
+    if(max_files != -1 && files + NUM_SEQ_SIZES > max_files){
+        printf("At most %d files fit the directory with %d byte blocks\n", max_files - NUM_SEQ_SIZES, opts.block_size);
+        return 2;
+    }
+
+    char** names = malloc(files * sizeof(char*));
+    char* name_buf = malloc((size_t)files * MAXFILENAME);
+    char* buf = malloc(seq_sizes[NUM_SEQ_SIZES - 1]);
+    if(names == NULL || name_buf == NULL || buf == NULL){
+        printf("Out of memory\n");
+        return 1;
+    }
+    for(int i = 0; i < files; i++){
+        names[i] = name_buf + (size_t)i * MAXFILENAME;
+        sprintf(names[i], "bench%d", i);
+    }
+    for(int i = 0; i < seq_sizes[NUM_SEQ_SIZES - 1]; i++){
+        buf[i] = (char)(i * 7 + i / 251);
+    }
+
+    //--THE FILE SYSTEM'S MESSAGES WOULD SLOW THE CALLS DOWN AND MIX WITH THE JSON--
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    if(saved != -1 && null != -1)
+    dup2(null, STDOUT_FILENO);
+    if(null != -1)
+    close(null);
+    sfs_t* fsys = sfs_mount(image, &opts);
+    if(fsys != NULL){
+        sfs_use(fsys);
+        benchnames(names, files);
+        benchseq(buf);
+        benchremove(names, files);
+        sfs_use(NULL);
+        sfs_umount(fsys);
+    }
+    fflush(stdout);
+    if(saved != -1){
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+
+    int failed = fsys == NULL;
+    if(fsys == NULL)
+    printf("Cannot make %s\n", image);
+    else{
+        FILE* out = output == NULL ? stdout : fopen(output, "w");
+        if(out == NULL){
+            printf("Cannot write %s: %s\n", output, strerror(errno));
+            failed = 1;
+        }
+        else{
+            writejson(out, image, &opts, files);
+            if(out != stdout)
+            fclose(out);
+        }
+    }
+    for(int i = 0; i < num_benches; i++){
+        failed |= benches[i].failed > 0;
+        free(benches[i].latency);
+    }
+    free(names);
+    free(name_buf);
+    free(buf);
+    return failed;
+}
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "sfs_api.h"
+
+/* --IMPORTANT INFORMATION REGARDING sfs_image--
+
+BUILDS AN SFS IMAGE FROM A HOST DIRECTORY OR DUMPS AN IMAGE INTO ONE, LIKE mkfs -d:
+
+    sfs_image import [-j THREADS] [-b BLOCK_SIZE] [-s DISK_SIZE] [-n NUM_INODES] IMAGE DIR
+    sfs_image export [-j THREADS] IMAGE DIR
+
+SFS HAS ONE FLAT DIRECTORY, SO ONLY THE REGULAR FILES DIRECTLY IN DIR ARE IMPORTED, AND
+ONLY IF THEIR NAMES FIT IN MAXFILENAME. IMPORT MAKES A NEW IMAGE SIZED FOR THE FILES (THE
+SMALLEST BLOCK SIZE THAT HOLDS THE LARGEST ONE) UNLESS THE GEOMETRY IS GIVEN, CREATES
+EVERY FILE WITH ONE sfs_create_many CALL, THEN THREADS READ THE HOST FILES IN PARALLEL
+AND WRITE THEM IN CHUNK_SIZE PIECES. EACH sfs_fwrite RESERVES ONE RUN OF BLOCKS FOR THE
+WHOLE PIECE AND SENDS ADJACENT BLOCKS AS ONE DEVICE WRITE. EXPORT STREAMS EVERY FILE BACK
+OUT IN CHUNK_SIZE PIECES THE SAME WAY. THREADS WORK ON THE MOUNTED IMAGE THROUGH sfs_use.
+
+*/
+
+#define DEFAULT_THREADS 4 //one writer per allocation group
+#define CHUNK_SIZE (1 << 20) //bytes moved by one call
+#define MIN_BLOCK_SIZE 512
+#define MAX_BLOCK_SIZE 65536
+#define MAX_FILE_SIZE(bs) ((12LL + (bs) / 4) * (bs)) //12 direct pointers and one indirect block
+#define OVERHEAD_BLOCKS 128 //superblock, journal and rounding of the layout
+
+struct image_file {
+    char name[MAXFILENAME];
+    long long size;
+};
+
+struct image_job {
+    sfs_t* fsys;
+    const char* dir;
+    struct image_file* files;
+    int* status; //i-node from sfs_create_many, -1 IF THE FILE WAS NOT CREATED
+    int count;
+    int next; //next file to take, shared by the threads
+    int errors;
+    long long bytes;
+};
+
+/* --HELPER FUNCTION--
+
+LISTS THE REGULAR FILES DIRECTLY IN dir THAT FIT IN SFS INTO *files
+RETURNS NUMBER OF FILES OR,
+RETURNS -1 IF dir CANNOT BE READ
+
+*/
+
+static int scandir_files(const char* dir, struct image_file** files){
+    DIR* d = opendir(dir);
+    if(d == NULL){
+        printf("Cannot open %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    int count = 0;
+    int cap = 64;
+    *files = malloc(cap * sizeof(struct image_file));
+    struct dirent* ent;
+    char path[PATH_MAX];
+    struct stat st;
+    while(*files != NULL && (ent = readdir(d)) != NULL){
+        snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+        if(stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+        continue;
+        if(strlen(ent->d_name) >= MAXFILENAME){
+            printf("Skipping %s, name too long\n", ent->d_name);
+            continue;
+        }
+        if(count == cap){
+            cap *= 2;
+            struct image_file* grown = realloc(*files, cap * sizeof(struct image_file));
+            if(grown == NULL){
+                free(*files);
+                *files = NULL;
+                break;
+            }
+            *files = grown;
+        }
+        strcpy((*files)[count].name, ent->d_name);
+        (*files)[count].size = st.st_size;
+        count++;
+    }
+    closedir(d);
+    return *files == NULL ? -1 : count;
+}
+
+/* --HELPER FUNCTION--
+
+PICKS A GEOMETRY FOR count FILES: THE SMALLEST BLOCK SIZE THAT HOLDS THE LARGEST FILE AND
+THE WHOLE DIRECTORY, AND A DISK WITH AN EIGHTH OF FREE SPACE LEFT AFTER THE IMPORT
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF NO BLOCK SIZE FITS
+
+*/
+
+static int pickgeometry(const struct image_file* files, int count, struct sfs_mount_opts* opts){
+    long long largest = 0;
+    for(int i = 0; i < count; i++){
+        if(files[i].size > largest)
+        largest = files[i].size;
+    }
+    if(opts->block_size == 0){
+        opts->block_size = MIN_BLOCK_SIZE;
+        while(opts->block_size < MAX_BLOCK_SIZE && (MAX_FILE_SIZE(opts->block_size) < largest || sfs_max_files(opts->block_size) < count)){
+            opts->block_size *= 2;
+        }
+    }
+    int bs = opts->block_size;
+    if(MAX_FILE_SIZE(bs) < largest || sfs_max_files(bs) < count)
+    return -1;
+    if(opts->num_inodes == 0)
+    opts->num_inodes = count + 1;
+    if(opts->disk_size == 0){
+        long long data = 12; //directory
+        for(int i = 0; i < count; i++){
+            long long blocks = (files[i].size + bs - 1) / bs;
+            data += blocks + (blocks > 12 ? 1 : 0);
+        }
+        long long inode_blocks = ((long long)opts->num_inodes * 256 + bs - 1) / bs;
+        long long blocks = data + data / 8 + inode_blocks + data / bs + OVERHEAD_BLOCKS;
+        opts->disk_size = blocks * bs;
+    }
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF AN IMPORT THREAD: TAKES THE NEXT FILE UNTIL NONE IS LEFT AND COPIES IT FROM THE
+HOST INTO THE IMAGE
+
+*/
+
+static void* importworker(void* arg){
+    struct image_job* job = arg;
+    char* chunk = malloc(CHUNK_SIZE);
+    char path[PATH_MAX];
+    sfs_use(job->fsys);
+    while(chunk != NULL){
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if(i >= job->count)
+        break;
+        if(job->status[i] == -1)
+        continue;
+        snprintf(path, sizeof(path), "%s/%s", job->dir, job->files[i].name);
+        int in = open(path, O_RDONLY);
+        int fd = in == -1 ? -1 : sfs_fopen(job->files[i].name);
+        long long copied = 0;
+        ssize_t n = 0;
+        while(fd != -1 && (n = read(in, chunk, CHUNK_SIZE)) > 0){
+            if(sfs_fwrite(fd, chunk, (int)n) != n)
+            break;
+            copied += n;
+        }
+        if(fd == -1 || n != 0){
+            printf("Failed to import %s\n", job->files[i].name);
+            __atomic_add_fetch(&job->errors, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&job->bytes, copied, __ATOMIC_RELAXED);
+        if(fd != -1)
+        sfs_fclose(fd);
+        if(in != -1)
+        close(in);
+    }
+    free(chunk);
+    sfs_use(NULL);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+BODY OF AN EXPORT THREAD: TAKES THE NEXT FILE UNTIL NONE IS LEFT AND COPIES IT FROM THE
+IMAGE INTO THE HOST DIRECTORY
+
+*/
+
+static void* exportworker(void* arg){
+    struct image_job* job = arg;
+    char* chunk = malloc(CHUNK_SIZE);
+    char path[PATH_MAX];
+    sfs_use(job->fsys);
+    while(chunk != NULL){
+        int i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if(i >= job->count)
+        break;
+        //--NAMES CREATED THROUGH THE FUSE WRAPPER START WITH A SLASH--
+        const char* name = job->files[i].name[0] == '/' ? job->files[i].name + 1 : job->files[i].name;
+        snprintf(path, sizeof(path), "%s/%s", job->dir, name);
+        int fd = sfs_fopen(job->files[i].name);
+        int out = fd == -1 ? -1 : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        long long copied = 0;
+        int n = 0;
+        if(out != -1)
+        sfs_fseek(fd, 0);
+        while(out != -1 && (n = sfs_fread(fd, chunk, CHUNK_SIZE)) > 0){
+            if(write(out, chunk, n) != n)
+            break;
+            copied += n;
+        }
+        if(out == -1 || copied != job->files[i].size){
+            printf("Failed to export %s\n", job->files[i].name);
+            __atomic_add_fetch(&job->errors, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(&job->bytes, copied, __ATOMIC_RELAXED);
+        if(out != -1)
+        close(out);
+        if(fd != -1)
+        sfs_fclose(fd);
+    }
+    free(chunk);
+    sfs_use(NULL);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+RUNS worker ON threads THREADS (IN THE CALLING THREAD IF NONE CAN BE STARTED) AND
+REPORTS THE THROUGHPUT
+
+*/
+
+static void runjob(struct image_job* job, void* (*worker)(void*), int threads, const char* what){
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    while(ids != NULL && started < threads && pthread_create(&ids[started], NULL, worker, job) == 0){
+        started++;
+    }
+    if(started == 0)
+    worker(job);
+    for(int t = 0; t < started; t++){
+        pthread_join(ids[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    free(ids);
+    double secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("%s %d files, %lld bytes in %.3f s (%.1f MB/s), %d errors\n", what, job->count, job->bytes, secs,
+           secs > 0 ? job->bytes / secs / 1e6 : 0.0, job->errors);
+}
+
+/* --IMPORT--
+
+MAKES A NEW IMAGE FROM THE FILES IN dir
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int import(const char* image, const char* dir, struct sfs_mount_opts* opts, int threads){
+    struct image_file* files;
+    int count = scandir_files(dir, &files);
+    if(count < 0)
+    return 1;
+    if(pickgeometry(files, count, opts) != 0){
+        printf("No geometry holds the files of %s\n", dir);
+        free(files);
+        return 1;
+    }
+    opts->create = 1;
+    sfs_t* fsys = sfs_mount(image, opts);
+    char** names = malloc((count + 1) * sizeof(char*));
+    int* status = malloc((count + 1) * sizeof(int));
+    if(fsys == NULL || names == NULL || status == NULL){
+        printf("Cannot create %s\n", image);
+        free(files);
+        free(names);
+        free(status);
+        if(fsys != NULL)
+        sfs_umount(fsys);
+        return 1;
+    }
+
+    //--EVERY DIRECTORY ENTRY AND I-NODE IN ONE BATCH--
+    for(int i = 0; i < count; i++){
+        names[i] = files[i].name;
+    }
+    struct image_job job = {fsys, dir, files, status, count, 0, 0, 0};
+    sfs_use(fsys);
+    if(sfs_create_many(names, count, status) < 0){
+        for(int i = 0; i < count; i++){
+            status[i] = -1;
+        }
+    }
+    sfs_use(NULL);
+    for(int i = 0; i < count; i++){
+        if(status[i] == -1){
+            printf("Failed to create %s\n", files[i].name);
+            job.errors++;
+        }
+    }
+
+    runjob(&job, importworker, threads, "Imported");
+    sfs_umount(fsys);
+    free(names);
+    free(status);
+    free(files);
+    return job.errors == 0 ? 0 : 1;
+}
+
+/* --EXPORT--
+
+COPIES EVERY FILE OF AN IMAGE INTO dir, WHICH IS CREATED IF NEEDED
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int export(const char* image, const char* dir, int threads){
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST){
+        printf("Cannot create %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+    sfs_t* fsys = sfs_mount(image, NULL);
+    if(fsys == NULL){
+        printf("Cannot mount %s\n", image);
+        return 1;
+    }
+    sfs_use(fsys);
+    int count = 0;
+    int cap = 64;
+    struct image_file* files = malloc(cap * sizeof(struct image_file));
+    struct sfs_dirent ents[64];
+    SFS_DIR* d = sfs_opendir();
+    int n;
+    while(files != NULL && d != NULL && (n = sfs_readdir_plus(d, ents, 64)) > 0){
+        for(int i = 0; i < n && files != NULL; i++){
+            if(count == cap){
+                cap *= 2;
+                struct image_file* grown = realloc(files, cap * sizeof(struct image_file));
+                if(grown == NULL)
+                free(files);
+                files = grown;
+                if(files == NULL)
+                break;
+            }
+            strcpy(files[count].name, ents[i].name);
+            files[count].size = ents[i].size;
+            count++;
+        }
+    }
+    if(d != NULL)
+    sfs_closedir(d);
+    sfs_use(NULL);
+    if(files == NULL || d == NULL){
+        free(files);
+        sfs_umount(fsys);
+        return 1;
+    }
+
+    struct image_job job = {fsys, dir, files, NULL, count, 0, 0, 0};
+    runjob(&job, exportworker, threads, "Exported");
+    sfs_umount(fsys);
+    free(files);
+    return job.errors == 0 ? 0 : 1;
+}
+
+static void usage(void){
+    printf("usage: sfs_image import [-j THREADS] [-b BLOCK_SIZE] [-s DISK_SIZE] [-n NUM_INODES] IMAGE DIR\n");
+    printf("       sfs_image export [-j THREADS] IMAGE DIR\n");
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        usage();
+        return 2;
+    }
+    struct sfs_mount_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    int threads = DEFAULT_THREADS;
+    int c;
+    optind = 2;
+    while((c = getopt(argc, argv, "j:b:s:n:")) != -1){
+        switch(c){
+            case 'j': threads = atoi(optarg); break;
+            case 'b': opts.block_size = atoi(optarg); break;
+            case 's': opts.disk_size = atoll(optarg); break;
+            case 'n': opts.num_inodes = atoi(optarg); break;
+            default: usage(); return 2;
+        }
+    }
+    if(argc - optind != 2 || threads < 1){
+        usage();
+        return 2;
+    }
+    if(strcmp(argv[1], "import") == 0)
+    return import(argv[optind], argv[optind + 1], &opts, threads);
+    if(strcmp(argv[1], "export") == 0)
+    return export(argv[optind], argv[optind + 1], threads);
+    usage();
+    return 2;
+}
@@ -0,0 +1,738 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sfs_journal.h"
+#include "disk_emu.h"
+
+/* --IMPORTANT INFORMATION REGARDING THE JOURNAL--
+
+EVERY METADATA BLOCK WRITE (SUPERBLOCK, I-NODE TABLE, DIRECTORY, BYTEMAP) IS STAGED
+IN MEMORY INSTEAD OF BEING WRITTEN IN PLACE. THE STAGED BLOCKS OF MANY OPERATIONS ARE
+COMMITTED TOGETHER AS ONE TRANSACTION WITH A SINGLE SEQUENTIAL WRITE TO THE JOURNAL
+REGION. WHEN THE JOURNAL FILLS UP, COMMITTED BLOCKS ARE CHECKPOINTED TO THEIR HOME
+LOCATIONS AND THE JOURNAL IS RESET.
+
+JOURNAL LAYOUT: 1 (JOURNAL SUPERBLOCK) + TRANSACTIONS
+TRANSACTION LAYOUT: 1 (DESCRIPTOR) + N (BLOCK IMAGES) + 1 (COMMIT RECORD)
+
+A TRANSACTION IS ONLY REPLAYED ON MOUNT IF ITS COMMIT RECORD IS PRESENT AND ITS
+CHECKSUM MATCHES, SO THE BLOCKS OF A TRANSACTION REACH THEIR HOME LOCATIONS ALL
+TOGETHER OR NOT AT ALL.
+
+THE STAGED COPIES, THE TRANSACTION BUFFER AND THE JOURNAL SUPERBLOCK ARE CARVED OUT OF
+BUFFERS ALLOCATED BY jnl_init, SO STAGING, COMMITTING AND CHECKPOINTING NEVER ALLOCATE.
+
+LOCKING: jnl->lock (READERS/WRITER) GUARDS THE STAGED BLOCKS. jnl->txn_lock GUARDS THE
+COUNT OF OPERATIONS IN FLIGHT; A COMMIT WAITS FOR THAT COUNT TO DRAIN AND HOLDS OFF
+NEW OPERATIONS UNTIL IT IS DONE. ALWAYS TAKE txn_lock BEFORE lock.
+
+ROOM: A TRANSACTION ONLY HOLDS max_txn BLOCKS, AND COMMITTING IT WHILE AN OPERATION IS
+HALFWAY THROUGH WOULD MAKE THAT HALF DURABLE ON ITS OWN. SO jnl_begin ONLY LETS AN
+OPERATION IN WHILE EVERY OPERATION IN FLIGHT, ITSELF INCLUDED, HAS JNL_OP_BLOCKS OF
+THE TRANSACTION LEFT, AND OTHERWISE HAS THE RUNNING ONE COMMITTED FIRST. OPERATIONS
+THAT CAN TOUCH MORE BLOCKS THAN THAT (BATCHES, SNAPSHOTS, fsck, GROWING) START WITH
+jnl_begin_excl AND RUN ALONE: THEY ARE THE ONLY ONES THAT MAY BE SPLIT ACROSS
+TRANSACTIONS, AT A POINT OF THEIR CHOICE (jnl_split) OR WHEN THE TRANSACTION FILLS UP.
+
+*/
+
+#define JNL_MAGIC_SUPER 0x4c4e4a53
+#define JNL_MAGIC_DESC 0x43534544
+#define JNL_MAGIC_COMMIT 0x544d4f43
+#define JNL_GROUP_OPS 16 //operations batched into one transaction
+#define JNL_OP_BLOCKS 8 //blocks of the running transaction kept free for each operation in flight
+
+struct jnl_super {
+    int magic;
+    int seq;
+};
+
+struct jnl_desc {
+    int magic;
+    int seq;
+    int count;
+    int homes[];
+};
+
+struct jnl_commit {
+    int magic;
+    int seq;
+    int count;
+    unsigned int checksum;
+};
+
+struct jnl_slot {
+    int home;
+    int dirty; //staged in the running transaction, not yet committed
+    char* data;
+    char* committed; //image committed before the running transaction changed it, NULL IF NONE
+};
+
+struct jnl_state {
+    pthread_rwlock_t lock;
+    pthread_mutex_t txn_lock;
+    pthread_cond_t txn_cond;
+    int active; //operations in flight
+    int exclusive; //an operation of jnl_begin_excl runs or waits for the others to leave
+    int commit_wanted;
+    int start;
+    int nblocks;
+    int block_size;
+    int seq;
+    int tail;
+    int ops;
+    int max_txn;
+    int max_slots;
+    int nslots;
+    int ndirty;
+    struct jnl_slot* slots;
+    char* pool; //max_slots + max_txn BLOCKS, ONE PER SLOT AND ONE PER committed COPY
+    char** spare; //blocks of the pool no slot is using
+    int nspare;
+    char* txn_buffer; //descriptor, max_txn block images and commit record
+    long long allocs; //heap allocations made by the journal
+};
+
+static struct jnl_state jnl_default = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER,
+    .txn_lock = PTHREAD_MUTEX_INITIALIZER,
+    .txn_cond = PTHREAD_COND_INITIALIZER,
+};
+static __thread struct jnl_state* jnl = &jnl_default; //journal of the calling thread, see jnl_bind
+
+static __thread int jnl_depth; //nesting of jnl_begin in the calling thread
+static __thread int jnl_owner; //the calling thread's operation runs alone, see jnl_begin_excl
+
+static int jnl_commit_locked(void);
+
+/* --HELPER FUNCTION--
+
+ALLOCATES size BYTES FOR THE JOURNAL AND COUNTS THE ALLOCATION
+RETURNS THE MEMORY OR NULL ON FAILURE
+
+*/
+
+static void* jnl_alloc(size_t size){
+    void* p = malloc(size);
+    if(p != NULL)
+    __atomic_add_fetch(&jnl->allocs, 1, __ATOMIC_RELAXED);
+    return p;
+}
+
+/* --HELPER FUNCTION--
+
+CHECKSUM OVER THE HOME ADDRESSES AND BLOCK IMAGES OF A TRANSACTION (FNV-1A)
+
+*/
+
+static unsigned int jnl_checksum(const int* homes, const char* data, int count, int block_size){
+    unsigned int h = 2166136261u;
+    const unsigned char* p = (const unsigned char*) homes;
+    for(int i = 0; i < count * (int)sizeof(int); i++){
+        h = (h ^ p[i]) * 16777619u;
+    }
+    p = (const unsigned char*) data;
+    for(int i = 0; i < count * block_size; i++){
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+/* --HELPER FUNCTION--
+
+FINDS THE STAGED COPY OF A HOME BLOCK
+RETURNS SLOT OR NULL IF THE BLOCK IS NOT IN THE JOURNAL
+
+*/
+
+static struct jnl_slot* jnl_find(int home){
+    for(int i = 0; i < jnl->nslots; i++){
+        if(jnl->slots[i].home == home)
+        return &jnl->slots[i];
+    }
+    return NULL;
+}
+
+static int jnl_write_super(void){
+    //--NEVER CALLED WHILE A TRANSACTION IS BEING BUILT IN txn_buffer--
+    char* buffer = jnl->txn_buffer;
+    memset(buffer, 0, jnl->block_size);
+    struct jnl_super* js = (struct jnl_super*) buffer;
+    js->magic = JNL_MAGIC_SUPER;
+    js->seq = jnl->seq;
+    return write_blocks(jnl->start, 1, buffer) == 1 ? 0 : -1;
+}
+
+static int jnl_cmp_home(const void* a, const void* b){
+    return ((const struct jnl_slot*)a)->home - ((const struct jnl_slot*)b)->home;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES EVERY COMMITTED BLOCK TO ITS HOME LOCATION (IN BLOCK ORDER) AND RESETS THE JOURNAL.
+BLOCKS OF THE RUNNING TRANSACTION STAY STAGED, THE ONES THAT WERE COMMITTED BEFORE IT
+CHANGED THEM HAVE THAT IMAGE WRITTEN HOME, SINCE THE RESET DROPS IT FROM THE JOURNAL.
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int jnl_checkpoint_committed(void){
+    qsort(jnl->slots, jnl->nslots, sizeof(struct jnl_slot), jnl_cmp_home);
+    int kept = 0;
+    for(int i = 0; i < jnl->nslots; i++){
+        struct jnl_slot* s = &jnl->slots[i];
+        if(s->dirty){
+            if(s->committed != NULL){
+                if(write_blocks(s->home, 1, s->committed) != 1)
+                return -1;
+                jnl->spare[jnl->nspare++] = s->committed;
+                s->committed = NULL;
+            }
+            jnl->slots[kept++] = *s;
+            continue;
+        }
+        if(write_blocks(s->home, 1, s->data) != 1)
+        return -1;
+        jnl->spare[jnl->nspare++] = s->data;
+    }
+    jnl->nslots = kept;
+    jnl->tail = 1;
+    return jnl_write_super();
+}
+
+int jnl_init(int start, int nblocks, int block_size){
+    jnl_shutdown();
+    jnl->start = start;
+    jnl->nblocks = nblocks;
+    jnl->block_size = block_size;
+    jnl->seq = 1;
+    jnl->tail = 1;
+    jnl->active = 0;
+    jnl->commit_wanted = 0;
+    jnl->ops = 0;
+    jnl->max_txn = nblocks - 3;
+    if(jnl->max_txn > (block_size - (int)sizeof(struct jnl_desc)) / (int)sizeof(int))
+    jnl->max_txn = (block_size - (int)sizeof(struct jnl_desc)) / (int)sizeof(int);
+    if(jnl->max_txn <= 0){
+        printf("Journal region too small\n");
+        return -1;
+    }
+    //--COMMITTED BLOCKS NEVER OUTNUMBER THE JOURNAL, RUNNING ONES (AND THEIR committed
+    //--COPIES) NEVER OUTNUMBER A TRANSACTION--
+    jnl->max_slots = nblocks + jnl->max_txn;
+    jnl->nslots = 0;
+    jnl->ndirty = 0;
+    int pool = jnl->max_slots + jnl->max_txn;
+    jnl->slots = jnl_alloc(jnl->max_slots * sizeof(struct jnl_slot));
+    jnl->pool = jnl_alloc((size_t)pool * block_size);
+    jnl->spare = jnl_alloc(pool * sizeof(char*));
+    jnl->txn_buffer = jnl_alloc((size_t)(jnl->max_txn + 2) * block_size);
+    if(jnl->slots == NULL || jnl->pool == NULL || jnl->spare == NULL || jnl->txn_buffer == NULL){
+        jnl_shutdown();
+        return -1;
+    }
+    for(jnl->nspare = 0; jnl->nspare < pool; jnl->nspare++){
+        jnl->spare[jnl->nspare] = jnl->pool + (size_t)jnl->nspare * block_size;
+    }
+    return 0;
+}
+
+int jnl_format(void){
+    jnl->seq = 1;
+    jnl->tail = 1;
+    return jnl_write_super();
+}
+
+/* --JOURNAL RECOVERY--
+
+REPLAYS EVERY FULLY COMMITTED TRANSACTION FOUND IN THE JOURNAL TO ITS HOME LOCATIONS.
+STOPS AT THE FIRST TRANSACTION WITH A MISSING OR CORRUPT COMMIT RECORD.
+RETURNS NUMBER OF TRANSACTIONS REPLAYED OR,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_recover(void){
+    char* buffer = jnl_alloc((size_t)jnl->block_size * jnl->nblocks);
+    if(buffer == NULL)
+    return -1;
+    if(read_blocks(jnl->start, jnl->nblocks, buffer) != jnl->nblocks){
+        free(buffer);
+        return -1;
+    }
+    struct jnl_super* js = (struct jnl_super*) buffer;
+    if(js->magic != JNL_MAGIC_SUPER){
+        printf("No journal found, formatting journal\n");
+        free(buffer);
+        return jnl_format() == 0 ? 0 : -1;
+    }
+    int seq = js->seq;
+    int tail = 1;
+    int replayed = 0;
+    while(tail + 2 <= jnl->nblocks){
+        struct jnl_desc* d = (struct jnl_desc*)(buffer + tail * jnl->block_size);
+        if(d->magic != JNL_MAGIC_DESC || d->seq != seq)
+        break;
+        if(d->count <= 0 || d->count > jnl->max_txn || tail + d->count + 2 > jnl->nblocks)
+        break;
+        char* data = buffer + (tail + 1) * jnl->block_size;
+        struct jnl_commit* c = (struct jnl_commit*)(data + d->count * jnl->block_size);
+        if(c->magic != JNL_MAGIC_COMMIT || c->seq != seq || c->count != d->count)
+        break;
+        if(c->checksum != jnl_checksum(d->homes, data, d->count, jnl->block_size))
+        break;
+        for(int i = 0; i < d->count; i++){
+            write_blocks(d->homes[i], 1, data + i * jnl->block_size);
+        }
+        replayed++;
+        seq++;
+        tail += d->count + 2;
+    }
+    free(buffer);
+    if(replayed > 0)
+    printf("Replayed %d journal transaction(s)\n", replayed);
+    jnl->seq = seq;
+    jnl->tail = 1;
+    if(jnl_write_super() != 0)
+    return -1;
+    return replayed;
+}
+
+/* --JOURNAL READ--
+
+READS A METADATA BLOCK, PREFERRING THE COPY STAGED IN THE JOURNAL
+RETURNS 1 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_read(int block_num, void* buffer){
+    pthread_rwlock_rdlock(&jnl->lock);
+    struct jnl_slot* s = jnl_find(block_num);
+    if(s != NULL){
+        memcpy(buffer, s->data, jnl->block_size);
+        pthread_rwlock_unlock(&jnl->lock);
+        return 1;
+    }
+    //--NOT STAGED, THE HOME LOCATION IS UP TO DATE--
+    pthread_rwlock_unlock(&jnl->lock);
+    return read_blocks(block_num, 1, buffer);
+}
+
+/* --JOURNAL HOLDS--
+
+RETURNS 1 IF THE JOURNAL HOLDS A COPY OF block_num THAT HAS NOT BEEN CHECKPOINTED, A
+CHECKPOINT OR A REPLAY WOULD STILL WRITE IT TO THE HOME LOCATION. RETURNS 0 OTHERWISE
+
+*/
+
+int jnl_holds(int block_num){
+    pthread_rwlock_rdlock(&jnl->lock);
+    int held = jnl_find(block_num) != NULL;
+    pthread_rwlock_unlock(&jnl->lock);
+    return held;
+}
+
+/* --JOURNAL SEQUENCE--
+
+RETURNS THE SEQUENCE NUMBER OF THE RUNNING TRANSACTION. IT GROWS BY ONE AT EVERY COMMIT,
+SO A CHANGE MADE WHILE IT WAS s IS COMMITTED ONCE IT IS PAST s
+
+*/
+
+int jnl_seq(void){
+    pthread_rwlock_rdlock(&jnl->lock);
+    int seq = jnl->seq;
+    pthread_rwlock_unlock(&jnl->lock);
+    return seq;
+}
+
+/* --JOURNAL READ (RANGE)--
+
+READS nblocks CONTIGUOUS METADATA BLOCKS WITH ONE DISK READ, THEN OVERLAYS THE COPIES
+STAGED IN THE JOURNAL
+RETURNS nblocks ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_read_range(int start, int nblocks, void* buffer){
+    //--HOLD THE LOCK SO NO CHECKPOINT SLIPS BETWEEN THE READ AND THE OVERLAY--
+    pthread_rwlock_rdlock(&jnl->lock);
+    if(read_blocks(start, nblocks, buffer) != nblocks){
+        pthread_rwlock_unlock(&jnl->lock);
+        return -1;
+    }
+    for(int i = 0; i < jnl->nslots; i++){
+        int home = jnl->slots[i].home;
+        if(home >= start && home < start + nblocks)
+        memcpy((char*)buffer + (home - start) * jnl->block_size, jnl->slots[i].data, jnl->block_size);
+    }
+    pthread_rwlock_unlock(&jnl->lock);
+    return nblocks;
+}
+
+/* --HELPER FUNCTION--
+
+FINDS OR CREATES THE STAGED COPY OF A HOME BLOCK AND MARKS IT DIRTY. THE CALLER HOLDS
+jnl->lock FOR WRITING. A NEW SLOT IS FILLED FROM DISK WHEN load IS SET. A COMMITTED SLOT
+KEEPS ITS IMAGE IN committed UNTIL THE RUNNING TRANSACTION COMMITS OR IS CHECKPOINTED.
+RETURNS SLOT OR NULL ON FAILURE
+
+*/
+
+static struct jnl_slot* jnl_stage(int block_num, int load){
+    struct jnl_slot* s = jnl_find(block_num);
+    //--A SINGLE OPERATION OUTGREW A TRANSACTION. ONLY ONE THAT RUNS ALONE MAY COMMIT WHAT
+    //--IT HAS SO FAR, ANY OTHER WOULD ALSO COMMIT THE HALF DONE BLOCKS OF THE REST--
+    if((s == NULL || !s->dirty) && jnl->ndirty >= jnl->max_txn){
+        if(!jnl_owner){
+            printf("Journal transaction full\n");
+            return NULL;
+        }
+        if(jnl_commit_locked() != 0)
+        return NULL;
+        //--A CHECKPOINT MOVES THE SLOTS--
+        s = jnl_find(block_num);
+    }
+    if(s == NULL){
+        char* data = jnl->spare[--jnl->nspare];
+        if(load && read_blocks(block_num, 1, data) != 1){
+            jnl->nspare++;
+            return NULL;
+        }
+        s = &jnl->slots[jnl->nslots++];
+        s->home = block_num;
+        s->dirty = 1;
+        s->data = data;
+        s->committed = NULL;
+        jnl->ndirty++;
+    }
+    if(!s->dirty){
+        s->committed = jnl->spare[--jnl->nspare];
+        memcpy(s->committed, s->data, jnl->block_size);
+        s->dirty = 1;
+        jnl->ndirty++;
+    }
+    return s;
+}
+
+/* --JOURNAL WRITE--
+
+STAGES A METADATA BLOCK IN THE RUNNING TRANSACTION. REPEATED WRITES TO THE SAME BLOCK
+ARE ABSORBED INTO ONE JOURNAL BLOCK.
+RETURNS 1 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_write(int block_num, const void* buffer){
+    pthread_rwlock_wrlock(&jnl->lock);
+    struct jnl_slot* s = jnl_stage(block_num, 0);
+    if(s != NULL)
+    memcpy(s->data, buffer, jnl->block_size);
+    pthread_rwlock_unlock(&jnl->lock);
+    return s != NULL ? 1 : -1;
+}
+
+/* --JOURNAL PATCH--
+
+ATOMICALLY OVERWRITES len BYTES AT offset OF A METADATA BLOCK. USED WHEN SEVERAL
+THREADS UPDATE DIFFERENT RECORDS (I-NODES, BYTEMAP ENTRIES) OF THE SAME BLOCK.
+RETURNS 1 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_patch(int block_num, int offset, const void* src, int len){
+    pthread_rwlock_wrlock(&jnl->lock);
+    struct jnl_slot* s = jnl_stage(block_num, 1);
+    if(s != NULL)
+    memcpy(s->data + offset, src, len);
+    pthread_rwlock_unlock(&jnl->lock);
+    return s != NULL ? 1 : -1;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF THE RUNNING TRANSACTION HAS JNL_OP_BLOCKS LEFT FOR EACH OF ops OPERATIONS,
+0 OTHERWISE
+
+*/
+
+static int jnl_room(int ops){
+    pthread_rwlock_rdlock(&jnl->lock);
+    int room = jnl->ndirty + ops * JNL_OP_BLOCKS <= jnl->max_txn;
+    pthread_rwlock_unlock(&jnl->lock);
+    return room;
+}
+
+/* --HELPER FUNCTION--
+
+COMMITS THE RUNNING TRANSACTION ON BEHALF OF EVERY OPERATION IN IT AND WAKES THE THREADS
+WAITING FOR THAT. CALLER HOLDS txn_lock AND NO OPERATION IS IN FLIGHT
+
+*/
+
+static void jnl_group_commit(void){
+    pthread_rwlock_wrlock(&jnl->lock);
+    jnl_commit_locked();
+    pthread_rwlock_unlock(&jnl->lock);
+    jnl->ops = 0;
+    jnl->commit_wanted = 0;
+    pthread_cond_broadcast(&jnl->txn_cond);
+}
+
+/* --OPERATION BOUNDARIES--
+
+EVERY FILE SYSTEM OPERATION THAT MODIFIES METADATA IS BRACKETED BY jnl_begin/jnl_end.
+A TRANSACTION IS ONLY COMMITTED WHEN NO OPERATION IS IN FLIGHT, SO ALL THE BLOCKS AN
+OPERATION TOUCHES ARE COMMITTED ATOMICALLY. GROUP COMMIT HAPPENS EVERY JNL_GROUP_OPS
+OPERATIONS OR WHEN THE RUNNING TRANSACTION COULD NOT ABSORB ANOTHER OPERATION.
+jnl_begin MAY WAIT FOR A COMMIT, SO IT MUST BE CALLED BEFORE TAKING ANY OTHER LOCK.
+jnl_begin_excl ALSO WAITS FOR THE OPERATIONS IN FLIGHT TO LEAVE AND KEEPS NEW ONES OUT
+UNTIL ITS jnl_end (SEE ROOM ABOVE); INSIDE ANOTHER OPERATION IT ONLY NESTS.
+
+*/
+
+void jnl_begin(void){
+    if(jnl_depth++ > 0)
+    return;
+    pthread_mutex_lock(&jnl->txn_lock);
+    while(jnl->commit_wanted || jnl->exclusive || !jnl_room(jnl->active + 1)){
+        //--NOBODY LEFT TO COMMIT THE FULL TRANSACTION, DO IT HERE--
+        if(!jnl->commit_wanted && !jnl->exclusive && jnl->active == 0){
+            jnl_group_commit();
+            break;
+        }
+        if(!jnl->exclusive)
+        jnl->commit_wanted = 1;
+        pthread_cond_wait(&jnl->txn_cond, &jnl->txn_lock);
+    }
+    jnl->active++;
+    pthread_mutex_unlock(&jnl->txn_lock);
+}
+
+void jnl_begin_excl(void){
+    if(jnl_depth++ > 0)
+    return;
+    pthread_mutex_lock(&jnl->txn_lock);
+    while(jnl->exclusive){
+        pthread_cond_wait(&jnl->txn_cond, &jnl->txn_lock);
+    }
+    //--THE LAST OPERATION TO LEAVE COMMITS, SO THIS ONE STARTS WITH AN EMPTY TRANSACTION--
+    jnl->exclusive = 1;
+    while(jnl->active > 0){
+        jnl->commit_wanted = 1;
+        pthread_cond_wait(&jnl->txn_cond, &jnl->txn_lock);
+    }
+    jnl->active++;
+    jnl_owner = 1;
+    pthread_mutex_unlock(&jnl->txn_lock);
+}
+
+void jnl_end(void){
+    if(jnl_depth == 0 || --jnl_depth > 0)
+    return;
+    pthread_mutex_lock(&jnl->txn_lock);
+    jnl->active--;
+    jnl->ops++;
+    pthread_rwlock_rdlock(&jnl->lock);
+    int full = jnl->ndirty > jnl->max_txn / 2;
+    pthread_rwlock_unlock(&jnl->lock);
+    if(jnl->ops >= JNL_GROUP_OPS || full)
+    jnl->commit_wanted = 1;
+    //--THE LAST OPERATION TO LEAVE COMMITS ON BEHALF OF THE GROUP--
+    if(jnl->commit_wanted && jnl->active == 0)
+    jnl_group_commit();
+    if(jnl_owner){
+        jnl_owner = 0;
+        jnl->exclusive = 0;
+        pthread_cond_broadcast(&jnl->txn_cond);
+    }
+    pthread_mutex_unlock(&jnl->txn_lock);
+}
+
+/* --SPLITTING AN OPERATION--
+
+jnl_full RETURNS 1 IF THE RUNNING TRANSACTION HAS LESS THAN JNL_OP_BLOCKS LEFT, 0
+OTHERWISE. jnl_split COMMITS IT FOR AN OPERATION OF jnl_begin_excl THAT IS AT A POINT
+WHERE ITS BLOCKS SO FAR ARE CONSISTENT ON THEIR OWN, BEFORE IT GOES ON
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE OR IF THE OPERATION DOES NOT RUN ALONE
+
+*/
+
+int jnl_full(void){
+    return !jnl_room(1);
+}
+
+int jnl_split(void){
+    if(!jnl_owner)
+    return -1;
+    pthread_rwlock_wrlock(&jnl->lock);
+    int res = jnl_commit_locked();
+    pthread_rwlock_unlock(&jnl->lock);
+    return res;
+}
+
+/* --JOURNAL COMMIT--
+
+WRITES THE RUNNING TRANSACTION TO THE JOURNAL IN ONE SEQUENTIAL WRITE
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int jnl_commit_locked(void){
+    if(jnl->ndirty == 0)
+    return 0;
+    //--NOT ENOUGH ROOM LEFT IN THE JOURNAL, CHECKPOINT FIRST--
+    if(jnl->tail + jnl->ndirty + 2 > jnl->nblocks && jnl_checkpoint_committed() != 0)
+    return -1;
+
+    int count = jnl->ndirty;
+    char* buffer = jnl->txn_buffer;
+    //--THE BLOCK IMAGES ARE COPIED OVER, ONLY THE DESCRIPTOR AND THE COMMIT RECORD NEED CLEARING--
+    memset(buffer, 0, jnl->block_size);
+    memset(buffer + (size_t)(count + 1) * jnl->block_size, 0, jnl->block_size);
+    struct jnl_desc* d = (struct jnl_desc*) buffer;
+    d->magic = JNL_MAGIC_DESC;
+    d->seq = jnl->seq;
+    d->count = count;
+    char* data = buffer + jnl->block_size;
+    int n = 0;
+    for(int i = 0; i < jnl->nslots; i++){
+        if(jnl->slots[i].dirty){
+            d->homes[n] = jnl->slots[i].home;
+            memcpy(data + n * jnl->block_size, jnl->slots[i].data, jnl->block_size);
+            n++;
+        }
+    }
+    struct jnl_commit* c = (struct jnl_commit*)(data + count * jnl->block_size);
+    c->magic = JNL_MAGIC_COMMIT;
+    c->seq = jnl->seq;
+    c->count = count;
+    c->checksum = jnl_checksum(d->homes, data, count, jnl->block_size);
+
+    int res = write_blocks(jnl->start + jnl->tail, count + 2, buffer);
+    if(res != count + 2)
+    return -1;
+    //--THE NEW IMAGES ARE THE COMMITTED ONES NOW--
+    for(int i = 0; i < jnl->nslots; i++){
+        struct jnl_slot* s = &jnl->slots[i];
+        s->dirty = 0;
+        if(s->committed != NULL){
+            jnl->spare[jnl->nspare++] = s->committed;
+            s->committed = NULL;
+        }
+    }
+    jnl->ndirty = 0;
+    jnl->tail += count + 2;
+    jnl->seq++;
+    return 0;
+}
+
+/* --HELPER FUNCTION--
+
+WAITS UNTIL NO OPERATION IS IN FLIGHT AND BLOCKS NEW ONES. RETURNS WITH jnl->lock HELD
+FOR WRITING. MUST NOT BE CALLED FROM INSIDE AN OPERATION.
+
+*/
+
+static void jnl_quiesce(void){
+    pthread_mutex_lock(&jnl->txn_lock);
+    jnl->commit_wanted = 1;
+    while(jnl->active > 0){
+        pthread_cond_wait(&jnl->txn_cond, &jnl->txn_lock);
+    }
+    pthread_rwlock_wrlock(&jnl->lock);
+}
+
+static void jnl_resume(void){
+    pthread_rwlock_unlock(&jnl->lock);
+    jnl->ops = 0;
+    jnl->commit_wanted = 0;
+    pthread_cond_broadcast(&jnl->txn_cond);
+    pthread_mutex_unlock(&jnl->txn_lock);
+}
+
+int jnl_commit(void){
+    jnl_quiesce();
+    int res = jnl_commit_locked();
+    jnl_resume();
+    return res;
+}
+
+/* --JOURNAL CHECKPOINT--
+
+COMMITS THE RUNNING TRANSACTION AND WRITES EVERYTHING IN THE JOURNAL TO ITS HOME LOCATION
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+int jnl_checkpoint(void){
+    jnl_quiesce();
+    int res = jnl_commit_locked();
+    if(res == 0)
+    res = jnl_checkpoint_committed();
+    jnl_resume();
+    return res;
+}
+
+void jnl_shutdown(void){
+    free(jnl->slots);
+    free(jnl->pool);
+    free(jnl->spare);
+    free(jnl->txn_buffer);
+    jnl->slots = NULL;
+    jnl->pool = NULL;
+    jnl->spare = NULL;
+    jnl->txn_buffer = NULL;
+    jnl->nslots = 0;
+    jnl->nspare = 0;
+    jnl->ndirty = 0;
+}
+
+long long jnl_allocs(void){
+    return __atomic_load_n(&jnl->allocs, __ATOMIC_RELAXED);
+}
+
+/* --JOURNAL INSTANCES--
+
+EACH MOUNTED FILE SYSTEM HAS ITS OWN JOURNAL. jnl_bind MAKES ONE THE JOURNAL OF THE
+CALLING THREAD (NULL FOR THE DEFAULT ONE) AND RETURNS THE JOURNAL IT REPLACES.
+jnl_destroy SHUTS A JOURNAL DOWN AND FREES IT.
+
+*/
+
+struct jnl_state* jnl_create(void){
+    struct jnl_state* j = calloc(1, sizeof(struct jnl_state));
+    if(j == NULL)
+    return NULL;
+    pthread_rwlock_init(&j->lock, NULL);
+    pthread_mutex_init(&j->txn_lock, NULL);
+    pthread_cond_init(&j->txn_cond, NULL);
+    return j;
+}
+
+struct jnl_state* jnl_bind(struct jnl_state* j){
+    struct jnl_state* prev = jnl;
+    jnl = j != NULL ? j : &jnl_default;
+    return prev;
+}
+
+void jnl_destroy(struct jnl_state* j){
+    if(j == NULL)
+    return;
+    struct jnl_state* prev = jnl_bind(j);
+    jnl_shutdown();
+    jnl_bind(prev);
+    pthread_rwlock_destroy(&j->lock);
+    pthread_mutex_destroy(&j->txn_lock);
+    pthread_cond_destroy(&j->txn_cond);
+    free(j);
+}
@@ -0,0 +1,49 @@
+#ifndef SFS_JOURNAL_H
+#define SFS_JOURNAL_H
+
+// Write-ahead journal for SFS metadata blocks (superblock, i-node table,
+// directory blocks, bytemap). Data blocks are written in place.
+
+int jnl_init(int start, int nblocks, int block_size);
+
+int jnl_format(void);
+
+int jnl_recover(void);
+
+int jnl_read(int block_num, void* buffer);
+
+int jnl_read_range(int start, int nblocks, void* buffer);
+
+int jnl_holds(int block_num);
+
+int jnl_seq(void);
+
+int jnl_write(int block_num, const void* buffer);
+
+int jnl_patch(int block_num, int offset, const void* src, int len);
+
+void jnl_begin(void);
+
+void jnl_begin_excl(void);
+
+void jnl_end(void);
+
+int jnl_full(void);
+
+int jnl_split(void);
+
+int jnl_commit(void);
+
+int jnl_checkpoint(void);
+
+void jnl_shutdown(void);
+
+long long jnl_allocs(void);
+
+struct jnl_state* jnl_create(void);
+
+struct jnl_state* jnl_bind(struct jnl_state* j);
+
+void jnl_destroy(struct jnl_state* j);
+
+#endif
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include "sfs_api.h"
+
+/* --IMPORTANT INFORMATION REGARDING sfs_replay--
+
+PLAYS A TRACE OF sfs_* CALLS BACK AGAINST AN IMAGE AND REPORTS HOW FAST EACH KIND OF CALL
+WAS, OR WRITES A TRACE FROM ONE OF THE BUILT-IN PROFILES:
+
+    sfs_replay run [-m] [-t] [-v] [-b BLOCK_SIZE] [-s DISK_SIZE] [-n NUM_INODES] IMAGE TRACE
+    sfs_replay gen [-c CALLS] [-r RATE] [-S SEED] PROFILE TRACE
+
+A TRACE IS THE FILE sfs_trace WRITES FROM A LIVE MOUNT (SEE --TRACING-- IN sfs_api.c): ONE
+CALL PER LINE, THE MICROSECONDS SINCE THE TRACE STARTED, THEN open NAME FD, close FD,
+write FD BYTES, read FD BYTES, seek FD OFFSET OR remove NAME. LINES STARTING WITH # ARE
+SKIPPED. THE DESCRIPTORS OF THE TRACE ARE MAPPED TO THE ONES THE REPLAY GETS, AND WRITES
+WRITE A FIXED PATTERN.
+
+run MAKES A FRESH IMAGE WITH THE GIVEN GEOMETRY (REPLAY_BLOCK_SIZE, REPLAY_DISK_SIZE AND
+REPLAY_NUM_INODES BY DEFAULT) OR WITH -m MOUNTS THE ONE THERE. CALLS GO OUT ONE AFTER THE
+OTHER AS FAST AS THEY RETURN, OR WITH -t AT THE TIMES OF THE TRACE. THE FILE SYSTEM'S OWN
+MESSAGES GO TO /dev/null UNLESS -v. A CALL FAILS IF IT RETURNS AN ERROR OR MOVES FEWER
+BYTES THAN THE TRACE SAYS. FOR EVERY KIND OF CALL THE REPORT GIVES THE CALLS, THE CALLS PER
+SECOND OF THE WHOLE RUN, THE MB/s WHILE IN THOSE CALLS AND THE 50TH, 90TH AND 99TH
+PERCENTILE AND LONGEST LATENCY.
+
+gen WRITES CALLS CALLS OF A PROFILE (FINISHING THE FILE IT IS ON), RATE CALLS PER SECOND
+APART (0 FOR ALL AT ONCE):
+
+    churn       SMALL FILES (1-16 KB) BEING CREATED, READ BACK WHOLE AND REMOVED
+    sequential  LARGE FILES (4 MB) WRITTEN AND THEN READ IN 64 KB CALLS
+    mixed       A SET OF 4-64 KB FILES WITH RANDOM 4 KB READS, APPENDS, CREATES AND REMOVES
+
+*/
+
+#define REPLAY_BLOCK_SIZE 4096 //geometry of the image run makes
+#define REPLAY_DISK_SIZE (256LL << 20)
+#define REPLAY_NUM_INODES 1024
+#define DEFAULT_CALLS 10000
+#define DEFAULT_RATE 1000 //calls per second of a generated trace
+#define CHURN_FILES 64 //names the churn profile cycles through
+#define SEQ_FILE_SIZE (4 << 20)
+#define SEQ_CHUNK (64 << 10)
+#define SEQ_FILES 8 //large files kept before the oldest is removed
+#define MIXED_FILES 256
+#define MIXED_MAX_SIZE (1 << 20) //appends stop at this size
+
+enum { OP_OPEN, OP_CLOSE, OP_WRITE, OP_READ, OP_SEEK, OP_REMOVE, NUM_OPS };
+
+static const char* op_names[NUM_OPS] = {"open", "close", "write", "read", "seek", "remove"};
+
+struct call {
+    long long time; //microseconds since the start of the trace
+    int op;
+    int fd;
+    int arg; //bytes of a write or read, offset of a seek
+    char name[MAXFILENAME];
+};
+
+struct op_stats {
+    long long* latency; //nanoseconds of each call
+    int count;
+    int cap;
+    int failed;
+    long long bytes;
+    long long busy; //nanoseconds spent in the calls
+};
+
+/* --HELPER FUNCTION--
+
+RETURNS THE TIME IN NANOSECONDS
+
+*/
+
+static long long now_ns(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/* --HELPER FUNCTION--
+
+READS THE TRACE AT path INTO *calls
+RETURNS NUMBER OF CALLS OR,
+RETURNS -1 IF THE TRACE CANNOT BE READ
+
+*/
+
+static int loadtrace(const char* path, struct call** calls){
+    FILE* in = fopen(path, "r");
+    if(in == NULL){
+        printf("Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    int count = 0;
+    int cap = 1024;
+    int line_num = 0;
+    *calls = malloc(cap * sizeof(struct call));
+    char line[256];
+    char op[16];
+    char word[64];
+    while(*calls != NULL && fgets(line, sizeof(line), in) != NULL){
+        line_num++;
+        if(line[0] == '#' || line[0] == '\n')
+        continue;
+        if(count == cap){
+            cap *= 2;
+            struct call* grown = realloc(*calls, cap * sizeof(struct call));
+            if(grown == NULL)
+            free(*calls);
+            *calls = grown;
+            if(*calls == NULL)
+            break;
+        }
+        struct call* c = &(*calls)[count];
+        memset(c, 0, sizeof(*c));
+        int fields = sscanf(line, "%lld %15s %63s %d", &c->time, op, word, &c->arg);
+        c->op = -1;
+        for(int i = 0; fields >= 3 && i < NUM_OPS; i++){
+            if(strcmp(op, op_names[i]) == 0)
+            c->op = i;
+        }
+        int ok = c->op != -1;
+        if(c->op == OP_OPEN || c->op == OP_REMOVE){
+            ok = strlen(word) < MAXFILENAME;
+            if(ok)
+            strcpy(c->name, word);
+            c->fd = c->arg;
+            if(c->op == OP_OPEN && fields < 4)
+            ok = 0;
+        }
+        else if(ok){
+            c->fd = atoi(word);
+            if(c->op != OP_CLOSE && fields < 4)
+            ok = 0;
+        }
+        if(!ok || c->fd < 0 || c->arg < 0){
+            printf("Skipping line %d of %s\n", line_num, path);
+            continue;
+        }
+        count++;
+    }
+    fclose(in);
+    return *calls == NULL ? -1 : count;
+}
+
+/* --HELPER FUNCTION--
+
+ADDS A CALL THAT TOOK latency NANOSECONDS AND MOVED bytes TO stats
+RETURNS 0 ON SUCCESS,
+RETURNS -1 IF OUT OF MEMORY
+
+*/
+
+static int record(struct op_stats* stats, long long latency, int bytes){
+    if(stats->count == stats->cap){
+        int cap = stats->cap == 0 ? 1024 : stats->cap * 2;
+        long long* grown = realloc(stats->latency, cap * sizeof(long long));
+        if(grown == NULL)
+        return -1;
+        stats->latency = grown;
+        stats->cap = cap;
+    }
+    stats->latency[stats->count++] = latency;
+    stats->busy += latency;
+    stats->bytes += bytes;
+    return 0;
+}
+
+static int cmplatency(const void* a, const void* b){
+    long long x = *(const long long*)a;
+    long long y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS THE pct PERCENTILE OF THE SORTED LATENCIES OF stats IN MICROSECONDS
+
+*/
+
+static double percentile(const struct op_stats* stats, int pct){
+    if(stats->count == 0)
+    return 0;
+    return stats->latency[(long long)(stats->count - 1) * pct / 100] / 1e3;
+}
+
+/* --HELPER FUNCTION--
+
+PLAYS count CALLS BACK ON THE MOUNTED IMAGE, WITH timed AT THE TIMES OF THE TRACE
+RETURNS THE NANOSECONDS THE RUN TOOK OR,
+RETURNS -1 IF OUT OF MEMORY
+
+*/
+
+static long long replay(const struct call* calls, int count, int timed, struct op_stats* stats){
+    int map_size = 64;
+    int* fdmap = malloc(map_size * sizeof(int));
+    int buf_size = 0;
+    char* buf = NULL;
+    for(int i = 0; i < count; i++){
+        if(calls[i].op == OP_WRITE || calls[i].op == OP_READ){
+            if(calls[i].arg > buf_size)
+            buf_size = calls[i].arg;
+        }
+    }
+    buf = malloc(buf_size + 1);
+    if(fdmap == NULL || buf == NULL){
+        free(fdmap);
+        free(buf);
+        return -1;
+    }
+    for(int i = 0; i < map_size; i++){
+        fdmap[i] = -1;
+    }
+    for(int i = 0; i < buf_size; i++){
+        buf[i] = (char)(i * 7 + i / 251);
+    }
+
+    long long start = now_ns();
+    for(int i = 0; i < count; i++){
+        const struct call* c = &calls[i];
+        if(c->fd >= map_size){
+            int size = map_size;
+            while(size <= c->fd){
+                size *= 2;
+            }
+            int* grown = realloc(fdmap, size * sizeof(int));
+            if(grown == NULL)
+            break;
+            fdmap = grown;
+            for(int k = map_size; k < size; k++){
+                fdmap[k] = -1;
+            }
+            map_size = size;
+        }
+        if(timed){
+            long long wait = start + c->time * 1000 - now_ns();
+            if(wait > 0){
+                struct timespec pause = {wait / 1000000000LL, wait % 1000000000LL};
+                nanosleep(&pause, NULL);
+            }
+        }
+        int fd = fdmap[c->fd];
+        int res = -1;
+        int ok;
+        long long t0 = now_ns();
+        switch(c->op){
+            case OP_OPEN:
+            res = sfs_fopen((char*)c->name);
+            ok = res != -1;
+            break;
+            case OP_CLOSE:
+            ok = fd != -1 && sfs_fclose(fd) == 0;
+            break;
+            case OP_WRITE:
+            ok = fd != -1 && (res = sfs_fwrite(fd, buf, c->arg)) == c->arg;
+            break;
+            case OP_READ:
+            ok = fd != -1 && (res = sfs_fread(fd, buf, c->arg)) == c->arg;
+            break;
+            case OP_SEEK:
+            ok = fd != -1 && sfs_fseek(fd, c->arg) == 0;
+            break;
+            default:
+            ok = sfs_remove((char*)c->name) == 0;
+            break;
+        }
+        long long latency = now_ns() - t0;
+        if(c->op == OP_OPEN)
+        fdmap[c->fd] = res;
+        else if(c->op == OP_CLOSE)
+        fdmap[c->fd] = -1;
+        int moved = (c->op == OP_WRITE || c->op == OP_READ) && res > 0 ? res : 0;
+        if(record(&stats[c->op], latency, moved) != 0)
+        break;
+        if(!ok)
+        stats[c->op].failed++;
+    }
+    long long elapsed = now_ns() - start;
+
+    //--LEAVE NOTHING OPEN BEHIND--
+    for(int i = 0; i < map_size; i++){
+        if(fdmap[i] != -1)
+        sfs_fclose(fdmap[i]);
+    }
+    free(fdmap);
+    free(buf);
+    return elapsed;
+}
+
+/* --RUN--
+
+REPLAYS THE TRACE AT trace ON THE IMAGE AT image AND PRINTS THE REPORT
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int run(const char* image, const char* trace, struct sfs_mount_opts* opts, int timed, int verbose){
+    struct call* calls;
+    int count = loadtrace(trace, &calls);
+    if(count == -1)
+    return 1;
+
+    //--THE FILE SYSTEM'S MESSAGES WOULD DROWN THE REPORT AND SLOW THE CALLS DOWN--
+    int saved = -1;
+    if(!verbose){
+        fflush(stdout);
+        saved = dup(STDOUT_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        if(saved != -1 && null != -1)
+        dup2(null, STDOUT_FILENO);
+        if(null != -1)
+        close(null);
+    }
+    struct op_stats stats[NUM_OPS];
+    memset(stats, 0, sizeof(stats));
+    long long elapsed = -1;
+    sfs_t* fsys = sfs_mount(image, opts);
+    if(fsys != NULL){
+        sfs_use(fsys);
+        elapsed = replay(calls, count, timed, stats);
+        sfs_use(NULL);
+        sfs_umount(fsys);
+    }
+    fflush(stdout);
+    if(saved != -1){
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+    free(calls);
+    if(fsys == NULL || elapsed == -1){
+        printf(fsys == NULL ? "Cannot mount %s\n" : "Out of memory replaying %s\n", fsys == NULL ? image : trace);
+        for(int i = 0; i < NUM_OPS; i++){
+            free(stats[i].latency);
+        }
+        return 1;
+    }
+
+    int total = 0;
+    int failed = 0;
+    for(int i = 0; i < NUM_OPS; i++){
+        total += stats[i].count;
+        failed += stats[i].failed;
+    }
+    double secs = elapsed / 1e9;
+    printf("Replayed %d calls of %s in %.3f s (%.0f calls/s), %d failed\n", total, trace, secs, secs > 0 ? total / secs : 0.0, failed);
+    printf("%-8s %9s %8s %11s %9s %9s %9s %9s %9s\n", "call", "calls", "failed", "calls/s", "MB/s", "p50 us", "p90 us", "p99 us", "max us");
+    for(int i = 0; i < NUM_OPS; i++){
+        struct op_stats* s = &stats[i];
+        if(s->count == 0)
+        continue;
+        qsort(s->latency, s->count, sizeof(long long), cmplatency);
+        printf("%-8s %9d %8d %11.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n", op_names[i], s->count, s->failed,
+               secs > 0 ? s->count / secs : 0.0, s->busy > 0 ? s->bytes / (s->busy / 1e9) / 1e6 : 0.0,
+               percentile(s, 50), percentile(s, 90), percentile(s, 99), percentile(s, 100));
+        free(s->latency);
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+/* --TRACE GENERATOR--
+
+WRITES THE CALLS OF A PROFILE TO A TRACE FILE. EVERY PROFILE KEEPS TRACK OF THE FILES IT
+MADE AND THEIR SIZES SO THAT EVERY CALL OF THE TRACE SUCCEEDS ON A FRESH IMAGE
+
+*/
+
+struct gen {
+    FILE* out;
+    int calls; //calls written so far
+    int limit;
+    int rate;
+    unsigned int seed;
+};
+
+static unsigned int gennext(struct gen* g){
+    g->seed ^= g->seed << 13;
+    g->seed ^= g->seed >> 17;
+    g->seed ^= g->seed << 5;
+    return g->seed;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES ONE CALL, format GIVES WHAT FOLLOWS THE TIME
+
+*/
+
+static void gencall(struct gen* g, const char* format, const char* name, int a, int b){
+    long long time = g->rate > 0 ? g->calls * 1000000LL / g->rate : 0;
+    fprintf(g->out, "%lld ", time);
+    if(name != NULL)
+    fprintf(g->out, format, name, a, b);
+    else
+    fprintf(g->out, format, a, b);
+    fputc('\n', g->out);
+    g->calls++;
+}
+
+/* --HELPER FUNCTION--
+
+WRITES A FILE OF size BYTES IN chunk BYTE CALLS (THE NAME IS OPENED ON FD 0)
+
+*/
+
+static void genwrite(struct gen* g, const char* name, int size, int chunk){
+    gencall(g, "open %s %d", name, 0, 0);
+    for(int done = 0; done < size; done += chunk){
+        gencall(g, "write %d %d", NULL, 0, size - done < chunk ? size - done : chunk);
+    }
+    gencall(g, "close %d", NULL, 0, 0);
+}
+
+/* --HELPER FUNCTION--
+
+READS A WHOLE FILE OF size BYTES IN chunk BYTE CALLS FROM THE START
+
+*/
+
+static void genread(struct gen* g, const char* name, int size, int chunk){
+    gencall(g, "open %s %d", name, 0, 0);
+    gencall(g, "seek %d %d", NULL, 0, 0);
+    for(int done = 0; done < size; done += chunk){
+        gencall(g, "read %d %d", NULL, 0, size - done < chunk ? size - done : chunk);
+    }
+    gencall(g, "close %d", NULL, 0, 0);
+}
+
+static void genchurn(struct gen* g){
+    int size[CHURN_FILES] = {0}; //0 IF THE FILE DOES NOT EXIST
+    char name[MAXFILENAME];
+    while(g->calls < g->limit){
+        int i = gennext(g) % CHURN_FILES;
+        sprintf(name, "churn%d", i);
+        if(size[i] == 0){
+            size[i] = 1024 + gennext(g) % (15 * 1024);
+            genwrite(g, name, size[i], size[i]);
+        }
+        else if(gennext(g) % 2 == 0)
+        genread(g, name, size[i], size[i]);
+        else{
+            gencall(g, "remove %s", name, 0, 0);
+            size[i] = 0;
+        }
+    }
+}
+
+static void gensequential(struct gen* g){
+    char name[MAXFILENAME];
+    for(int n = 0; g->calls < g->limit; n++){
+        if(n >= SEQ_FILES){
+            sprintf(name, "seq%d", n - SEQ_FILES);
+            gencall(g, "remove %s", name, 0, 0);
+        }
+        sprintf(name, "seq%d", n);
+        genwrite(g, name, SEQ_FILE_SIZE, SEQ_CHUNK);
+        genread(g, name, SEQ_FILE_SIZE, SEQ_CHUNK);
+    }
+}
+
+static void genmixed(struct gen* g){
+    int size[MIXED_FILES];
+    char name[MAXFILENAME];
+    for(int i = 0; i < MIXED_FILES && g->calls < g->limit; i++){
+        size[i] = 4096 + gennext(g) % (60 * 1024);
+        sprintf(name, "mixed%d", i);
+        genwrite(g, name, size[i], size[i]);
+    }
+    while(g->calls < g->limit){
+        int i = gennext(g) % MIXED_FILES;
+        int pick = gennext(g) % 100;
+        sprintf(name, "mixed%d", i);
+        if(pick < 70 && size[i] > 0){
+            //--RANDOM 4 KB READ--
+            int offset = (int)(gennext(g) % ((size[i] + 4095) / 4096)) * 4096;
+            gencall(g, "open %s %d", name, 0, 0);
+            gencall(g, "seek %d %d", NULL, 0, offset);
+            gencall(g, "read %d %d", NULL, 0, size[i] - offset < 4096 ? size[i] - offset : 4096);
+            gencall(g, "close %d", NULL, 0, 0);
+        }
+        else if(pick < 90 && size[i] > 0 && size[i] + 4096 <= MIXED_MAX_SIZE){
+            //--sfs_fopen STARTS AT THE END OF THE FILE, SO THIS APPENDS--
+            genwrite(g, name, 4096, 4096);
+            size[i] += 4096;
+        }
+        else if(size[i] == 0){
+            size[i] = 4096 + gennext(g) % (60 * 1024);
+            genwrite(g, name, size[i], size[i]);
+        }
+        else if(pick >= 95){
+            gencall(g, "remove %s", name, 0, 0);
+            size[i] = 0;
+        }
+    }
+}
+
+/* --GENERATE--
+
+WRITES calls CALLS OF PROFILE profile TO trace
+RETURNS 0 ON SUCCESS,
+RETURNS 1 ON FAILURE
+
+*/
+
+static int generate(const char* profile, const char* trace, int calls, int rate, unsigned int seed){
+    void (*gen)(struct gen*) = NULL;
+    if(strcmp(profile, "churn") == 0)
+    gen = genchurn;
+    else if(strcmp(profile, "sequential") == 0)
+    gen = gensequential;
+    else if(strcmp(profile, "mixed") == 0)
+    gen = genmixed;
+    if(gen == NULL){
+        printf("Unknown profile %s\n", profile);
+        return 1;
+    }
+    struct gen g = {fopen(trace, "w"), 0, calls, rate, seed == 0 ? 1 : seed};
+    if(g.out == NULL){
+        printf("Cannot write %s: %s\n", trace, strerror(errno));
+        return 1;
+    }
+    fprintf(g.out, "# sfs_replay %s profile, seed %u\n", profile, seed);
+    gen(&g);
+    fclose(g.out);
+    printf("Wrote %d calls of the %s profile to %s\n", g.calls, profile, trace);
+    return 0;
+}
+
+static void usage(void){
+    printf("usage: sfs_replay run [-m] [-t] [-v] [-b BLOCK_SIZE] [-s DISK_SIZE] [-n NUM_INODES] IMAGE TRACE\n");
+    printf("       sfs_replay gen [-c CALLS] [-r RATE] [-S SEED] churn|sequential|mixed TRACE\n");
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        usage();
+        return 2;
+    }
+    struct sfs_mount_opts opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.create = 1;
+    opts.block_size = REPLAY_BLOCK_SIZE;
+    opts.disk_size = REPLAY_DISK_SIZE;
+    opts.num_inodes = REPLAY_NUM_INODES;
+    int timed = 0;
+    int verbose = 0;
+    int calls = DEFAULT_CALLS;
+    int rate = DEFAULT_RATE;
+    unsigned int seed = 1;
+    int c;
+    optind = 2;
+    while((c = getopt(argc, argv, "mtvb:s:n:c:r:S:")) != -1){
+        switch(c){
+            case 'm': opts.create = 0; break;
+            case 't': timed = 1; break;
+            case 'v': verbose = 1; break;
+            case 'b': opts.block_size = atoi(optarg); break;
+            case 's': opts.disk_size = atoll(optarg); break;
+            case 'n': opts.num_inodes = atoi(optarg); break;
+            case 'c': calls = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 'S': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default: usage(); return 2;
+        }
+    }
+    if(argc - optind != 2 || calls < 1 || rate < 0){
+        usage();
+        return 2;
+    }
+    if(strcmp(argv[1], "run") == 0)
+    return run(argv[optind], argv[optind + 1], &opts, timed, verbose);
+    if(strcmp(argv[1], "gen") == 0)
+    return generate(argv[optind], argv[optind + 1], calls, rate, seed);
+    usage();
+    return 2;
+}
@@ -109,11 +109,15 @@ main(int argc, char **argv)
       fprintf(stderr, "ERROR: creating first test file %s\n", names[i]);
       error_count++;
     }
+    /* A second open gets its own descriptor on the same file. */
     tmp = sfs_fopen(names[i]);
-    if (tmp >= 0 && tmp != fds[i]) {
-      fprintf(stderr, "ERROR: file %s was opened twice\n", names[i]);
+    if (tmp < 0 || tmp == fds[i]) {
+      fprintf(stderr, "ERROR: second open of %s did not get its own descriptor\n", names[i]);
       error_count++;
     }
+    else {
+      sfs_fclose(tmp);
+    }
     filesize[i] = (rand() % (MAX_BYTES-MIN_BYTES)) + MIN_BYTES;
   }
 
@@ -0,0 +1,1076 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "sfs_api.h"
+
+/* --IMPORTANT INFORMATION REGARDING sfs_test3--
+
+CHECKS THE BEHAVIOUR OF THE CALLS BEYOND THE ASSIGNMENT, ONE TEST PER FEATURE:
+
+    journal     A COPY OF THE IMAGE TAKEN WHILE IT IS MOUNTED (A CRASH) REPLAYS TO
+                EVERYTHING SYNCED, AND A BLOCK FREED BY AN UNCOMMITTED CALL STILL HOLDS
+                ITS OLD CONTENT
+    fsck        A DIRTY IMAGE WITH A WIPED BYTEMAP IS REPAIRED WHEN IT IS MOUNTED
+    snapshot    A SNAPSHOT AND A CLONE KEEP THEIR CONTENT WHILE THE ORIGINAL CHANGES, AND
+                THE LIVE FILES STAY WRITABLE WHILE SNAPSHOT FILES ARE OPEN
+    dedup       EQUAL BLOCKS ARE SHARED AND A WRITE TO ONE FILE LEAVES THE OTHERS ALONE
+    compress    COMPRESSED FILES READ BACK WHOLE AND PIECE BY PIECE, ACROSS A REMOUNT
+    truncate    sfs_ftruncate, sfs_fallocate AND sfs_punch_hole SIZES AND CONTENT
+    inline      A FILE THAT FITS THE I-NODE RECORD READS BACK ACROSS A REMOUNT, KEEPS ITS
+                CONTENT WHEN IT GROWS OUT OF IT, AND TRUNCATES EITHER WAY. NO OFFSET GOES
+                PAST THE MAXIMUM FILE SIZE
+    copy        sfs_copy_range SHARES WHOLE BLOCKS (A COPY THE DISK HAS NO ROOM FOR FITS)
+                AND MOVES THE REST THROUGH ITS BUFFER, STOPS AT THE END OF THE SOURCE AND
+                REFUSES OVERLAPPING RANGES OF ONE FILE. A LATER WRITE TO THE SOURCE LEAVES
+                THE COPY ALONE
+    defrag      A PASS LEAVES NO FRAGMENTED FILE AND EVERY FILE UNCHANGED
+    log         FILES WRITTEN IN LOG MODE READ BACK AFTER IT IS TURNED OFF
+    grow        A FULL DISK GROWN WITH sfs_grow TAKES THE REST OF A WRITE, AND WITH
+                sfs_autogrow ONE WRITE LARGER THAN THE FREE SPACE GROWS THE DISK ITSELF
+    fadvise     SFS_FADV_WILLNEED LOADS A RANGE INTO THE BLOCK CACHE, SFS_FADV_DONTNEED DROPS
+                IT AND SFS_FADV_RANDOM STOPS THE READAHEAD, AS sfs_cache_stats COUNTS THEM
+    tiers       sfs_ftier MOVES A FILE TO THE SLOW IMAGE AND BACK
+    batch       sfs_create_many (WHICH SPREADS FILES OVER THE ALLOCATION GROUPS),
+                sfs_stat_many, sfs_remove_many, THE DIRECTORY CURSOR AND ITS CAPACITY
+    heap        ONCE WARM, OPENING, WRITING, READING AND CLOSING A FILE TAKES NOTHING FROM
+                THE HEAP (sfs_heap_allocs DOES NOT MOVE)
+    shared      THREADS WRITING THROUGH ONE DESCRIPTOR GET A RANGE EACH WHILE OTHER
+                THREADS OPEN, CLOSE AND REMOVE FILES
+    trace       sfs_trace WRITES ONE LINE PER CALL IN THE FORMAT sfs_replay READS, AND STOPS
+                WITH sfs_trace(NULL) OR THE UNMOUNT
+    umount      sfs_umount REFUSES AN INSTANCE ANOTHER THREAD IS STILL BOUND TO
+
+EVERY FAILED CHECK PRINTS "ERROR:" AND THE PROGRAM RETURNS THE NUMBER OF FAILED CHECKS.
+THE IMAGES MADE WITH sfs_mount ARE REMOVED AT THE END.
+
+*/
+
+#define TEST_IMAGE "sfs_test3_disk"
+#define CRASH_IMAGE "sfs_test3_crash"
+#define SLOW_IMAGE "sfs_test3_slow"
+#define TRACE_FILE "sfs_test3_trace"
+#define BS 512 //block size of mksfs(1)
+#define INLINE_SIZE 248 //INODE_INLINE_CAPACITY of sfs_api.c
+#define MAX_SIZE ((12 + BS / 4) * BS) //largest file of mksfs(1)
+
+static int error_count = 0;
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+/* --HELPER FUNCTION--
+
+COUNTS AND REPORTS A FAILED CHECK
+
+*/
+
+static void check(int ok, const char* cond, int line){
+    if(ok)
+    return;
+    fprintf(stderr, "ERROR: line %d: %s\n", line, cond);
+    error_count++;
+}
+
+/* --HELPER FUNCTION--
+
+FILLS buf WITH n BYTES THAT DEPEND ON seed AND DO NOT REPEAT FROM BLOCK TO BLOCK
+
+*/
+
+static void fill(char* buf, int n, int seed){
+    for(int i = 0; i < n; i++)
+    buf[i] = (char)(i * 7 + seed * 13 + i / 300);
+}
+
+/* --HELPER FUNCTION--
+
+WRITES size BYTES OF fill(seed) TO THE END OF FILE name
+RETURNS NUMBER OF BYTES WRITTEN
+
+*/
+
+static int writefile(char* name, int size, int seed){
+    char* buf = malloc(size);
+    fill(buf, size, seed);
+    int fd = sfs_fopen(name);
+    int n = sfs_fwrite(fd, buf, size);
+    sfs_fclose(fd);
+    free(buf);
+    return n;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF THE FILE OPEN AS fd HOLDS EXACTLY THE size BYTES OF expect, 0 IF NOT
+
+*/
+
+static int samefd(int fd, const char* expect, int size){
+    char* buf = malloc(size + 1);
+    sfs_fseek(fd, 0);
+    int n = sfs_fread(fd, buf, size + 1);
+    int ok = fd >= 0 && n == size && memcmp(buf, expect, size) == 0;
+    free(buf);
+    return ok;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF FILE name HOLDS EXACTLY THE size BYTES OF expect, 0 IF NOT
+
+*/
+
+static int samefile(char* name, const char* expect, int size){
+    int fd = sfs_fopen(name);
+    int ok = samefd(fd, expect, size);
+    sfs_fclose(fd);
+    return ok;
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF FILE name HOLDS EXACTLY size BYTES OF fill(seed), 0 IF NOT
+
+*/
+
+static int checkfile(char* name, int size, int seed){
+    char* expect = malloc(size);
+    fill(expect, size, seed);
+    int ok = samefile(name, expect, size);
+    free(expect);
+    return ok;
+}
+
+/* --HELPER FUNCTION--
+
+COPIES THE DISK FILE src TO dst, WHAT A CRASH WOULD LEAVE ON DISK IF src IS MOUNTED
+RETURNS 0 ON SUCCESS,
+RETURNS -1 ON FAILURE
+
+*/
+
+static int copyimage(const char* src, const char* dst){
+    FILE* in = fopen(src, "rb");
+    FILE* out = fopen(dst, "wb");
+    char buf[4096];
+    size_t n;
+    int res = in != NULL && out != NULL ? 0 : -1;
+    while(res == 0 && (n = fread(buf, 1, sizeof(buf), in)) > 0){
+        if(fwrite(buf, 1, n, out) != n)
+        res = -1;
+    }
+    if(in != NULL)
+    fclose(in);
+    if(out != NULL && fclose(out) != 0)
+    res = -1;
+    return res;
+}
+
+/* --HELPER FUNCTION--
+
+MOUNTS THE CRASH COPY AND MAKES IT THE INSTANCE OF THIS THREAD
+RETURNS THE INSTANCE OR,
+RETURNS NULL ON FAILURE
+
+*/
+
+static sfs_t* crashmount(const char* image){
+    if(copyimage(image, CRASH_IMAGE) != 0)
+    return NULL;
+    sfs_t* crash = sfs_mount(CRASH_IMAGE, NULL);
+    if(crash != NULL)
+    sfs_use(crash);
+    return crash;
+}
+
+static void test_journal(void){
+    //--A SMALL DISK, SO THE SECOND FILE HAS TO REUSE THE BLOCKS THE FIRST ONE FREES--
+    struct sfs_mount_opts opts = {1, BS, BS * 90LL, 4};
+    sfs_t* live = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(live != NULL);
+    if(live == NULL)
+    return;
+    sfs_use(live);
+    CHECK(writefile("a", 12 * BS, 1) == 12 * BS);
+    CHECK(sfs_sync() == 0);
+
+    sfs_t* crash = crashmount(TEST_IMAGE);
+    CHECK(crash != NULL);
+    CHECK(checkfile("a", 12 * BS, 1));
+    CHECK(sfs_fsck() == 0);
+    sfs_umount(crash);
+    sfs_use(live);
+
+    //--THE TRUNCATE IS NOT COMMITTED, SO ITS BLOCKS MUST NOT HOLD NEW DATA YET--
+    int fd = sfs_fopen("a");
+    CHECK(sfs_ftruncate(fd, 0) == 0);
+    CHECK(writefile("b", 12 * BS, 2) == 12 * BS);
+    crash = crashmount(TEST_IMAGE);
+    CHECK(crash != NULL);
+    int size = sfs_getfilesize("a");
+    CHECK(size == 0 || (size == 12 * BS && checkfile("a", 12 * BS, 1)));
+    sfs_umount(crash);
+    sfs_use(live);
+    sfs_fclose(fd);
+    sfs_umount(live);
+    sfs_use(NULL);
+}
+
+static void test_fsck(void){
+    mksfs(1);
+    CHECK(writefile("a", 20 * BS, 3) == 20 * BS);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(copyimage("sfs_disk", CRASH_IMAGE) == 0);
+    sfs_unmount();
+
+    //--THE BYTEMAP IS THE LAST BLOCK OF THE DEFAULT GEOMETRY, WIPE IT--
+    char zero[BS] = {0};
+    FILE* f = fopen(CRASH_IMAGE, "r+b");
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    fseek(f, -BS, SEEK_END);
+    CHECK(fwrite(zero, 1, BS, f) == BS);
+    fclose(f);
+
+    //--THE MOUNT SEES A DIRTY DISK AND REBUILDS THE BYTEMAP, SO NEW BLOCKS MISS "a"--
+    sfs_t* crash = sfs_mount(CRASH_IMAGE, NULL);
+    CHECK(crash != NULL);
+    if(crash == NULL)
+    return;
+    sfs_use(crash);
+    CHECK(sfs_fsck() == 0);
+    CHECK(writefile("b", 40 * BS, 4) == 40 * BS);
+    CHECK(checkfile("a", 20 * BS, 3));
+    CHECK(checkfile("b", 40 * BS, 4));
+    sfs_umount(crash);
+    sfs_use(NULL);
+}
+
+static void test_snapshot(void){
+    static char a[20 * BS], b[20 * BS], expect[20 * BS];
+    fill(a, sizeof(a), 5);
+    fill(b, sizeof(b), 6);
+    mksfs(1);
+    CHECK(writefile("big", sizeof(a), 5) == sizeof(a));
+    CHECK(writefile("small", 5, 7) == 5);
+    CHECK(sfs_clone("big", "copy") == 0);
+    CHECK(sfs_clone("big", "small") == -1);
+
+    //--WRITES TO THE CLONE STAY IN THE CLONE--
+    int fd = sfs_fopen("copy");
+    sfs_fseek(fd, 0);
+    sfs_fwrite(fd, b, 100);
+    sfs_fseek(fd, 15 * BS + 3);
+    sfs_fwrite(fd, b, 600);
+    sfs_fclose(fd);
+    memcpy(expect, a, sizeof(a));
+    memcpy(expect, b, 100);
+    memcpy(expect + 15 * BS + 3, b, 600);
+    CHECK(samefile("big", a, sizeof(a)));
+    CHECK(samefile("copy", expect, sizeof(expect)));
+
+    //--THE SNAPSHOT KEEPS WHAT THE FILES HELD WHEN IT WAS TAKEN--
+    int id = sfs_snapshot_create();
+    CHECK(id >= 0);
+    fd = sfs_fopen("big");
+    sfs_fseek(fd, 0);
+    sfs_fwrite(fd, b, sizeof(b));
+    sfs_fclose(fd);
+    sfs_remove("small");
+    int snap = sfs_snapshot_open(id, "big");
+    CHECK(snap >= 0 && samefd(snap, a, sizeof(a)));
+    CHECK(sfs_fwrite(snap, b, 1) == -1 && sfs_ftruncate(snap, 0) == -1);
+    int small = sfs_snapshot_open(id, "small");
+    CHECK(small >= 0 && sfs_fread(small, expect, 5) == 0);
+    sfs_fclose(small);
+    CHECK(sfs_snapshot_open(id, "new") == -1);
+    CHECK(sfs_snapshot_open(id + 1, "big") == -1);
+
+    //--THE LIVE FILE SYSTEM STAYS WRITABLE NEXT TO THE OPEN SNAPSHOT FILE--
+    CHECK(writefile("new", 100, 12) == 100);
+    fd = sfs_fopen("big");
+    sfs_fseek(fd, 0);
+    CHECK(sfs_fwrite(fd, a, BS) == BS);
+    sfs_fseek(fd, 0);
+    CHECK(sfs_fwrite(fd, b, BS) == BS);
+    sfs_fclose(fd);
+    CHECK(samefd(snap, a, sizeof(a)));
+    CHECK(samefile("big", b, sizeof(b)));
+    CHECK(sfs_getfilesize("small") == -1);
+
+    SFS_DIR* dir = sfs_snapshot_opendir(id);
+    struct sfs_dirent ents[4];
+    CHECK(dir != NULL && sfs_readdir_plus(dir, ents, 4) == 3);
+    sfs_closedir(dir);
+    CHECK(sfs_snapshot_delete(id) == -1);
+    sfs_fclose(snap);
+    CHECK(sfs_snapshot_delete(id) == 0);
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_dedup(void){
+    static char expect[8 * BS];
+    mksfs(1);
+    CHECK(sfs_dedup(1) == 0);
+    char name[] = "f0";
+    for(int i = 0; i < 3; i++){
+        name[1] = '0' + i;
+        CHECK(writefile(name, 8 * BS, 8) == 8 * BS);
+    }
+    struct sfs_dedup_stats stats;
+    CHECK(sfs_dedup_stats(&stats) == 0);
+    CHECK(stats.blocks_shared >= 16);
+
+    //--A WRITE TO A SHARED BLOCK MOVES IT--
+    int fd = sfs_fopen("f0");
+    sfs_fseek(fd, BS + 10);
+    sfs_fwrite(fd, "XYZ", 3);
+    sfs_fclose(fd);
+    fill(expect, sizeof(expect), 8);
+    CHECK(checkfile("f1", 8 * BS, 8));
+    CHECK(checkfile("f2", 8 * BS, 8));
+    memcpy(expect + BS + 10, "XYZ", 3);
+    CHECK(samefile("f0", expect, sizeof(expect)));
+    CHECK(sfs_dedup(0) == 0);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(samefile("f0", expect, sizeof(expect)));
+    CHECK(checkfile("f2", 8 * BS, 8));
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_compress(void){
+    static char text[60 * BS + 100], expect[60 * BS + 100];
+    static const char* words[] = {"the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog\n"};
+    int n = sizeof(text);
+    for(int i = 0, w = 0; i < n; w++){
+        for(const char* c = words[(w * 5 + w / 8) % 8]; *c != '\0' && i < n; c++)
+        text[i++] = *c;
+    }
+    mksfs(1);
+    int fd = sfs_fopen("txt");
+    CHECK(sfs_fcompress(fd, 1) == 0);
+    for(int off = 0; off < n; off += 700)
+    sfs_fwrite(fd, text + off, n - off < 700 ? n - off : 700);
+    sfs_fseek(fd, 3000);
+    sfs_fwrite(fd, "PATCHED", 7);
+    sfs_fclose(fd);
+    memcpy(expect, text, n);
+    memcpy(expect + 3000, "PATCHED", 7);
+    fd = sfs_fopen("rnd");
+    CHECK(sfs_fcompress(fd, 1) == 0);
+    sfs_fclose(fd);
+    CHECK(writefile("rnd", 30 * BS, 9) == 30 * BS);
+    sfs_unmount();
+
+    mksfs(0);
+    CHECK(samefile("txt", expect, n));
+    CHECK(checkfile("rnd", 30 * BS, 9));
+    char piece[333];
+    fd = sfs_fopen("txt");
+    for(int off = 0; off < n; off += sizeof(piece)){
+        int len = n - off < (int)sizeof(piece) ? n - off : (int)sizeof(piece);
+        sfs_fseek(fd, off);
+        if(sfs_fread(fd, piece, len) != len || memcmp(piece, expect + off, len) != 0){
+            CHECK(!"compressed piece read back");
+            break;
+        }
+    }
+    sfs_fclose(fd);
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_truncate(void){
+    static char expect[40 * BS];
+    int n = sizeof(expect);
+    mksfs(1);
+
+    //--SHRINK, THEN GROW OVER A HOLE THAT READS AS ZEROS--
+    CHECK(writefile("t", n, 10) == n);
+    int fd = sfs_fopen("t");
+    CHECK(sfs_ftruncate(fd, 5 * BS + 10) == 0);
+    CHECK(sfs_getfilesize("t") == 5 * BS + 10);
+    CHECK(sfs_ftruncate(fd, 20 * BS) == 0);
+    sfs_fclose(fd);
+    fill(expect, n, 10);
+    memset(expect + 5 * BS + 10, 0, 20 * BS - (5 * BS + 10));
+    CHECK(samefile("t", expect, 20 * BS));
+
+    //--PREALLOCATED BLOCKS READ AS ZEROS AND THE SIZE COVERS THEM--
+    fd = sfs_fopen("p");
+    CHECK(sfs_fallocate(fd, 0, 30 * BS) == 0);
+    CHECK(sfs_fallocate(fd, -1, BS) == -1);
+    sfs_fclose(fd);
+    memset(expect, 0, n);
+    CHECK(samefile("p", expect, 30 * BS));
+
+    //--A PUNCHED RANGE READS AS ZEROS, THE SIZE STAYS--
+    CHECK(writefile("h", 12 * BS, 11) == 12 * BS);
+    fd = sfs_fopen("h");
+    CHECK(sfs_punch_hole(fd, 2 * BS + 100, 4 * BS) == 0);
+    sfs_fclose(fd);
+    fill(expect, 12 * BS, 11);
+    memset(expect + 2 * BS + 100, 0, 4 * BS);
+    CHECK(samefile("h", expect, 12 * BS));
+    sfs_unmount();
+
+    mksfs(0);
+    CHECK(samefile("h", expect, 12 * BS));
+    CHECK(sfs_getfilesize("p") == 30 * BS);
+    CHECK(sfs_fsck() == 0);
+
+    //--A PREALLOCATION THE DISK CANNOT HOLD LEAVES THE SIZE AND GIVES ITS BLOCKS BACK--
+    char name[8];
+    int res = 0;
+    for(int i = 0; i < 8 && res == 0; i++){
+        sprintf(name, "full%d", i);
+        fd = sfs_fopen(name);
+        res = sfs_fallocate(fd, 0, 140 * BS);
+        sfs_fclose(fd);
+    }
+    CHECK(res == -1 && sfs_getfilesize(name) == 0);
+    CHECK(sfs_sync() == 0);
+    fd = sfs_fopen("last");
+    CHECK(sfs_fallocate(fd, 0, BS) == 0);
+    sfs_fclose(fd);
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+
+    //--CUTTING A COMPRESSED GROUP SHORT REWRITES IT, ON A FULL DISK THAT FAILS AND THE SIZE STAYS--
+    struct sfs_mount_opts opts = {1, BS, BS * 100LL, 8};
+    sfs_t* f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    sfs_use(f);
+    for(int i = 0; i < 8 * BS; i++)
+    expect[i] = "abcd"[i % 4];
+    fd = sfs_fopen("c");
+    CHECK(sfs_fcompress(fd, 1) == 0);
+    CHECK(sfs_fwrite(fd, expect, 8 * BS) == 8 * BS);
+    CHECK(writefile("rest", n, 12) > 0);
+    CHECK(sfs_sync() == 0);
+    CHECK(sfs_ftruncate(fd, 1000) == -1);
+    CHECK(samefd(fd, expect, 8 * BS));
+    sfs_fclose(fd);
+    CHECK(sfs_fsck() == 0);
+    sfs_umount(f);
+    sfs_use(NULL);
+}
+
+static void test_inline(void){
+    static char expect[3 * BS];
+    int n = sizeof(expect);
+    fill(expect, n, 90);
+    mksfs(1);
+    //--WRITTEN IN TWO PIECES, BOTH INSIDE THE I-NODE RECORD--
+    int fd = sfs_fopen("s");
+    CHECK(sfs_fwrite(fd, expect, 100) == 100);
+    CHECK(sfs_fwrite(fd, expect + 100, INLINE_SIZE - 100) == INLINE_SIZE - 100);
+    sfs_fclose(fd);
+    CHECK(writefile("t", 200, 91) == 200);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(samefile("s", expect, INLINE_SIZE));
+    CHECK(checkfile("t", 200, 91));
+
+    //--ONE BYTE MORE MOVES THE FILE TO DATA BLOCKS WITH ITS CONTENT--
+    fd = sfs_fopen("s");
+    CHECK(sfs_fwrite(fd, expect + INLINE_SIZE, n - INLINE_SIZE) == n - INLINE_SIZE);
+    CHECK(samefd(fd, expect, n));
+
+    //--TRUNCATING THE PROMOTED FILE AND THE INLINE ONE, THEN GROWING THEM OVER ZEROS--
+    CHECK(sfs_ftruncate(fd, 100) == 0);
+    CHECK(sfs_ftruncate(fd, 400) == 0);
+    sfs_fclose(fd);
+    memset(expect + 100, 0, 300);
+    CHECK(samefile("s", expect, 400));
+    static char small[INLINE_SIZE];
+    fill(small, 50, 91);
+    fd = sfs_fopen("t");
+    CHECK(sfs_ftruncate(fd, 50) == 0);
+    CHECK(sfs_ftruncate(fd, 150) == 0);
+    sfs_fclose(fd);
+    CHECK(samefile("t", small, 150));
+
+    //--A WRITE AT THE LARGEST OFFSET TAKES NOTHING, A SEEK PAST IT FAILS--
+    fd = sfs_fopen("t");
+    CHECK(sfs_fseek(fd, 2147483000) == -1);
+    CHECK(sfs_fseek(fd, MAX_SIZE + 1) == -1);
+    CHECK(sfs_fseek(fd, MAX_SIZE) == 0);
+    CHECK(sfs_fwrite(fd, expect, 1000) == 0);
+    CHECK(sfs_fseek(fd, MAX_SIZE - 10) == 0);
+    CHECK(sfs_fwrite(fd, expect, 1000) == 10);
+    CHECK(sfs_getfilesize("t") == MAX_SIZE);
+    sfs_fclose(fd);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(samefile("s", expect, 400));
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_copy(void){
+    static char expect[3 * BS + 7];
+    //--26 DATA BLOCKS, "a" TAKES 16 OF THEM (WITH ITS INDIRECT BLOCK) SO ONLY SHARING FITS A SECOND COPY--
+    struct sfs_mount_opts opts = {1, BS, BS * 100LL, 8};
+    sfs_t* f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    sfs_use(f);
+    int size = 14 * BS + 300;
+    char* a = malloc(size);
+    fill(a, size, 110);
+    CHECK(writefile("a", size, 110) == size);
+    int src = sfs_fopen("a");
+    int dst = sfs_fopen("b");
+    CHECK(sfs_copy_range(src, 0, dst, 0, size) == size);
+    CHECK(samefd(dst, a, size));
+
+    //--THE SOURCE MOVES ITS BLOCK BEFORE THE WRITE, THE COPY KEEPS THE OLD ONE--
+    sfs_fseek(src, 3 * BS + 5);
+    CHECK(sfs_fwrite(src, "XYZ", 3) == 3);
+    CHECK(samefd(dst, a, size));
+    memcpy(a + 3 * BS + 5, "XYZ", 3);
+    CHECK(samefd(src, a, size));
+    sfs_fclose(dst);
+
+    //--DIFFERENT POSITIONS IN A BLOCK, EVERYTHING GOES THROUGH THE BUFFER--
+    dst = sfs_fopen("c");
+    CHECK(sfs_copy_range(src, 100, dst, 7, 3 * BS) == 3 * BS);
+    memset(expect, 0, 7);
+    memcpy(expect + 7, a + 100, 3 * BS);
+    CHECK(samefd(dst, expect, sizeof(expect)));
+
+    //--THE END OF THE SOURCE CLIPS THE COPY, BAD RANGES ARE REFUSED--
+    CHECK(sfs_copy_range(src, size - 200, dst, 0, 1000) == 200);
+    memcpy(expect, a + size - 200, 200);
+    CHECK(samefd(dst, expect, sizeof(expect)));
+    CHECK(sfs_copy_range(src, 0, src, BS, 2 * BS) == -1);
+    CHECK(sfs_copy_range(src, BS, src, 0, 2 * BS) == -1);
+    CHECK(sfs_copy_range(src, 0, dst, 2147483000, 1000) == -1);
+    CHECK(sfs_copy_range(src, 2147483000, dst, 0, 1000) == -1);
+    CHECK(sfs_copy_range(src, 0, dst, 0, -1) == -1);
+    CHECK(samefd(src, a, size));
+    sfs_fclose(dst);
+    sfs_fclose(src);
+    sfs_umount(f);
+
+    f = sfs_mount(TEST_IMAGE, NULL);
+    CHECK(f != NULL);
+    if(f != NULL){
+        sfs_use(f);
+        CHECK(samefile("a", a, size));
+        CHECK(checkfile("b", size, 110));
+        CHECK(samefile("c", expect, sizeof(expect)));
+        CHECK(sfs_fsck() == 0);
+        sfs_umount(f);
+    }
+    sfs_use(NULL);
+    free(a);
+}
+
+static void test_defrag(void){
+    static char buf[4][20 * BS + 33];
+    int size = sizeof(buf[0]);
+    char name[] = "f0";
+    int fd[4];
+    mksfs(1);
+    //--WRITING THE FILES A BLOCK AT A TIME IN TURN INTERLEAVES THEIR BLOCKS--
+    for(int i = 0; i < 4; i++){
+        fill(buf[i], size, 20 + i);
+        name[1] = '0' + i;
+        fd[i] = sfs_fopen(name);
+    }
+    for(int off = 0; off < size; off += BS){
+        for(int i = 0; i < 4; i++)
+        sfs_fwrite(fd[i], buf[i] + off, size - off < BS ? size - off : BS);
+    }
+    for(int i = 0; i < 4; i++)
+    sfs_fclose(fd[i]);
+    CHECK(sfs_fragmentation() > 0);
+    struct sfs_defrag_stats stats;
+    CHECK(sfs_defrag_start(0) == 0);
+    CHECK(sfs_defrag_wait(&stats) == 0);
+    CHECK(stats.score_before > 0 && stats.score_after == 0 && stats.blocks_moved > 0);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(sfs_fragmentation() == 0);
+    for(int i = 0; i < 4; i++){
+        name[1] = '0' + i;
+        CHECK(samefile(name, buf[i], size));
+    }
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_log(void){
+    static char expect[40 * BS], patch[700];
+    mksfs(1);
+    CHECK(sfs_logmode(1) == 0);
+    CHECK(writefile("big", sizeof(expect), 30) == sizeof(expect));
+    fill(expect, sizeof(expect), 30);
+    int fd = sfs_fopen("big");
+    for(int k = 0; k < 20; k++){
+        int off = (k * 3571) % (39 * BS);
+        fill(patch, sizeof(patch), 31 + k);
+        sfs_fseek(fd, off);
+        sfs_fwrite(fd, patch, sizeof(patch));
+        memcpy(expect + off, patch, sizeof(patch));
+    }
+    sfs_fclose(fd);
+    CHECK(samefile("big", expect, sizeof(expect)));
+    struct sfs_log_stats stats;
+    CHECK(sfs_log_stats(&stats) == 0);
+    CHECK(stats.blocks_appended >= 40 && stats.device_writes < stats.blocks_appended);
+    CHECK(sfs_logmode(0) == 0);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(samefile("big", expect, sizeof(expect)));
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_grow(void){
+    struct sfs_mount_opts opts = {1, BS, BS * 100LL, 8};
+    sfs_t* f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    sfs_use(f);
+    //--THE DISK FILLS UP PART WAY THROUGH THE FILE--
+    int size = 100 * BS;
+    char* buf = malloc(size);
+    fill(buf, size, 40);
+    int fd = sfs_fopen("f");
+    int n = sfs_fwrite(fd, buf, size);
+    CHECK(n >= 0 && n < size);
+    CHECK(sfs_grow(BS * 400LL) == 0);
+    if(n > 0)
+    CHECK(sfs_fwrite(fd, buf + n, size - n) == size - n);
+    sfs_fclose(fd);
+    CHECK(samefile("f", buf, size));
+    CHECK(sfs_grow(BS * 200LL) == -1);
+    sfs_umount(f);
+
+    f = sfs_mount(TEST_IMAGE, NULL);
+    CHECK(f != NULL);
+    if(f != NULL){
+        sfs_use(f);
+        CHECK(samefile("f", buf, size));
+        CHECK(sfs_fsck() == 0);
+        sfs_umount(f);
+    }
+
+    //--WITHOUT A STEP THE WRITE STOPS SHORT, WITH ONE IT GROWS THE DISK AS OFTEN AS IT NEEDS--
+    f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL){
+        free(buf);
+        return;
+    }
+    sfs_use(f);
+    fd = sfs_fopen("short");
+    CHECK(sfs_autogrow(0) == 0);
+    n = sfs_fwrite(fd, buf, size);
+    CHECK(n >= 0 && n < size);
+    sfs_fclose(fd);
+    CHECK(sfs_autogrow(-1) == -1);
+    CHECK(sfs_autogrow(BS * 30LL) == 0);
+    fd = sfs_fopen("auto");
+    CHECK(sfs_fwrite(fd, buf, size) == size);
+    CHECK(samefd(fd, buf, size));
+    sfs_fclose(fd);
+    sfs_umount(f);
+
+    f = sfs_mount(TEST_IMAGE, NULL);
+    CHECK(f != NULL);
+    if(f != NULL){
+        sfs_use(f);
+        CHECK(samefile("short", buf, n));
+        CHECK(samefile("auto", buf, size));
+        CHECK(sfs_fsck() == 0);
+        sfs_umount(f);
+    }
+    sfs_use(NULL);
+    free(buf);
+}
+
+/* --HELPER FUNCTION--
+
+WAITS UP TO A SECOND FOR THE PREFETCH THREAD TO HAVE LOADED want BLOCKS
+RETURNS THE CACHE COUNTERS OF THE LAST LOOK
+
+*/
+
+static struct sfs_cache_stats prefetchwait(long long want){
+    struct sfs_cache_stats stats;
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    for(int i = 0; i < 100 && sfs_cache_stats(&stats) == 0 && stats.prefetched < want; i++)
+    nanosleep(&pause, NULL);
+    return stats;
+}
+
+static void test_fadvise(void){
+    static char buf[40 * BS];
+    struct sfs_cache_stats stats;
+    mksfs(1);
+    CHECK(writefile("r", sizeof(buf), 50) == sizeof(buf));
+    sfs_unmount();
+    mksfs(0);
+    int fd = sfs_fopen("r");
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.cached_blocks == 0);
+
+    //--THE PREFETCHED RANGE IS READ WITHOUT A MISS--
+    CHECK(sfs_fadvise(fd, 0, 16 * BS, SFS_FADV_WILLNEED) == 0);
+    stats = prefetchwait(16);
+    CHECK(stats.prefetched == 16 && stats.cached_blocks == 16);
+    CHECK(sfs_fadvise(fd, 0, 0, SFS_FADV_RANDOM) == 0);
+    sfs_fseek(fd, 0);
+    CHECK(sfs_fread(fd, buf, 16 * BS) == 16 * BS);
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.hits == 16 && stats.misses == 0);
+
+    //--A DROPPED RANGE MISSES AGAIN--
+    CHECK(sfs_fadvise(fd, 0, 0, SFS_FADV_DONTNEED) == 0);
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.cached_blocks == 0);
+    sfs_fseek(fd, 0);
+    CHECK(sfs_fread(fd, buf, BS) == BS);
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.misses == 1);
+
+    //--A RANDOM READER GOING ON WHERE IT STOPPED IS NOT READ AHEAD OF, A NORMAL ONE IS--
+    for(int k = 1; k < 20; k++)
+    CHECK(sfs_fread(fd, buf, BS) == BS);
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.readahead == 0 && stats.misses == 20);
+    CHECK(sfs_fadvise(fd, 0, 0, SFS_FADV_NORMAL) == 0);
+    for(int k = 20; k < 30; k++)
+    CHECK(sfs_fread(fd, buf, BS) == BS);
+    CHECK(sfs_cache_stats(&stats) == 0 && stats.readahead > 0);
+    CHECK(sfs_fadvise(fd, 0, 0, 9) == -1);
+    sfs_fclose(fd);
+    sfs_unmount();
+}
+
+static void test_tiers(void){
+    struct sfs_mount_opts opts = {1, 1024, 600 * 1024LL, 64, SLOW_IMAGE, 250 * 1024LL, 0};
+    sfs_t* f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    sfs_use(f);
+    struct sfs_tier_stats before, after;
+    CHECK(sfs_tier_stats(&before) == 0);
+    CHECK(writefile("cold", 30000, 50) == 30000);
+    int fd = sfs_fopen("cold");
+    CHECK(sfs_ftier(fd, SFS_TIER_SLOW) > 0);
+    CHECK(sfs_ftier(fd, SFS_TIER_SLOW) == 0);
+    CHECK(sfs_ftier(fd, 7) == -1);
+    sfs_fclose(fd);
+    CHECK(sfs_tier_stats(&after) == 0);
+    CHECK(after.slow_free < before.slow_free && after.demotions >= 1);
+    CHECK(checkfile("cold", 30000, 50));
+    sfs_umount(f);
+
+    //--THE DISK NEEDS BOTH IMAGES TO MOUNT AGAIN--
+    struct sfs_mount_opts both = {0, 0, 0, 0, SLOW_IMAGE};
+    f = sfs_mount(TEST_IMAGE, &both);
+    CHECK(f != NULL);
+    if(f != NULL){
+        sfs_use(f);
+        CHECK(checkfile("cold", 30000, 50));
+        fd = sfs_fopen("cold");
+        CHECK(sfs_ftier(fd, SFS_TIER_FAST) > 0);
+        sfs_fclose(fd);
+        CHECK(checkfile("cold", 30000, 50));
+        CHECK(sfs_fsck() == 0);
+        sfs_umount(f);
+    }
+    sfs_use(NULL);
+}
+
+static void test_batch(void){
+    char names[40][16];
+    char* list[40];
+    int status[40];
+    struct sfs_dirent ents[40];
+    for(int i = 0; i < 40; i++){
+        sprintf(names[i], "file%03d", i);
+        list[i] = names[i];
+    }
+    //--NO MORE FILES THAN THE DIRECTORY CAN NAME--
+    CHECK(sfs_max_files(BS) == 12 * (BS / 32));
+    CHECK(sfs_mkfs(BS, 2000LL * BS, sfs_max_files(BS) + 2) == -1);
+    mksfs(1);
+    CHECK(sfs_create_many(list, 40, status) == 40);
+    //--THE FILES GO ROUND THE ALLOCATION GROUPS LIKE sfs_fopen's (26 I-NODES EACH ON mksfs(1))--
+    CHECK(status[0] / 26 != status[1] / 26 && status[1] / 26 != status[2] / 26 && status[0] / 26 != status[2] / 26);
+    CHECK(writefile(list[5], 5, 60) == 5);
+    //--EXISTING NAMES KEEP THEIR I-NODES--
+    int inode = status[5];
+    CHECK(sfs_create_many(list, 10, status) == 10 && status[5] == inode);
+    CHECK(sfs_stat_many(list, 40, ents) == 40);
+    CHECK(ents[5].inode == inode && ents[5].size == 5 && ents[6].size == 0);
+
+    //--THE CURSOR RETURNS EACH NAME ONCE, AND A SAVED POSITION READS THE SAME AGAIN--
+    SFS_DIR* dir = sfs_opendir();
+    CHECK(dir != NULL);
+    if(dir != NULL){
+        struct sfs_dirent first[7], again[7];
+        int total = sfs_readdir_plus(dir, ents, 7);
+        int pos = sfs_telldir(dir);
+        CHECK(sfs_readdir_plus(dir, first, 7) == 7);
+        CHECK(sfs_seekdir(dir, pos) == 0);
+        CHECK(sfs_readdir_plus(dir, again, 7) == 7);
+        CHECK(memcmp(first, again, sizeof(first)) == 0);
+        total += 7;
+        int n;
+        while((n = sfs_readdir_plus(dir, ents, 7)) > 0)
+        total += n;
+        CHECK(total == 40);
+        sfs_closedir(dir);
+    }
+    CHECK(sfs_remove_many(list, 40, status) == 40);
+    CHECK(sfs_remove_many(list, 1, status) == 0 && status[0] == -1);
+    char name[MAXFILENAME];
+    CHECK(sfs_getnextfilename(name) == 0);
+    CHECK(sfs_fsck() == 0);
+    sfs_unmount();
+}
+
+static void test_heap(void){
+    char buf[3 * BS], back[3 * BS];
+    fill(buf, sizeof(buf), 70);
+    mksfs(1);
+    //--THE FIRST ROUNDS FILL THE SCRATCH ARENA AND THE JOURNAL POOL--
+    long long warm = 0;
+    for(int round = 0; round < 20; round++){
+        if(round == 10)
+        warm = sfs_heap_allocs();
+        int fd = sfs_fopen("h");
+        sfs_fseek(fd, 0);
+        CHECK(sfs_fwrite(fd, buf, sizeof(buf)) == sizeof(buf));
+        sfs_fseek(fd, 0);
+        CHECK(sfs_fread(fd, back, sizeof(back)) == sizeof(back));
+        CHECK(sfs_fclose(fd) == 0);
+    }
+    CHECK(memcmp(buf, back, sizeof(buf)) == 0);
+    CHECK(sfs_heap_allocs() == warm);
+    sfs_unmount();
+}
+
+#define SHARED_WRITERS 4
+#define SHARED_RECORDS 30
+
+static int shared_fd;
+
+/* --HELPER FUNCTION--
+
+WRITES SHARED_RECORDS BLOCKS OF 'a' + THE WRITER'S NUMBER THROUGH shared_fd
+
+*/
+
+static void* sharedwriter(void* arg){
+    char rec[BS];
+    memset(rec, 'a' + (int)(long)arg, BS);
+    for(int i = 0; i < SHARED_RECORDS; i++)
+    CHECK(sfs_fwrite(shared_fd, rec, BS) == BS);
+    return NULL;
+}
+
+/* --HELPER FUNCTION--
+
+OPENS, WRITES, CLOSES AND REMOVES FILES WHILE THE WRITERS RUN
+
+*/
+
+static void* sharedchurn(void* arg){
+    char name[8];
+    for(int i = 0; i < 50; i++){
+        sprintf(name, "c%d", i % 5);
+        int fd = sfs_fopen(name);
+        CHECK(fd >= 0);
+        CHECK(sfs_fwrite(fd, name, 2) == 2);
+        CHECK(sfs_fclose(fd) == 0);
+        if(i % 3 == 0)
+        CHECK(sfs_remove(name) == 0);
+    }
+    return NULL;
+}
+
+static void test_shared(void){
+    pthread_t writers[SHARED_WRITERS], churn;
+    int counts[SHARED_WRITERS] = {0};
+    char* back = malloc(SHARED_WRITERS * SHARED_RECORDS * BS);
+    mksfs(1);
+    shared_fd = sfs_fopen("s");
+    pthread_create(&churn, NULL, sharedchurn, NULL);
+    for(long t = 0; t < SHARED_WRITERS; t++)
+    pthread_create(&writers[t], NULL, sharedwriter, (void*)t);
+    for(int t = 0; t < SHARED_WRITERS; t++)
+    pthread_join(writers[t], NULL);
+    pthread_join(churn, NULL);
+    //--EVERY BLOCK IS ONE WHOLE RECORD, AND NO RECORD WAS WRITTEN OVER--
+    sfs_fseek(shared_fd, 0);
+    CHECK(sfs_fread(shared_fd, back, SHARED_WRITERS * SHARED_RECORDS * BS) == SHARED_WRITERS * SHARED_RECORDS * BS);
+    for(int b = 0; b < SHARED_WRITERS * SHARED_RECORDS; b++){
+        int t = back[b * BS] - 'a';
+        int whole = t >= 0 && t < SHARED_WRITERS;
+        for(int i = 1; whole && i < BS; i++)
+        whole = back[b * BS + i] == back[b * BS];
+        CHECK(whole);
+        if(whole)
+        counts[t]++;
+    }
+    for(int t = 0; t < SHARED_WRITERS; t++)
+    CHECK(counts[t] == SHARED_RECORDS);
+    CHECK(sfs_fclose(shared_fd) == 0);
+    free(back);
+    sfs_unmount();
+}
+
+/* --HELPER FUNCTION--
+
+RETURNS 1 IF TRACE FILE path HOLDS EXACTLY THE n CALLS OF expect (EACH A LINE WITHOUT ITS
+TIME), WITH TIMES THAT DO NOT GO BACK AND FIELDS sfs_replay CAN READ, 0 IF NOT
+
+*/
+
+static int sametrace(const char* path, const char** expect, int n){
+    FILE* in = fopen(path, "r");
+    if(in == NULL)
+    return 0;
+    char line[256], op[16], word[64];
+    long long time, last = 0;
+    int arg, rest;
+    int count = 0;
+    int ok = 1;
+    while(ok && fgets(line, sizeof(line), in) != NULL){
+        if(line[0] == '#')
+        continue;
+        line[strcspn(line, "\n")] = '\0';
+        op[0] = '\0';
+        //--THE FIELDS AS sfs_replay PARSES THEM: close AND remove HAVE NO NUMBER AFTER THE WORD--
+        int fields = sscanf(line, "%lld %15s %63s %d", &time, op, word, &arg);
+        int want = strcmp(op, "close") == 0 || strcmp(op, "remove") == 0 ? 3 : 4;
+        ok = sscanf(line, "%lld %n", &time, &rest) == 1 && fields == want && time >= last
+             && count < n && strcmp(line + rest, expect[count]) == 0;
+        last = time;
+        count++;
+    }
+    fclose(in);
+    return ok && count == n;
+}
+
+static void test_trace(void){
+    char buf[1000];
+    char lines[6][32];
+    const char* expect[6];
+    fill(buf, sizeof(buf), 120);
+    mksfs(1);
+    CHECK(sfs_trace(TRACE_FILE) == 0);
+    int fd = sfs_fopen("t");
+    CHECK(sfs_fwrite(fd, buf, 1000) == 1000);
+    CHECK(sfs_fseek(fd, 100) == 0);
+    CHECK(sfs_fread(fd, buf, 1000) == 900);
+    sfs_fclose(fd);
+    sfs_remove("t");
+    CHECK(sfs_trace(NULL) == 0);
+    sprintf(lines[0], "open t %d", fd);
+    sprintf(lines[1], "write %d 1000", fd);
+    sprintf(lines[2], "seek %d 100", fd);
+    sprintf(lines[3], "read %d 900", fd);
+    sprintf(lines[4], "close %d", fd);
+    sprintf(lines[5], "remove t");
+    for(int i = 0; i < 6; i++)
+    expect[i] = lines[i];
+
+    //--NOTHING IS ADDED ONCE THE TRACE IS STOPPED--
+    CHECK(writefile("u", 10, 121) == 10);
+    CHECK(sametrace(TRACE_FILE, expect, 6));
+
+    //--THE UNMOUNT ENDS A TRACE, THE NEXT MOUNT DOES NOT TRACE--
+    CHECK(sfs_trace(TRACE_FILE) == 0);
+    fd = sfs_fopen("u");
+    sprintf(lines[0], "open u %d", fd);
+    sfs_unmount();
+    mksfs(0);
+    CHECK(writefile("u", 10, 121) == 10);
+    CHECK(sametrace(TRACE_FILE, expect, 1));
+    CHECK(sfs_trace(NULL) == 0);
+    sfs_unmount();
+    CHECK(sfs_trace(TRACE_FILE) == -1);
+}
+
+static pthread_barrier_t bound_barrier;
+
+/* --HELPER FUNCTION--
+
+STAYS BOUND TO THE INSTANCE arg BETWEEN TWO WAITS ON bound_barrier
+
+*/
+
+static void* boundthread(void* arg){
+    sfs_use(arg);
+    CHECK(writefile("b", 100, 81) == 100);
+    pthread_barrier_wait(&bound_barrier);
+    pthread_barrier_wait(&bound_barrier);
+    sfs_use(NULL);
+    return NULL;
+}
+
+static void test_umount(void){
+    struct sfs_mount_opts opts = {1, BS, BS * 200LL, 16};
+    sfs_t* f = sfs_mount(TEST_IMAGE, &opts);
+    CHECK(f != NULL);
+    if(f == NULL)
+    return;
+    pthread_t t;
+    pthread_barrier_init(&bound_barrier, NULL, 2);
+    pthread_create(&t, NULL, boundthread, f);
+    pthread_barrier_wait(&bound_barrier);
+    CHECK(sfs_umount(f) == -1);
+    //--THE HANDLE FUNCTIONS STILL WORK ON IT--
+    int fd = sfs_open(f, "b");
+    char back[100];
+    CHECK(sfs_seek(f, fd, 0) == 0 && sfs_read(f, fd, back, 100) == 100);
+    CHECK(sfs_close(f, fd) == 0);
+    pthread_barrier_wait(&bound_barrier);
+    pthread_join(t, NULL);
+    pthread_barrier_destroy(&bound_barrier);
+    //--THE CALLER'S OWN BINDING DOES NOT KEEP IT MOUNTED--
+    sfs_use(f);
+    CHECK(checkfile("b", 100, 81));
+    CHECK(sfs_umount(f) == 0);
+    CHECK(sfs_use(NULL) == NULL);
+}
+
+int main(){
+    struct {
+        const char* name;
+        void (*run)(void);
+    } tests[] = {
+        {"journal", test_journal}, {"fsck", test_fsck}, {"snapshot", test_snapshot},
+        {"dedup", test_dedup}, {"compress", test_compress}, {"truncate", test_truncate},
+        {"inline", test_inline}, {"copy", test_copy}, {"defrag", test_defrag},
+        {"log", test_log}, {"grow", test_grow}, {"fadvise", test_fadvise},
+        {"tiers", test_tiers}, {"batch", test_batch}, {"heap", test_heap},
+        {"shared", test_shared}, {"trace", test_trace}, {"umount", test_umount}
+    };
+    for(int i = 0; i < (int)(sizeof(tests) / sizeof(tests[0])); i++){
+        int before = error_count;
+        tests[i].run();
+        printf("%-10s %s\n", tests[i].name, error_count == before ? "ok" : "FAILED");
+    }
+    remove(TEST_IMAGE);
+    remove(CRASH_IMAGE);
+    remove(SLOW_IMAGE);
+    remove(TRACE_FILE);
+    fprintf(stderr, "Test program exiting with %d errors\n", error_count);
+    return error_count;
+}